@@ -0,0 +1,123 @@
+// Copyright 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "p4rt_perf_async_writer.h"
+
+#include <memory>
+#include <string>
+
+#include "p4/v1/p4runtime.grpc.pb.h"
+
+struct AsyncWriter::PendingWrite {
+  grpc::ClientContext context;
+  p4::v1::WriteResponse response;
+  grpc::Status status;
+  std::unique_ptr<grpc::ClientAsyncResponseReader<p4::v1::WriteResponse>>
+      reader;
+  absl::Time start;  // latency is measured from this time
+  absl::Time sent;
+};
+
+AsyncWriter::AsyncWriter(P4rtSession* session, uint32_t max_inflight)
+    : session_(session),
+      max_inflight_(max_inflight == 0 ? 1 : max_inflight),
+      reaper_(&AsyncWriter::ReapLoop, this) {}
+
+AsyncWriter::~AsyncWriter() {
+  Flush();
+  cq_.Shutdown();
+  reaper_.join();
+}
+
+void AsyncWriter::Write(const p4::v1::WriteRequest& write_request) {
+  WaitForRoom(absl::Now());
+  Start(write_request, absl::Now());
+}
+
+void AsyncWriter::WriteScheduled(const p4::v1::WriteRequest& write_request,
+                                 absl::Time scheduled) {
+  WaitForRoom(scheduled);
+  Start(write_request, scheduled);
+}
+
+void AsyncWriter::WaitForRoom(absl::Time ready) {
+  absl::MutexLock lock(&mu_);
+  auto has_room = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return num_inflight_ < max_inflight_;
+  };
+  mu_.Await(absl::Condition(&has_room));
+  queue_time_ += absl::Now() - ready;
+  num_inflight_++;
+  num_requests_++;
+}
+
+void AsyncWriter::Start(const p4::v1::WriteRequest& write_request,
+                        absl::Time start) {
+  // The request is serialized when the call starts.
+  auto* pending = new PendingWrite();
+  pending->start = start;
+  pending->sent = absl::Now();
+  pending->reader =
+      session_->Stub().AsyncWrite(&pending->context, write_request, &cq_);
+  pending->reader->Finish(&pending->response, &pending->status, pending);
+}
+
+void AsyncWriter::Flush() {
+  absl::MutexLock lock(&mu_);
+  auto drained = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return num_inflight_ == 0;
+  };
+  mu_.Await(absl::Condition(&drained));
+}
+
+void AsyncWriter::ReapLoop() {
+  void* tag;
+  bool ok;
+  while (cq_.Next(&tag, &ok)) {
+    std::unique_ptr<PendingWrite> pending(static_cast<PendingWrite*>(tag));
+    const absl::Time now = absl::Now();
+
+    absl::MutexLock lock(&mu_);
+    request_time_ += now - pending->sent;
+    latency_.Record(now - pending->start);
+    if (!ok || !pending->status.ok()) {
+      if (num_failed_requests_++ == 0) {
+        first_error_ = ok ? absl::Status(static_cast<absl::StatusCode>(
+                                             pending->status.error_code()),
+                                         pending->status.error_message())
+                          : absl::UnavailableError("Write request dropped");
+      }
+    }
+    num_inflight_--;
+  }
+}
+
+uint64_t AsyncWriter::NumRequests() {
+  absl::MutexLock lock(&mu_);
+  return num_requests_;
+}
+
+uint64_t AsyncWriter::NumFailedRequests() {
+  absl::MutexLock lock(&mu_);
+  return num_failed_requests_;
+}
+
+absl::Status AsyncWriter::FirstError() {
+  absl::MutexLock lock(&mu_);
+  return first_error_;
+}
+
+absl::Duration AsyncWriter::QueueTime() {
+  absl::MutexLock lock(&mu_);
+  return queue_time_;
+}
+
+absl::Duration AsyncWriter::RequestTime() {
+  absl::MutexLock lock(&mu_);
+  return request_time_;
+}
+
+LatencyHistogram AsyncWriter::Latency() {
+  absl::MutexLock lock(&mu_);
+  return latency_;
+}
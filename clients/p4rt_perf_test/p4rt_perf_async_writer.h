@@ -0,0 +1,88 @@
+// Copyright 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef P4RT_PERF_ASYNC_WRITER_H
+#define P4RT_PERF_ASYNC_WRITER_H
+
+#include <grpcpp/grpcpp.h>
+#include <stdint.h>
+
+#include <thread>
+
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "p4/v1/p4runtime.pb.h"
+#include "p4rt_perf_histogram.h"
+#include "p4rt_perf_session.h"
+
+// Sends write requests on a gRPC CompletionQueue, keeping up to a fixed
+// number of them in flight. A thread reaps the completions, so request
+// latencies are measured when the responses arrive.
+class AsyncWriter {
+ public:
+  AsyncWriter(P4rtSession* session, uint32_t max_inflight);
+  ~AsyncWriter();
+
+  AsyncWriter(const AsyncWriter&) = delete;
+  AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+  // Sends a write request, after waiting for a request in flight to
+  // complete if the window is full. The request can be reused as soon as
+  // the call returns.
+  void Write(const p4::v1::WriteRequest& write_request);
+
+  // Sends a write request that was due at a scheduled time, for open-loop
+  // load. Its latency is measured from that time rather than from when it
+  // is sent, so a request held back by a full window or by a late sender
+  // still counts the delay (corrected for coordinated omission).
+  void WriteScheduled(const p4::v1::WriteRequest& write_request,
+                      ::absl::Time scheduled);
+
+  // Waits for all the requests in flight to complete.
+  void Flush();
+
+  uint64_t NumRequests();
+  uint64_t NumFailedRequests();
+
+  // Status of the first request that failed.
+  ::absl::Status FirstError();
+
+  // Sum of the times requests waited for room in the window, or were sent
+  // after their scheduled time.
+  ::absl::Duration QueueTime();
+
+  // Sum of the times from sending a request to receiving its response.
+  // Unlike Latency(), it leaves out the delay before a scheduled request
+  // is sent, which QueueTime() counts.
+  ::absl::Duration RequestTime();
+
+  // Latency of each request, from sending it, or from its scheduled time,
+  // to receiving its response.
+  LatencyHistogram Latency();
+
+ private:
+  struct PendingWrite;
+
+  // Waits for room in the window and counts the request as in flight.
+  void WaitForRoom(::absl::Time ready);
+  void Start(const p4::v1::WriteRequest& write_request, ::absl::Time start);
+  void ReapLoop();
+
+  P4rtSession* session_;
+  const uint32_t max_inflight_;
+  grpc::CompletionQueue cq_;
+
+  absl::Mutex mu_;
+  uint32_t num_inflight_ ABSL_GUARDED_BY(mu_) = 0;
+  uint64_t num_requests_ ABSL_GUARDED_BY(mu_) = 0;
+  uint64_t num_failed_requests_ ABSL_GUARDED_BY(mu_) = 0;
+  ::absl::Status first_error_ ABSL_GUARDED_BY(mu_);
+  ::absl::Duration queue_time_ ABSL_GUARDED_BY(mu_);
+  ::absl::Duration request_time_ ABSL_GUARDED_BY(mu_);
+  LatencyHistogram latency_ ABSL_GUARDED_BY(mu_);
+
+  std::thread reaper_;
+};
+
+#endif  // P4RT_PERF_ASYNC_WRITER_H
@@ -0,0 +1,198 @@
+// Copyright 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "p4rt_perf_churn.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+
+extern TestParams test_params;
+
+bool ParseChurnMix(const std::string& text, uint32_t mix[NUM_CHURN_OPS]) {
+  std::vector<std::string> ratios = absl::StrSplit(text, ':');
+  if (ratios.size() != NUM_CHURN_OPS) return false;
+
+  uint32_t parsed[NUM_CHURN_OPS];
+  uint64_t total = 0;
+  for (int op = 0; op < NUM_CHURN_OPS; op++) {
+    if (!absl::SimpleAtoi(ratios[op], &parsed[op])) return false;
+    total += parsed[op];
+  }
+  if (total == 0) return false;
+  std::copy(parsed, parsed + NUM_CHURN_OPS, mix);
+  return true;
+}
+
+namespace {
+
+// Picks an element of a pool at random and removes it.
+uint64_t TakeRandom(std::vector<uint64_t>* pool, std::mt19937_64* rng) {
+  std::uniform_int_distribution<size_t> pick(0, pool->size() - 1);
+  const size_t slot = pick(*rng);
+  const uint64_t key = (*pool)[slot];
+  (*pool)[slot] = pool->back();
+  pool->pop_back();
+  return key;
+}
+
+uint64_t PickRandom(const std::vector<uint64_t>& pool, std::mt19937_64* rng) {
+  std::uniform_int_distribution<size_t> pick(0, pool.size() - 1);
+  return pool[pick(*rng)];
+}
+
+// Turns the updates of a request into modifies. If change is set, the
+// action data is changed as well, by flipping the lowest bit of the first
+// parameter of each action, which keeps the value within its bit width.
+void MakeModify(bool change, p4::v1::WriteRequest* write_request) {
+  for (auto& update : *write_request->mutable_updates()) {
+    update.set_type(p4::v1::Update::MODIFY);
+    if (!change) continue;
+    auto* action =
+        update.mutable_entity()->mutable_table_entry()->mutable_action();
+    if (!action->has_action() || action->action().params().empty()) {
+      continue;
+    }
+    std::string* value =
+        action->mutable_action()->mutable_params(0)->mutable_value();
+    if (!value->empty()) value->back() ^= 1;
+  }
+}
+
+// Programs or deletes entries in batches, without measuring them.
+int WriteEntries(P4rtSession* session, const ::p4::config::v1::P4Info& p4info,
+                 const BatchBuilder& build_batch, uint32_t oper,
+                 const std::vector<uint64_t>& keys) {
+  const uint64_t batch_size =
+      (test_params.batch_size == 0) ? keys.size() : test_params.batch_size;
+  p4::v1::WriteRequest write_request;
+  for (size_t first = 0; first < keys.size(); first += batch_size) {
+    const size_t last = std::min<size_t>(keys.size(), first + batch_size);
+    ResetWriteRequest(session, &write_request);
+    for (size_t index = first; index < last; index++) {
+      int status = build_batch(session, p4info, oper, keys[index], 1,
+                               &write_request);
+      if (status != SUCCESS) return status;
+    }
+    auto sts = SendWriteRequest(session, write_request);
+    if (!sts.ok()) {
+      std::cerr << "Failed to " << (oper == ADD ? "program" : "delete")
+                << " entries: " << sts.message() << std::endl;
+      return INTERNAL_ERR;
+    }
+  }
+  return SUCCESS;
+}
+
+}  // namespace
+
+int RunChurnTest(P4rtSession* session, const ::p4::config::v1::P4Info& p4info,
+                 ThreadInfo& t_data, const BatchBuilder& build_batch) {
+  // The thread draws its keys from twice as many as it keeps programmed,
+  // so that inserts can pick keys that are not in the table.
+  const uint64_t target = t_data.num_entries;
+  if (target == 0) return SUCCESS;
+  const uint64_t first_key = 2 * t_data.start + 1;
+  std::vector<uint64_t> installed;
+  std::vector<uint64_t> free_keys;
+  installed.reserve(2 * target);
+  free_keys.reserve(2 * target);
+  for (uint64_t key = first_key; key < first_key + 2 * target; key++) {
+    (installed.size() < target ? installed : free_keys).push_back(key);
+  }
+  // Whether the action data of each entry was changed by its last modify,
+  // so that the next one changes it back.
+  std::vector<bool> modified(2 * target);
+
+  int status = WriteEntries(session, p4info, build_batch, ADD, installed);
+  if (status != SUCCESS) return status;
+
+  std::mt19937_64 rng(t_data.tid);
+  std::discrete_distribution<int> pick_op(
+      test_params.churn_mix, test_params.churn_mix + NUM_CHURN_OPS);
+  p4::v1::WriteRequest write_request;
+  p4::v1::ReadRequest read_request;
+
+  const absl::Time start = absl::Now();
+  const absl::Time end = start + absl::Seconds(test_params.duration);
+  while (absl::Now() < end) {
+    // The table grows or shrinks if the mix has more inserts than deletes
+    // or the reverse. Only once it is full or empty is an insert turned
+    // into a delete, or any other request into an insert.
+    int op = pick_op(rng);
+    if (op == CHURN_INSERT && free_keys.empty()) op = CHURN_DELETE;
+    if (installed.empty()) op = CHURN_INSERT;
+
+    uint64_t key;
+    switch (op) {
+      case CHURN_INSERT:
+        key = TakeRandom(&free_keys, &rng);
+        break;
+      case CHURN_DELETE:
+        key = TakeRandom(&installed, &rng);
+        break;
+      default:
+        key = PickRandom(installed, &rng);
+        break;
+    }
+
+    // Modifies and reads are built as inserts and deletes of the entry:
+    // the former carry its action, the latter only its key.
+    ResetWriteRequest(session, &write_request);
+    status = build_batch(session, p4info,
+                         (op == CHURN_INSERT || op == CHURN_MODIFY) ? ADD : DEL,
+                         key, 1, &write_request);
+    if (status != SUCCESS) return status;
+    if (op == CHURN_MODIFY) {
+      modified[key - first_key] = !modified[key - first_key];
+      MakeModify(modified[key - first_key], &write_request);
+    }
+
+    ::absl::Status sts;
+    absl::Time timestamp;
+    if (op == CHURN_READ) {
+      read_request.Clear();
+      read_request.set_device_id(session->DeviceId());
+      for (const auto& update : write_request.updates()) {
+        *read_request.add_entities() = update.entity();
+      }
+      timestamp = absl::Now();
+      sts = SendReadRequest(session, read_request).status();
+    } else {
+      timestamp = absl::Now();
+      sts = SendWriteRequest(session, write_request);
+    }
+    const absl::Duration latency = absl::Now() - timestamp;
+
+    OpStats& stats = t_data.churn[op];
+    stats.num_requests++;
+    stats.latency.Record(latency);
+    if (!sts.ok() && stats.num_failed_requests++ == 0) {
+      std::cerr << "Thread " << t_data.tid << ": churn request failed: "
+                << sts.message() << std::endl;
+    }
+
+    // A failed request leaves the entry as it was. An inserted entry has
+    // the action data it is built with.
+    if (op == CHURN_INSERT) (sts.ok() ? installed : free_keys).push_back(key);
+    if (op == CHURN_DELETE) (sts.ok() ? free_keys : installed).push_back(key);
+    if (op == CHURN_INSERT) modified[key - first_key] = false;
+    if (op == CHURN_MODIFY && !sts.ok()) {
+      modified[key - first_key] = !modified[key - first_key];
+    }
+  }
+  t_data.time_taken = absl::ToDoubleSeconds(absl::Now() - start);
+
+  status = WriteEntries(session, p4info, build_batch, DEL, installed);
+  if (status != SUCCESS) return status;
+
+  for (const OpStats& stats : t_data.churn) {
+    if (stats.num_failed_requests != 0) return INTERNAL_ERR;
+  }
+  return SUCCESS;
+}
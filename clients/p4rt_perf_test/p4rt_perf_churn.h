@@ -0,0 +1,32 @@
+// Copyright 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef P4RT_PERF_CHURN_H
+#define P4RT_PERF_CHURN_H
+
+#include <string>
+
+#include "p4/config/v1/p4info.pb.h"
+#include "p4rt_perf_session.h"
+#include "p4rt_perf_test.h"
+#include "p4rt_perf_write.h"
+
+// Parses the ratios of a churn workload, given as
+// "insert:modify:delete:read", such as "4:1:4:1".
+bool ParseChurnMix(const std::string& text,
+                   uint32_t mix[NUM_CHURN_OPS]);
+
+// Runs a churn workload against a table that holds t_data.num_entries
+// entries of the profile.
+//
+// The thread first programs its entries, then sends single-entry insert,
+// modify, delete and read requests in the ratios of test_params.churn_mix
+// for test_params.duration seconds. Each modify changes the action data
+// of the entry. With more inserts than deletes, or the reverse, the number
+// of entries drifts between 0 and twice its target, where the mix can
+// no longer be followed. The entries left are deleted at the end. Only the
+// churn requests are measured, in t_data.churn.
+int RunChurnTest(P4rtSession* session, const ::p4::config::v1::P4Info& p4info,
+                 ThreadInfo& t_data, const BatchBuilder& build_batch);
+
+#endif  // P4RT_PERF_CHURN_H
@@ -0,0 +1,88 @@
+// Copyright 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "p4rt_perf_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "absl/strings/str_format.h"
+
+namespace {
+
+// Values below 2^kSubBucketBits get a bucket each. Above that, each
+// power-of-two range is split into 2^(kSubBucketBits - 1) buckets.
+constexpr int kSubBucketBits = 7;
+constexpr int kSubBucketCount = 1 << kSubBucketBits;
+constexpr int kSubBucketHalfCount = kSubBucketCount / 2;
+constexpr int kNumBuckets = (64 - kSubBucketBits + 2) * kSubBucketHalfCount;
+
+int MostSignificantBit(uint64_t value) { return 63 - __builtin_clzll(value); }
+
+}  // namespace
+
+LatencyHistogram::LatencyHistogram() : counts_(kNumBuckets, 0) {}
+
+int LatencyHistogram::BucketIndex(uint64_t value) {
+  if (value < kSubBucketCount) return static_cast<int>(value);
+  const int shift = MostSignificantBit(value) - kSubBucketBits + 1;
+  return shift * kSubBucketHalfCount + static_cast<int>(value >> shift);
+}
+
+uint64_t LatencyHistogram::BucketHighestValue(int index) {
+  if (index < kSubBucketCount) return index;
+  const int shift = index / kSubBucketHalfCount - 1;
+  const uint64_t top = index - shift * kSubBucketHalfCount;
+  return ((top + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(absl::Duration latency) {
+  const uint64_t value =
+      std::max<int64_t>(0, absl::ToInt64Nanoseconds(latency));
+  counts_[BucketIndex(value)]++;
+  count_++;
+  max_ = std::max(max_, value);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+  for (int index = 0; index < kNumBuckets; index++) {
+    counts_[index] += other.counts_[index];
+  }
+  count_ += other.count_;
+  max_ = std::max(max_, other.max_);
+}
+
+absl::Duration LatencyHistogram::Percentile(double percentile) const {
+  if (count_ == 0) return absl::ZeroDuration();
+  const uint64_t target = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(percentile / 100 * count_)));
+
+  uint64_t cumulative = 0;
+  for (int index = 0; index < kNumBuckets; index++) {
+    cumulative += counts_[index];
+    if (cumulative >= target) {
+      return absl::Nanoseconds(std::min(BucketHighestValue(index), max_));
+    }
+  }
+  return Max();
+}
+
+std::vector<LatencyHistogram::Bucket> LatencyHistogram::Buckets() const {
+  std::vector<Bucket> buckets;
+  for (int index = 0; index < kNumBuckets; index++) {
+    if (counts_[index] == 0) continue;
+    buckets.push_back(
+        {absl::Nanoseconds(BucketHighestValue(index)), counts_[index]});
+  }
+  return buckets;
+}
+
+std::string LatencyHistogram::Summary() const {
+  return absl::StrFormat(
+      "p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f us",
+      absl::ToDoubleMicroseconds(Percentile(50)),
+      absl::ToDoubleMicroseconds(Percentile(90)),
+      absl::ToDoubleMicroseconds(Percentile(99)),
+      absl::ToDoubleMicroseconds(Percentile(99.9)),
+      absl::ToDoubleMicroseconds(Max()));
+}
@@ -0,0 +1,56 @@
+// Copyright 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef P4RT_PERF_HISTOGRAM_H
+#define P4RT_PERF_HISTOGRAM_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "absl/time/time.h"
+
+// Latency histogram in the manner of HdrHistogram. Values are recorded in
+// nanoseconds and grouped in power-of-two ranges, each split into 64
+// linear buckets, so any recorded value is reported within 1/64 of its
+// true value. Recording is O(1) and the memory used is fixed.
+class LatencyHistogram {
+ public:
+  // Recorded values that fall in the same bucket.
+  struct Bucket {
+    absl::Duration highest;  // highest value of the bucket
+    uint64_t count;
+  };
+
+  LatencyHistogram();
+
+  void Record(absl::Duration latency);
+
+  // Adds the values recorded in another histogram.
+  void Merge(const LatencyHistogram& other);
+
+  uint64_t Count() const { return count_; }
+
+  // Returns the smallest value that the given percentage of the recorded
+  // values are at or below.
+  absl::Duration Percentile(double percentile) const;
+
+  absl::Duration Max() const { return absl::Nanoseconds(max_); }
+
+  // Formats p50, p90, p99, p99.9 and max in microseconds.
+  std::string Summary() const;
+
+  // Returns the buckets that hold values, in increasing order.
+  std::vector<Bucket> Buckets() const;
+
+ private:
+  static int BucketIndex(uint64_t value);
+  static uint64_t BucketHighestValue(int index);
+
+  std::vector<uint64_t> counts_;
+  uint64_t count_ = 0;
+  uint64_t max_ = 0;
+};
+
+#endif  // P4RT_PERF_HISTOGRAM_H
@@ -0,0 +1,467 @@
+// Copyright 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "p4rt_perf_linux_networking.h"
+
+#include <arpa/inet.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "p4rt_perf_churn.h"
+#include "p4rt_perf_read.h"
+#include "p4rt_perf_util.h"
+#include "p4rt_perf_write.h"
+
+#if defined(DPDK_TARGET)
+#include "dpdk/p4_name_mapping.h"
+#elif defined(ES2K_TARGET)
+#include "es2k/p4_name_mapping.h"
+#endif
+
+extern TestParams test_params;
+
+#if defined(ES2K_TARGET) || defined(DPDK_TARGET)
+
+namespace {
+
+// Values shared by all the entries of a profile.
+constexpr uint8_t kBridgeId = 1;
+constexpr uint8_t kPort = 1;
+constexpr uint8_t kVni = 100;
+constexpr uint16_t kVxlanPort = 4789;
+
+// Encodes a value in the canonical form of P4Runtime: big-endian, without
+// leading zero bytes.
+std::string EncodeIndex(uint64_t value) {
+  std::string bytes;
+  do {
+    bytes.insert(bytes.begin(), static_cast<char>(value & 0xff));
+    value >>= 8;
+  } while (value != 0);
+  return bytes;
+}
+
+// MAC address of the station learned for an entry.
+std::string MacForIndex(uint64_t index) {
+  return EncodeByteValue(6, (index >> 40) & 0xff, (index >> 32) & 0xff,
+                         (index >> 24) & 0xff, (index >> 16) & 0xff,
+                         (index >> 8) & 0xff, index & 0xff);
+}
+
+// IPv4 address of the remote tunnel endpoint of an entry, in 10.0.0.0/8.
+std::string RemoteIpv4ForIndex(uint64_t index) {
+  return EncodeByteValue(4, 10, (index >> 16) & 0xff, (index >> 8) & 0xff,
+                         index & 0xff);
+}
+
+std::string LocalIpv4() { return EncodeByteValue(4, 10, 255, 255, 254); }
+
+// Words of the IPv6 address of the remote tunnel endpoint of an entry, in
+// 2001:db8::/64.
+std::vector<std::string> RemoteIpv6WordsForIndex(uint64_t index) {
+  return {EncodeByteValue(4, 0x20, 0x01, 0x0d, 0xb8),
+          EncodeByteValue(4, 0, 0, 0, 0),
+          EncodeByteValue(4, (index >> 56) & 0xff, (index >> 48) & 0xff,
+                          (index >> 40) & 0xff, (index >> 32) & 0xff),
+          EncodeByteValue(4, (index >> 24) & 0xff, (index >> 16) & 0xff,
+                          (index >> 8) & 0xff, index & 0xff)};
+}
+
+void AddExactMatch(p4::v1::TableEntry* table_entry,
+                   const ::p4::config::v1::P4Info& p4info,
+                   const std::string& table, const std::string& field,
+                   const std::string& value) {
+  auto match = table_entry->add_match();
+  match->set_field_id(GetMatchFieldId(p4info, table, field));
+  match->mutable_exact()->set_value(value);
+}
+
+p4::v1::Action* SetAction(p4::v1::TableEntry* table_entry,
+                          const ::p4::config::v1::P4Info& p4info,
+                          const std::string& action_name) {
+  auto action = table_entry->mutable_action()->mutable_action();
+  action->set_action_id(GetActionId(p4info, action_name));
+  return action;
+}
+
+void AddParam(p4::v1::Action* action, const ::p4::config::v1::P4Info& p4info,
+              const std::string& action_name, const std::string& param_name,
+              const std::string& value) {
+  auto param = action->add_params();
+  param->set_param_id(GetParamId(p4info, action_name, param_name));
+  param->set_value(value);
+}
+
+// Adds an update of the request and returns its table entry.
+p4::v1::TableEntry* AddTableEntry(P4rtSession* session, uint32_t oper,
+                                  p4::v1::WriteRequest* write_request) {
+  return (oper == ADD) ? SetupTableEntryToInsert(session, write_request)
+                       : SetupTableEntryToDelete(session, write_request);
+}
+
+// l2_fwd_tx_table entry of a station learned on a VSI.
+void PrepareL2FwdTxEntry(p4::v1::TableEntry* table_entry,
+                         const ::p4::config::v1::P4Info& p4info,
+                         uint64_t index, bool insert_entry) {
+  table_entry->set_table_id(GetTableId(p4info, L2_FWD_TX_TABLE));
+  AddExactMatch(table_entry, p4info, L2_FWD_TX_TABLE,
+                L2_FWD_TX_TABLE_KEY_DST_MAC, MacForIndex(index));
+#if defined(ES2K_TARGET)
+  AddExactMatch(table_entry, p4info, L2_FWD_TX_TABLE,
+                L2_FWD_TX_TABLE_KEY_BRIDGE_ID, EncodeByteValue(1, kBridgeId));
+  AddExactMatch(table_entry, p4info, L2_FWD_TX_TABLE,
+                L2_FWD_TX_TABLE_KEY_SMAC_LEARNED, EncodeByteValue(1, 1));
+#endif
+  if (insert_entry) {
+    auto action = SetAction(table_entry, p4info, L2_FWD_TX_TABLE_ACTION_L2_FWD);
+    AddParam(action, p4info, L2_FWD_TX_TABLE_ACTION_L2_FWD,
+             ACTION_L2_FWD_PARAM_PORT, EncodeByteValue(1, kPort));
+  }
+}
+
+// l2_fwd_rx_table entry of a station learned on a VSI.
+void PrepareL2FwdRxEntry(p4::v1::TableEntry* table_entry,
+                         const ::p4::config::v1::P4Info& p4info,
+                         uint64_t index, bool insert_entry) {
+#if defined(ES2K_TARGET)
+  table_entry->set_table_id(GetTableId(p4info, L2_FWD_RX_TABLE));
+  AddExactMatch(table_entry, p4info, L2_FWD_RX_TABLE,
+                L2_FWD_RX_TABLE_KEY_DST_MAC, MacForIndex(index));
+  AddExactMatch(table_entry, p4info, L2_FWD_RX_TABLE,
+                L2_FWD_RX_TABLE_KEY_BRIDGE_ID, EncodeByteValue(1, kBridgeId));
+  AddExactMatch(table_entry, p4info, L2_FWD_RX_TABLE,
+                L2_FWD_RX_TABLE_KEY_SMAC_LEARNED, EncodeByteValue(1, 1));
+#else
+  table_entry->set_table_id(GetTableId(p4info, L2_FWD_RX_WITH_TUNNEL_TABLE));
+  AddExactMatch(table_entry, p4info, L2_FWD_RX_WITH_TUNNEL_TABLE,
+                L2_FWD_RX_WITH_TUNNEL_TABLE_KEY_DST_MAC, MacForIndex(index));
+#endif
+  if (insert_entry) {
+    auto action = SetAction(table_entry, p4info, L2_FWD_RX_TABLE_ACTION_L2_FWD);
+    AddParam(action, p4info, L2_FWD_RX_TABLE_ACTION_L2_FWD,
+             ACTION_L2_FWD_PARAM_PORT, EncodeByteValue(1, kPort));
+  }
+}
+
+// l2_fwd_tx_table entry of a station learned on a VXLAN port.
+void PrepareL2FwdTxTunnelEntry(p4::v1::TableEntry* table_entry,
+                               const ::p4::config::v1::P4Info& p4info,
+                               uint64_t index, bool ipv6, bool insert_entry) {
+  table_entry->set_table_id(GetTableId(p4info, L2_FWD_TX_TABLE));
+  AddExactMatch(table_entry, p4info, L2_FWD_TX_TABLE,
+                L2_FWD_TX_TABLE_KEY_DST_MAC, MacForIndex(index));
+#if defined(ES2K_TARGET)
+  AddExactMatch(table_entry, p4info, L2_FWD_TX_TABLE,
+                L2_FWD_TX_TABLE_KEY_BRIDGE_ID, EncodeByteValue(1, kBridgeId));
+  AddExactMatch(table_entry, p4info, L2_FWD_TX_TABLE,
+                L2_FWD_TX_TABLE_KEY_SMAC_LEARNED, EncodeByteValue(1, 1));
+  if (insert_entry) {
+    const char* action_name =
+        ipv6 ? L2_FWD_TX_TABLE_ACTION_SET_TUNNEL_UNDERLAY_V6
+             : L2_FWD_TX_TABLE_ACTION_SET_TUNNEL_UNDERLAY_V4;
+    const char* param_name =
+        ipv6 ? ACTION_SET_TUNNEL_UNDERLAY_V6_PARAM_TUNNEL_ID
+             : ACTION_SET_TUNNEL_UNDERLAY_V4_PARAM_TUNNEL_ID;
+    auto action = SetAction(table_entry, p4info, action_name);
+    AddParam(action, p4info, action_name, param_name,
+             EncodeByteValue(1, kVni));
+  }
+#else
+  // DPDK only has IPv4 tunnels.
+  (void)ipv6;
+  if (insert_entry) {
+    auto action =
+        SetAction(table_entry, p4info, L2_FWD_TX_TABLE_ACTION_SET_TUNNEL);
+    AddParam(action, p4info, L2_FWD_TX_TABLE_ACTION_SET_TUNNEL,
+             ACTION_SET_TUNNEL_PARAM_TUNNEL_ID, EncodeByteValue(1, kVni));
+    AddParam(action, p4info, L2_FWD_TX_TABLE_ACTION_SET_TUNNEL,
+             ACTION_SET_TUNNEL_PARAM_DST_ADDR, RemoteIpv4ForIndex(index));
+  }
+#endif
+}
+
+#if defined(ES2K_TARGET)
+// l2_fwd_smac_table entry of a learned station, which ovs-p4rt writes with
+// its forwarding entries.
+void PrepareL2FwdSmacEntry(p4::v1::TableEntry* table_entry,
+                           const ::p4::config::v1::P4Info& p4info,
+                           uint64_t index, bool insert_entry) {
+  table_entry->set_table_id(GetTableId(p4info, L2_FWD_SMAC_TABLE));
+  table_entry->set_priority(1);
+  auto match = table_entry->add_match();
+  match->set_field_id(
+      GetMatchFieldId(p4info, L2_FWD_SMAC_TABLE, L2_FWD_SMAC_TABLE_KEY_SA));
+  match->mutable_ternary()->set_value(MacForIndex(index));
+  match->mutable_ternary()->set_mask(
+      EncodeByteValue(6, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff));
+  if (insert_entry) {
+    SetAction(table_entry, p4info, L2_FWD_SMAC_TABLE_ACTION_SMAC_LEARN);
+  }
+}
+
+// l2_to_tunnel_v4 entry of a station learned on a VXLAN port.
+void PrepareL2ToTunnelV4Entry(p4::v1::TableEntry* table_entry,
+                              const ::p4::config::v1::P4Info& p4info,
+                              uint64_t index, bool insert_entry) {
+  table_entry->set_table_id(GetTableId(p4info, L2_TO_TUNNEL_V4_TABLE));
+  AddExactMatch(table_entry, p4info, L2_TO_TUNNEL_V4_TABLE,
+                L2_TO_TUNNEL_V4_KEY_DA, MacForIndex(index));
+  if (insert_entry) {
+    auto action =
+        SetAction(table_entry, p4info, L2_TO_TUNNEL_V4_ACTION_SET_TUNNEL_V4);
+    AddParam(action, p4info, L2_TO_TUNNEL_V4_ACTION_SET_TUNNEL_V4,
+             ACTION_SET_TUNNEL_V4_PARAM_DST_ADDR, RemoteIpv4ForIndex(index));
+  }
+}
+
+// l2_to_tunnel_v6 entry of a station learned on a VXLAN port.
+void PrepareL2ToTunnelV6Entry(p4::v1::TableEntry* table_entry,
+                              const ::p4::config::v1::P4Info& p4info,
+                              uint64_t index, bool insert_entry) {
+  table_entry->set_table_id(GetTableId(p4info, L2_TO_TUNNEL_V6_TABLE));
+  AddExactMatch(table_entry, p4info, L2_TO_TUNNEL_V6_TABLE,
+                L2_TO_TUNNEL_V6_KEY_DA, MacForIndex(index));
+  if (insert_entry) {
+    static const char* const kParams[] = {
+        ACTION_SET_TUNNEL_V6_PARAM_IPV6_1, ACTION_SET_TUNNEL_V6_PARAM_IPV6_2,
+        ACTION_SET_TUNNEL_V6_PARAM_IPV6_3, ACTION_SET_TUNNEL_V6_PARAM_IPV6_4};
+    auto action =
+        SetAction(table_entry, p4info, L2_TO_TUNNEL_V6_ACTION_SET_TUNNEL_V6);
+    const std::vector<std::string> words = RemoteIpv6WordsForIndex(index);
+    for (int word = 0; word < 4; word++) {
+      AddParam(action, p4info, L2_TO_TUNNEL_V6_ACTION_SET_TUNNEL_V6,
+               kParams[word], words[word]);
+    }
+  }
+}
+
+// tx_acc_vsi entry of a VSI.
+void PrepareTxAccVsiEntry(p4::v1::TableEntry* table_entry,
+                          const ::p4::config::v1::P4Info& p4info,
+                          uint64_t index, bool insert_entry) {
+  table_entry->set_table_id(GetTableId(p4info, TX_ACC_VSI_TABLE));
+  AddExactMatch(table_entry, p4info, TX_ACC_VSI_TABLE,
+                TX_ACC_VSI_TABLE_KEY_VSI, EncodeIndex(index));
+  if (insert_entry) {
+    auto action = SetAction(table_entry, p4info,
+                            TX_ACC_VSI_TABLE_ACTION_L2_FWD_AND_BYPASS_BRIDGE);
+    AddParam(action, p4info, TX_ACC_VSI_TABLE_ACTION_L2_FWD_AND_BYPASS_BRIDGE,
+             ACTION_L2_FWD_AND_BYPASS_BRIDGE_PARAM_PORT,
+             EncodeByteValue(1, kPort));
+  }
+}
+#endif  // ES2K_TARGET
+
+// vxlan_encap_mod_table entry of a VXLAN tunnel. The key is the index of
+// the entry rather than the VNI, so that tunnels don't collide.
+void PrepareVxlanEncapEntry(p4::v1::TableEntry* table_entry,
+                            const ::p4::config::v1::P4Info& p4info,
+                            uint64_t index, bool insert_entry) {
+  table_entry->set_table_id(GetTableId(p4info, VXLAN_ENCAP_MOD_TABLE));
+  AddExactMatch(table_entry, p4info, VXLAN_ENCAP_MOD_TABLE,
+                VXLAN_ENCAP_MOD_TABLE_KEY_VENDORMETA_MOD_DATA_PTR,
+                EncodeIndex(index));
+  if (insert_entry) {
+    const uint16_t dst_port = htons(kVxlanPort);
+    auto action = SetAction(table_entry, p4info, ACTION_VXLAN_ENCAP);
+    AddParam(action, p4info, ACTION_VXLAN_ENCAP,
+             ACTION_VXLAN_ENCAP_PARAM_SRC_ADDR, LocalIpv4());
+    AddParam(action, p4info, ACTION_VXLAN_ENCAP,
+             ACTION_VXLAN_ENCAP_PARAM_DST_ADDR, RemoteIpv4ForIndex(index));
+#if defined(ES2K_TARGET)
+    // Encoded the way ovs-p4rt encodes it.
+    AddParam(action, p4info, ACTION_VXLAN_ENCAP,
+             ACTION_VXLAN_ENCAP_PARAM_SRC_PORT,
+             EncodeByteValue(2, ((dst_port * 2) >> 8) & 0xff,
+                             (dst_port * 2) & 0xff));
+#endif
+    AddParam(action, p4info, ACTION_VXLAN_ENCAP,
+             ACTION_VXLAN_ENCAP_PARAM_DST_PORT,
+             EncodeByteValue(2, (dst_port >> 8) & 0xff, dst_port & 0xff));
+    AddParam(action, p4info, ACTION_VXLAN_ENCAP, ACTION_VXLAN_ENCAP_PARAM_VNI,
+             EncodeByteValue(1, kVni));
+  }
+}
+
+// ipv4_tunnel_term_table entry of a VXLAN tunnel.
+void PrepareTunnelTermEntry(p4::v1::TableEntry* table_entry,
+                            const ::p4::config::v1::P4Info& p4info,
+                            uint64_t index, bool insert_entry) {
+  table_entry->set_table_id(GetTableId(p4info, IPV4_TUNNEL_TERM_TABLE));
+  AddExactMatch(table_entry, p4info, IPV4_TUNNEL_TERM_TABLE,
+                IPV4_TUNNEL_TERM_TABLE_KEY_IPV4_SRC, RemoteIpv4ForIndex(index));
+#if defined(ES2K_TARGET)
+  AddExactMatch(table_entry, p4info, IPV4_TUNNEL_TERM_TABLE,
+                IPV4_TUNNEL_TERM_TABLE_KEY_BRIDGE_ID,
+                EncodeByteValue(1, kBridgeId));
+  AddExactMatch(table_entry, p4info, IPV4_TUNNEL_TERM_TABLE,
+                IPV4_TUNNEL_TERM_TABLE_KEY_VNI, EncodeByteValue(1, kVni));
+  if (insert_entry) {
+    auto action = SetAction(table_entry, p4info, ACTION_DECAP_OUTER_HDR);
+    AddParam(action, p4info, ACTION_DECAP_OUTER_HDR,
+             ACTION_DECAP_OUTER_HDR_PARAM_TUNNEL_ID, EncodeByteValue(1, kVni));
+  }
+#else
+  AddExactMatch(table_entry, p4info, IPV4_TUNNEL_TERM_TABLE,
+                IPV4_TUNNEL_TERM_TABLE_KEY_TUNNEL_TYPE,
+                EncodeByteValue(1, TUNNEL_TYPE_VXLAN));
+  AddExactMatch(table_entry, p4info, IPV4_TUNNEL_TERM_TABLE,
+                IPV4_TUNNEL_TERM_TABLE_KEY_IPV4_DST, LocalIpv4());
+  if (insert_entry) {
+    auto action = SetAction(table_entry, p4info, ACTION_DECAP_OUTER_IPV4);
+    AddParam(action, p4info, ACTION_DECAP_OUTER_IPV4,
+             ACTION_DECAP_OUTER_IPV4_PARAM_TUNNEL_ID, EncodeByteValue(1, kVni));
+  }
+#endif
+}
+
+// Tables a profile programs, to check that the pipeline has them.
+std::vector<std::string> ProfileTables(uint32_t profile) {
+  switch (profile) {
+    case LN_L2_FWD:
+#if defined(ES2K_TARGET)
+      return {L2_FWD_TX_TABLE, L2_FWD_RX_TABLE, L2_FWD_SMAC_TABLE};
+#else
+      return {L2_FWD_TX_TABLE, L2_FWD_RX_WITH_TUNNEL_TABLE};
+#endif
+#if defined(ES2K_TARGET)
+    case LN_L2_TUNNEL_V4:
+      return {L2_FWD_TX_TABLE, L2_TO_TUNNEL_V4_TABLE, L2_FWD_SMAC_TABLE};
+    case LN_L2_TUNNEL_V6:
+      return {L2_FWD_TX_TABLE, L2_TO_TUNNEL_V6_TABLE, L2_FWD_SMAC_TABLE};
+    case LN_TX_ACC_VSI:
+      return {TX_ACC_VSI_TABLE};
+#else
+    case LN_L2_TUNNEL_V4:
+      return {L2_FWD_TX_TABLE};
+#endif
+    case LN_VXLAN_ENCAP:
+      return {VXLAN_ENCAP_MOD_TABLE};
+    case LN_TUNNEL_TERM:
+      return {IPV4_TUNNEL_TERM_TABLE};
+    default:
+      return {};
+  }
+}
+
+}  // namespace
+
+bool IsLinuxNetworkingProfile(uint32_t profile) {
+  return !ProfileTables(profile).empty();
+}
+
+int BuildLinuxNetworkingBatch(uint32_t profile, P4rtSession* session,
+                              const ::p4::config::v1::P4Info& p4info,
+                              uint32_t oper, uint64_t first,
+                              uint64_t num_entries,
+                              p4::v1::WriteRequest* write_request) {
+  if (oper != ADD && oper != DEL) {
+    std::cerr << "Invalid operation" << std::endl;
+    return INVALID_ARG;
+  }
+  const bool insert_entry = (oper == ADD);
+
+  for (uint64_t index = first; index < first + num_entries; index++) {
+    switch (profile) {
+      case LN_L2_FWD:
+        PrepareL2FwdTxEntry(AddTableEntry(session, oper, write_request),
+                            p4info, index, insert_entry);
+        PrepareL2FwdRxEntry(AddTableEntry(session, oper, write_request),
+                            p4info, index, insert_entry);
+#if defined(ES2K_TARGET)
+        PrepareL2FwdSmacEntry(AddTableEntry(session, oper, write_request),
+                              p4info, index, insert_entry);
+#endif
+        break;
+      case LN_L2_TUNNEL_V4:
+        PrepareL2FwdTxTunnelEntry(AddTableEntry(session, oper, write_request),
+                                  p4info, index, false, insert_entry);
+#if defined(ES2K_TARGET)
+        PrepareL2ToTunnelV4Entry(AddTableEntry(session, oper, write_request),
+                                 p4info, index, insert_entry);
+        PrepareL2FwdSmacEntry(AddTableEntry(session, oper, write_request),
+                              p4info, index, insert_entry);
+#endif
+        break;
+#if defined(ES2K_TARGET)
+      case LN_L2_TUNNEL_V6:
+        PrepareL2FwdTxTunnelEntry(AddTableEntry(session, oper, write_request),
+                                  p4info, index, true, insert_entry);
+        PrepareL2ToTunnelV6Entry(AddTableEntry(session, oper, write_request),
+                                 p4info, index, insert_entry);
+        PrepareL2FwdSmacEntry(AddTableEntry(session, oper, write_request),
+                              p4info, index, insert_entry);
+        break;
+      case LN_TX_ACC_VSI:
+        PrepareTxAccVsiEntry(AddTableEntry(session, oper, write_request),
+                             p4info, index, insert_entry);
+        break;
+#endif
+      case LN_VXLAN_ENCAP:
+        PrepareVxlanEncapEntry(AddTableEntry(session, oper, write_request),
+                               p4info, index, insert_entry);
+        break;
+      case LN_TUNNEL_TERM:
+        PrepareTunnelTermEntry(AddTableEntry(session, oper, write_request),
+                               p4info, index, insert_entry);
+        break;
+      default:
+        std::cerr << "Invalid profile" << std::endl;
+        return INVALID_ARG;
+    }
+  }
+  return SUCCESS;
+}
+
+int LinuxNetworkingTest(P4rtSession* session,
+                        const ::p4::config::v1::P4Info& p4info,
+                        ThreadInfo& t_data) {
+  const uint32_t profile = test_params.profile;
+  for (const auto& table : ProfileTables(profile)) {
+    if (GetTableId(p4info, table) == -1) {
+      std::cerr << "Table " << table << " is not in the pipeline"
+                << std::endl;
+      return INVALID_ARG;
+    }
+  }
+
+  auto build_batch = [profile](P4rtSession* session,
+                                const ::p4::config::v1::P4Info& p4info,
+                                uint32_t oper, uint64_t first,
+                                uint64_t num_entries,
+                                p4::v1::WriteRequest* write_request) {
+    return BuildLinuxNetworkingBatch(profile, session, p4info, oper, first,
+                                     num_entries, write_request);
+  };
+  if (t_data.oper == CHURN) {
+    return RunChurnTest(session, p4info, t_data, build_batch);
+  }
+  if (IsReadOperation(t_data.oper)) {
+    return RunReadTest(session, p4info, t_data, build_batch);
+  }
+  return RunWriteTest(session, p4info, t_data, build_batch);
+}
+
+#else
+
+bool IsLinuxNetworkingProfile(uint32_t profile) { return false; }
+
+int BuildLinuxNetworkingBatch(uint32_t profile, P4rtSession* session,
+                              const ::p4::config::v1::P4Info& p4info,
+                              uint32_t oper, uint64_t first,
+                              uint64_t num_entries,
+                              p4::v1::WriteRequest* write_request) {
+  return INVALID_ARG;
+}
+
+int LinuxNetworkingTest(P4rtSession* session,
+                        const ::p4::config::v1::P4Info& p4info,
+                        ThreadInfo& t_data) {
+  std::cerr << "linux_networking profiles are not supported by this target"
+            << std::endl;
+  return INVALID_ARG;
+}
+
+#endif  // ES2K_TARGET || DPDK_TARGET
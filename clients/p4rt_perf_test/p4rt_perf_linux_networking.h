@@ -0,0 +1,33 @@
+// Copyright 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef P4RT_PERF_LINUX_NETWORKING_H
+#define P4RT_PERF_LINUX_NETWORKING_H
+
+#include <stdint.h>
+
+#include "p4/v1/p4runtime.pb.h"
+#include "p4rt_perf_session.h"
+#include "p4rt_perf_test.h"
+
+// Test profiles for the linux_networking pipeline. Each entry of a
+// profile stands for one learn or tunnel event, and is programmed with the
+// same updates ovs-p4rt makes for it, on one or more tables.
+
+// Returns true if the profile is a linux_networking profile supported by
+// the target.
+bool IsLinuxNetworkingProfile(uint32_t profile);
+
+// Adds the updates for the entries [first, first + num_entries) of the
+// profile to the request.
+int BuildLinuxNetworkingBatch(uint32_t profile, P4rtSession* session,
+                              const ::p4::config::v1::P4Info& p4info,
+                              uint32_t oper, uint64_t first,
+                              uint64_t num_entries,
+                              p4::v1::WriteRequest* write_request);
+
+int LinuxNetworkingTest(P4rtSession* session,
+                        const ::p4::config::v1::P4Info& p4info,
+                        ThreadInfo& t_data);
+
+#endif  // P4RT_PERF_LINUX_NETWORKING_H
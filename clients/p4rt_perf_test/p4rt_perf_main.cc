@@ -5,8 +5,8 @@
  * p4rt_perf_test- Performance Evaluation Tool for P4Runtime Server
  *
  * TODO:
- * 1. Programming with multiple threads doesn't really work as stratum currently
- * supports write by only master.
+ * 1. Programming with multiple threads only works with a shared session (-s),
+ * as stratum currently supports write by only master.
  * 2. Logging
  *
  */
@@ -14,30 +14,56 @@
 #include <arpa/inet.h>
 #include <pthread.h>
 
+#include <algorithm>
 #include <chrono>
 #include <cinttypes>
+#include <cstdlib>
 #include <ctime>
+#include <fstream>
 #include <iostream>
 #include <thread>
+#include <vector>
 
 #include "absl/flags/flag.h"
 #include "absl/memory/memory.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "p4rt_perf_churn.h"
+#include "p4rt_perf_linux_networking.h"
+#include "p4rt_perf_placement.h"
+#include "p4rt_perf_read.h"
+#include "p4rt_perf_results.h"
 #include "p4rt_perf_session.h"
 #include "p4rt_perf_simple_l2_demo.h"
 #include "p4rt_perf_test.h"
 #include "p4rt_perf_tls_credentials.h"
 
-#define MAX_THREADS 8
-#define CORE_BASE 20
-
 std::map<int, std::string> profileToStr = {
     {SIMPLE_L2_DEMO, "simple_l2_demo"},
+#if defined(ES2K_TARGET) || defined(DPDK_TARGET)
+    {LN_L2_FWD, "ln_l2_fwd"},
+    {LN_L2_TUNNEL_V4, "ln_l2_tunnel_v4"},
+    {LN_VXLAN_ENCAP, "ln_vxlan_encap"},
+    {LN_TUNNEL_TERM, "ln_tunnel_term"},
+#endif
+#if defined(ES2K_TARGET)
+    {LN_L2_TUNNEL_V6, "ln_l2_tunnel_v6"},
+    {LN_TX_ACC_VSI, "ln_tx_acc_vsi"},
+#endif
+};
+
+// Where to write the results of the run, and the baseline to compare them
+// with.
+struct OutputParams {
+  std::string json_path;
+  std::string csv_path;
+  std::string baseline_path;
+  double threshold = 5;  // percent
 };
 
 // globals
 TestParams test_params = {};
-ThreadInfo thread_data[MAX_THREADS];
-uint32_t core_id[MAX_THREADS];
+std::vector<ThreadInfo> thread_data;
 
 ABSL_FLAG(std::string, grpc_addr, "localhost:9559",
           "P4Runtime server address.");
@@ -46,21 +72,20 @@ ABSL_FLAG(uint64_t, device_id, 1, "P4Runtime device ID.");
 using P4rtStream = ::grpc::ClientReaderWriter<p4::v1::StreamMessageRequest,
                                               p4::v1::StreamMessageResponse>;
 
-void PopulateThreadInfo() {
-  uint16_t index;
+void PopulateThreadInfo(const std::vector<int>& thread_cpus) {
+  uint32_t index;
   uint64_t entries_per_thread =
       test_params.tot_num_entries / test_params.num_threads;
   uint64_t rem_rules = test_params.tot_num_entries % test_params.num_threads;
 
+  thread_data.resize(test_params.num_threads);
   for (index = 0; index < test_params.num_threads; index++) {
     thread_data[index].tid = index;
     thread_data[index].start = index * entries_per_thread;
     thread_data[index].num_entries = entries_per_thread;
     thread_data[index].oper = test_params.oper;
 
-    /* Initialize Core Ids */
-    core_id[index] = CORE_BASE + index;
-    thread_data[index].core_id = core_id[index];
+    thread_data[index].core_id = thread_cpus[index];
   }
 
   // add remaining entries to the last thread;
@@ -70,39 +95,62 @@ void PopulateThreadInfo() {
   for (index = 0; index < test_params.num_threads; index++) {
     printf("Thread data - Core: %u start_index: %" PRIu64
            " num_entries: %" PRIu64 "\n",
-           core_id[index], thread_data[index].start,
+           thread_data[index].core_id, thread_data[index].start,
            thread_data[index].num_entries);
   }
 }
 
-void RunPerfTest(int tid) {
-  thread_data[tid].status = SUCCESS;
-  // Start a new client session.
+// Starts a new client session and gets the P4Info of the pipeline.
+int OpenSession(std::unique_ptr<P4rtSession>* session,
+                ::p4::config::v1::P4Info* p4info) {
   auto status_or_session = P4rtSession::Create(absl::GetFlag(FLAGS_grpc_addr),
                                                GenerateClientCredentials(),
                                                absl::GetFlag(FLAGS_device_id));
   if (!status_or_session.ok()) {
     std::cerr << "Failure to create session. Error: "
               << status_or_session.status().message() << std::endl;
-    thread_data[tid].status = INTERNAL_ERR;
-    return;
+    return INTERNAL_ERR;
   }
 
   // Unwrap the session from the StatusOr object.
-  std::unique_ptr<P4rtSession> session = std::move(status_or_session).value();
-  ::p4::config::v1::P4Info p4info;
-  ::absl::Status status = GetForwardingPipelineConfig(session.get(), &p4info);
+  *session = std::move(status_or_session).value();
+  ::absl::Status status = GetForwardingPipelineConfig(session->get(), p4info);
   if (!status.ok()) {
     std::cerr << "Failure to get forwarding pipeline. Error: "
               << status.message() << std::endl;
-    thread_data[tid].status = INTERNAL_ERR;
-    return;
+    return INTERNAL_ERR;
+  }
+  return SUCCESS;
+}
+
+// Runs the test on a thread. If no shared session is given, the thread
+// starts its own.
+void RunPerfTest(int tid, P4rtSession* shared_session,
+                 const ::p4::config::v1::P4Info* shared_p4info) {
+  thread_data[tid].status = SUCCESS;
+  std::unique_ptr<P4rtSession> own_session;
+  ::p4::config::v1::P4Info own_p4info;
+  P4rtSession* session = shared_session;
+  const ::p4::config::v1::P4Info* p4info = shared_p4info;
+  if (session == nullptr) {
+    thread_data[tid].status = OpenSession(&own_session, &own_p4info);
+    if (thread_data[tid].status != SUCCESS) return;
+    session = own_session.get();
+    p4info = &own_p4info;
   }
 
   ThreadInfo& t_data = thread_data[tid];
   switch (test_params.profile) {
     case SIMPLE_L2_DEMO:
-      thread_data[tid].status = SimpleL2DemoTest(session.get(), p4info, t_data);
+      thread_data[tid].status = SimpleL2DemoTest(session, *p4info, t_data);
+      break;
+    case LN_L2_FWD:
+    case LN_L2_TUNNEL_V4:
+    case LN_L2_TUNNEL_V6:
+    case LN_VXLAN_ENCAP:
+    case LN_TUNNEL_TERM:
+    case LN_TX_ACC_VSI:
+      thread_data[tid].status = LinuxNetworkingTest(session, *p4info, t_data);
       break;
     default:
       std::cerr << "Unsupported profile" << std::endl;
@@ -113,14 +161,52 @@ void RunPerfTest(int tid) {
 
 inline void PrintUsage(const char* name) {
   std::cerr << "Usage: " << name
-            << " -t <value> -o <value> -n <value> -p <value>" << std::endl;
-  std::cout << "t: num of threads (optional, default: 1, max: 8)" << std::endl;
-  std::cout << "o: operation (ADD=1, DEL=2) (mandatory)" << std::endl;
+            << " -t <value> -o <value> -n <value> -p <value> -b <value>"
+            << " -d <value> -s -T <value> -m <value> -r <value>"
+            << " -j <file> -c <file> -B <file> -x <value>"
+            << " -C <cpus> -N <value> -P <placement>"
+            << std::endl;
+  std::cout << "t: num of threads (optional, default: 1)" << std::endl;
+  std::cout << "o: operation (ADD=1, DEL=2, CHURN=3, READ_TABLE=4, "
+               "READ_ENTRY=5, READ_COUNTER=6) (mandatory)"
+            << std::endl;
   std::cout
       << "n: num of entries (optional, default: 1000000, max: max of uint64)"
       << std::endl;
   std::cout << "p: test profile (optional, default:SIMPLE_L2_DEMO(1))"
             << std::endl;
+  std::cout << "b: num of entries per write request (optional, default: "
+               "1000, 0: all entries of a thread in one request)"
+            << std::endl;
+  std::cout << "d: max num of write requests in flight per thread (optional, "
+               "default: 0, 0: blocking write requests)"
+            << std::endl;
+  std::cout << "s: share one primary session between all threads (optional)"
+            << std::endl;
+  std::cout << "T: duration of a churn or read run in seconds (optional, "
+               "default: 10)"
+            << std::endl;
+  std::cout << "m: ratios of insert:modify:delete:read requests of a churn "
+               "run (optional, default: 1:1:1:1)"
+            << std::endl;
+  std::cout << "r: write requests per second of all threads, sent open loop; "
+               "a comma-separated list sweeps the rates with ADD (optional)"
+            << std::endl;
+  std::cout << "j: write the results to a JSON file (optional)" << std::endl;
+  std::cout << "c: append the results to a CSV file (optional)" << std::endl;
+  std::cout << "B: compare the results with a baseline JSON results file "
+               "(optional)"
+            << std::endl;
+  std::cout << "x: regression threshold of the comparison in percent "
+               "(optional, default: 5)"
+            << std::endl;
+  std::cout << "C: list of CPUs to pin the threads to, such as 0-3,8 "
+               "(optional, default: the CPUs of the process)"
+            << std::endl;
+  std::cout << "N: NUMA node to run the threads on (optional)" << std::endl;
+  std::cout << "P: run the threads on the CPUs of infrap4d (colocate) or "
+               "off them (isolate) (optional)"
+            << std::endl;
   std::cout << "   Supported profiles:" << std::endl;
   for (const auto& pair : profileToStr) {
     std::cout << "   " << pair.first << " : " << pair.second << std::endl;
@@ -134,15 +220,30 @@ int ValidateInput(const char* name) {
     PrintUsage(name);
     return INVALID_ARG;
   }
-  if (test_params.oper != ADD && test_params.oper != DEL) {
+  if (test_params.oper != ADD && test_params.oper != DEL &&
+      test_params.oper != CHURN && !IsReadOperation(test_params.oper)) {
     std::cerr << "Invalid Operation" << std::endl;
     PrintUsage(name);
     return INVALID_ARG;
   }
 
   // num of threads
-  if (test_params.num_threads > MAX_THREADS) {
-    std::cerr << "Number of threads greater than max allowed: " << MAX_THREADS
+  if (test_params.num_threads == 0) {
+    std::cerr << "Invalid number of threads" << std::endl;
+    PrintUsage(name);
+    return INVALID_ARG;
+  }
+
+  // churn or read duration
+  if ((test_params.oper == CHURN || IsReadOperation(test_params.oper)) &&
+      test_params.duration <= 0) {
+    std::cerr << "Invalid run duration" << std::endl;
+    PrintUsage(name);
+    return INVALID_ARG;
+  }
+  if (test_params.oper != ADD && test_params.oper != DEL &&
+      test_params.rate > 0) {
+    std::cerr << "Only ADD and DEL runs support a write request rate"
               << std::endl;
     PrintUsage(name);
     return INVALID_ARG;
@@ -158,12 +259,378 @@ int ValidateInput(const char* name) {
   return SUCCESS;
 }
 
+// Prints the throughput and latency of each kind of churn request, for all
+// the threads together, and sets them in the results.
+void PrintChurnResults(::google::protobuf::Struct* results) {
+  static const char* const kOpNames[NUM_CHURN_OPS] = {"Insert", "Modify",
+                                                      "Delete", "Read"};
+  double max_time = 0;
+  for (size_t index = 0; index < test_params.num_threads; index++) {
+    max_time = std::max(max_time, thread_data[index].time_taken);
+  }
+  std::cout << "Time taken: " << max_time << " seconds" << std::endl;
+
+  OpStats totals[NUM_CHURN_OPS] = {};
+  OpStats all = {};
+  for (int op = 0; op < NUM_CHURN_OPS; op++) {
+    OpStats& total = totals[op];
+    for (size_t index = 0; index < test_params.num_threads; index++) {
+      const OpStats& stats = thread_data[index].churn[op];
+      total.num_requests += stats.num_requests;
+      total.num_failed_requests += stats.num_failed_requests;
+      total.latency.Merge(stats.latency);
+    }
+    all.num_requests += total.num_requests;
+    all.num_failed_requests += total.num_failed_requests;
+    all.latency.Merge(total.latency);
+    std::cout << kOpNames[op] << " requests: " << total.num_requests << " ("
+              << total.num_failed_requests << " failed), "
+              << total.num_requests / max_time << " per second" << std::endl;
+    if (total.num_requests > 0) {
+      std::cout << kOpNames[op] << " latency: " << total.latency.Summary()
+                << std::endl;
+    }
+  }
+
+  SetSummary(all.num_requests / max_time, "churn requests/s", all.num_requests,
+             all.num_failed_requests, all.latency, results);
+  SetChurnSummary(totals, results);
+}
+
+// Parses a comma-separated list of write request rates, such as
+// "1000,2000,4000", and sorts it in increasing order.
+bool ParseRates(const std::string& text, std::vector<double>* rates) {
+  rates->clear();
+  for (const auto& field : absl::StrSplit(text, ',')) {
+    double rate;
+    if (!absl::SimpleAtod(field, &rate) || rate <= 0) return false;
+    rates->push_back(rate);
+  }
+  std::sort(rates->begin(), rates->end());
+  return !rates->empty();
+}
+
+// Runs the test on all the threads with the current test_params.oper and
+// test_params.rate, and waits for them to finish.
+int RunThreads(P4rtSession* shared_session,
+               const ::p4::config::v1::P4Info* shared_p4info) {
+  int status = SUCCESS;
+
+  // Clear the results of a previous run.
+  for (size_t index = 0; index < test_params.num_threads; index++) {
+    ThreadInfo t_data = {};
+    t_data.tid = thread_data[index].tid;
+    t_data.core_id = thread_data[index].core_id;
+    t_data.start = thread_data[index].start;
+    t_data.num_entries = thread_data[index].num_entries;
+    t_data.oper = test_params.oper;
+    thread_data[index] = t_data;
+  }
+
+  cpu_set_t cpuset;
+  std::vector<std::thread> client_threads(test_params.num_threads);
+  for (size_t index = 0; index < test_params.num_threads; index++) {
+    client_threads[index] =
+        std::thread(RunPerfTest, index, shared_session, shared_p4info);
+
+    /* Assign Thread Affinity */
+    CPU_ZERO(&cpuset);
+    CPU_SET(thread_data[index].core_id, &cpuset);
+    if ((pthread_setaffinity_np(client_threads[index].native_handle(),
+                                sizeof(cpuset), &cpuset))) {
+      std::cout << "setting affinity failed. Moving on" << std::endl;
+    }
+  }
+
+  // Wait for all threads to finish
+  for (size_t index = 0; index < test_params.num_threads; index++) {
+    client_threads[index].join();
+  }
+
+  // check if any of the threads exited with an error
+  for (size_t index = 0; index < test_params.num_threads; index++) {
+    if (thread_data[index].status != SUCCESS) {
+      std::cerr << "Thread: " << index << " exited with error" << std::endl;
+      status = thread_data[index].status;
+    }
+  }
+  return status;
+}
+
+// Write request statistics of all the threads together.
+struct WriteResults {
+  double max_time = 0;
+  double request_time = 0;
+  double queue_time = 0;
+  uint64_t num_requests = 0;
+  uint64_t num_failed_requests = 0;
+  LatencyHistogram latency;
+};
+
+WriteResults CollectWriteResults() {
+  // in the case of multiple threads, use the maximum time taken by a thread
+  // to calcuate perf
+  WriteResults results;
+  for (size_t index = 0; index < test_params.num_threads; index++) {
+    results.max_time =
+        std::max(results.max_time, thread_data[index].time_taken);
+    results.request_time += thread_data[index].request_time;
+    results.queue_time += thread_data[index].queue_time;
+    results.num_requests += thread_data[index].num_requests;
+    results.num_failed_requests += thread_data[index].num_failed_requests;
+    results.latency.Merge(thread_data[index].latency);
+  }
+  return results;
+}
+
+void PrintWriteResults(const WriteResults& results,
+                       ::google::protobuf::Struct* output) {
+  std::cout << "Num of entries added: " << test_params.tot_num_entries
+            << std::endl;
+  std::cout << "Num of write requests: " << results.num_requests << " ("
+            << results.num_failed_requests << " failed)" << std::endl;
+  std::cout << "Time taken: " << results.max_time << " seconds" << std::endl;
+  if (test_params.rate > 0) {
+    std::cout << "Write requests per second: "
+              << results.num_requests / results.max_time << " (target "
+              << test_params.rate << ")" << std::endl;
+  }
+  if (results.num_requests > 0) {
+    std::cout << "Average write request latency: "
+              << results.request_time / results.num_requests * 1e6 << " us"
+              << std::endl;
+    if (test_params.max_inflight > 0 || test_params.rate > 0) {
+      std::cout << "Average queueing delay: "
+                << results.queue_time / results.num_requests * 1e6 << " us"
+                << std::endl;
+    }
+    for (size_t index = 0; index < test_params.num_threads; index++) {
+      std::cout << "Thread " << index << " write request latency: "
+                << thread_data[index].latency.Summary() << std::endl;
+    }
+    std::cout << "Write request latency: " << results.latency.Summary()
+              << std::endl;
+  }
+  std::cout << "Number of entries per second: "
+            << test_params.tot_num_entries / results.max_time << std::endl;
+
+  SetSummary(test_params.tot_num_entries / results.max_time, "entries/s",
+             results.num_requests, results.num_failed_requests,
+             results.latency, output);
+}
+
+// Programs the entries open loop at each of the rates in turn, from the
+// lowest, deleting them after each run, and prints the throughput and
+// latency reached at each rate. The server is saturated from the first
+// rate it cannot keep up with: the requests then queue up, and the run
+// takes longer than its schedule.
+int RunRateSweep(const std::vector<double>& rates,
+                 P4rtSession* shared_session,
+                 const ::p4::config::v1::P4Info* shared_p4info,
+                 ::google::protobuf::Struct* output) {
+  // Fraction of the target rate a run must reach to count as sustained.
+  constexpr double kSustainedRatio = 0.95;
+
+  struct SweepStep {
+    double rate;
+    WriteResults results;
+  };
+  std::vector<SweepStep> steps;
+  int status = SUCCESS;
+  for (double rate : rates) {
+    test_params.oper = ADD;
+    test_params.rate = rate;
+    status = RunThreads(shared_session, shared_p4info);
+    steps.push_back({rate, CollectWriteResults()});
+
+    // The entries are deleted as fast as possible, unmeasured.
+    test_params.oper = DEL;
+    test_params.rate = 0;
+    const int delete_status = RunThreads(shared_session, shared_p4info);
+    if (status == SUCCESS) status = delete_status;
+    if (status != SUCCESS) break;
+  }
+  test_params.oper = ADD;
+
+  printf("%12s %12s %10s %10s %10s %10s\n", "target/s", "achieved/s",
+         "p50 us", "p99 us", "p99.9 us", "max us");
+  double knee = 0;
+  const SweepStep* knee_step = steps.empty() ? nullptr : &steps[0];
+  bool saturated = false;
+  for (const SweepStep& step : steps) {
+    const WriteResults& results = step.results;
+    const double achieved = results.num_requests / results.max_time;
+    printf("%12.0f %12.0f %10.1f %10.1f %10.1f %10.1f\n", step.rate, achieved,
+           absl::ToDoubleMicroseconds(results.latency.Percentile(50)),
+           absl::ToDoubleMicroseconds(results.latency.Percentile(99)),
+           absl::ToDoubleMicroseconds(results.latency.Percentile(99.9)),
+           absl::ToDoubleMicroseconds(results.latency.Max()));
+    AddSweepStep(step.rate, achieved, results.latency, output);
+    if (achieved < kSustainedRatio * step.rate) saturated = true;
+    if (!saturated && step.rate > knee) {
+      knee = step.rate;
+      knee_step = &step;
+    }
+  }
+  if (!saturated) {
+    std::cout << "Not saturated up to " << knee << " write requests per second"
+              << std::endl;
+  } else if (knee == 0) {
+    std::cout << "No sustainable rate: saturated from " << steps[0].rate
+              << " write requests per second" << std::endl;
+  } else {
+    std::cout << "Saturation knee: " << knee << " write requests per second"
+              << std::endl;
+  }
+
+  // The summary of a sweep is its knee, with the latency at that rate. If
+  // no rate is sustained, the throughput is 0 with the latency at the
+  // lowest rate.
+  if (knee_step != nullptr) {
+    SetSummary(knee, "write requests/s", knee_step->results.num_requests,
+               knee_step->results.num_failed_requests,
+               knee_step->results.latency, output);
+  }
+  return status;
+}
+
+// Returns a size field of /proc/self/status, such as "VmRSS:", in kB, or 0
+// if it is not known.
+uint64_t ProcStatusKb(const std::string& field) {
+  std::ifstream proc_status("/proc/self/status");
+  std::string line;
+  while (std::getline(proc_status, line)) {
+    if (line.rfind(field, 0) == 0) {
+      return std::strtoull(line.c_str() + field.size(), nullptr, 10);
+    }
+  }
+  return 0;
+}
+
+// Resets the peak resident set size of the process to its current one
+// (Linux 4.0 and later), and returns the current one in kB.
+uint64_t ResetPeakMemory() {
+  {
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+  }
+  return ProcStatusKb("VmRSS:");
+}
+
+// Returns how much the peak resident set size of the process exceeds a
+// baseline returned by ResetPeakMemory(), in kB. Without a reset, the peak
+// covers the whole life of the process, including the entries programmed
+// before the reads.
+uint64_t PeakMemoryKb(uint64_t baseline_kb) {
+  const uint64_t peak_kb = ProcStatusKb("VmHWM:");
+  return peak_kb > baseline_kb ? peak_kb - baseline_kb : 0;
+}
+
+// Prints the throughput, latency and ReadResponse sizes of a read run, for
+// all the threads together, and sets them in the results.
+void PrintReadResults(uint64_t peak_memory_kb,
+                      ::google::protobuf::Struct* results) {
+  double max_time = 0;
+  uint64_t num_requests = 0;
+  uint64_t num_failed_requests = 0;
+  ReadStats total = {};
+  LatencyHistogram latency;
+  for (size_t index = 0; index < test_params.num_threads; index++) {
+    const ThreadInfo& t_data = thread_data[index];
+    const ReadStats& stats = t_data.read;
+    max_time = std::max(max_time, t_data.time_taken);
+    num_requests += t_data.num_requests;
+    num_failed_requests += t_data.num_failed_requests;
+    latency.Merge(t_data.latency);
+    total.num_entities += stats.num_entities;
+    total.num_responses += stats.num_responses;
+    total.response_bytes += stats.response_bytes;
+    total.max_response_entities =
+        std::max(total.max_response_entities, stats.max_response_entities);
+    total.max_response_bytes =
+        std::max(total.max_response_bytes, stats.max_response_bytes);
+    total.first_response.Merge(stats.first_response);
+  }
+
+  std::cout << "Time taken: " << max_time << " seconds" << std::endl;
+  std::cout << "Num of read requests: " << num_requests << " ("
+            << num_failed_requests << " failed), " << num_requests / max_time
+            << " per second" << std::endl;
+  std::cout << "Num of entities read: " << total.num_entities << ", "
+            << total.num_entities / max_time << " per second" << std::endl;
+  if (total.num_responses > 0) {
+    std::cout << "Num of read responses: " << total.num_responses
+              << ", average " << total.num_entities / total.num_responses
+              << " entities and " << total.response_bytes / total.num_responses
+              << " bytes, largest " << total.max_response_entities
+              << " entities and " << total.max_response_bytes << " bytes"
+              << std::endl;
+    std::cout << "Time to first response: " << total.first_response.Summary()
+              << std::endl;
+  }
+  if (num_requests > 0) {
+    std::cout << "Read request latency: " << latency.Summary() << std::endl;
+  }
+  std::cout << "Peak client memory: " << peak_memory_kb << " kB" << std::endl;
+
+  SetSummary(total.num_entities / max_time, "entities/s", num_requests,
+             num_failed_requests, latency, results);
+  SetReadSummary(total, peak_memory_kb, results);
+}
+
+// Programs the entries, reads them back with the read operation, and
+// deletes them. Only the reads are measured.
+int RunReadBenchmark(P4rtSession* shared_session,
+                     const ::p4::config::v1::P4Info* shared_p4info,
+                     ::google::protobuf::Struct* results) {
+  const uint32_t read_oper = test_params.oper;
+  test_params.oper = ADD;
+  int status = RunThreads(shared_session, shared_p4info);
+  if (status == SUCCESS) {
+    test_params.oper = read_oper;
+    const uint64_t baseline_kb = ResetPeakMemory();
+    status = RunThreads(shared_session, shared_p4info);
+    PrintReadResults(PeakMemoryKb(baseline_kb), results);
+    AddThreadResults(thread_data.data(), thread_data.size(), results);
+  }
+
+  test_params.oper = DEL;
+  const int delete_status = RunThreads(shared_session, shared_p4info);
+  test_params.oper = read_oper;
+  return (status == SUCCESS) ? delete_status : status;
+}
+
+// Writes the results of the run to the files given on the command line,
+// and compares them with the baseline, if any.
+int ReportResults(const OutputParams& output_params,
+                  const ::google::protobuf::Struct& results) {
+  int status = SUCCESS;
+  if (!output_params.json_path.empty()) {
+    status = WriteJsonResults(output_params.json_path, results);
+    if (status != SUCCESS) return status;
+  }
+  if (!output_params.csv_path.empty()) {
+    status = AppendCsvResults(output_params.csv_path, results);
+    if (status != SUCCESS) return status;
+  }
+  if (!output_params.baseline_path.empty()) {
+    status = CompareWithBaseline(results, output_params.baseline_path,
+                                 output_params.threshold);
+  }
+  return status;
+}
+
 int main(int argc, char* argv[]) {
   int option;
   int status = SUCCESS;
+  std::vector<double> rates;
+  OutputParams output_params;
+  PlacementParams placement_params;
+  std::vector<int> thread_cpus;
 
   // parse command line args
-  while ((option = getopt(argc, argv, "t:o:n:p:")) != -1) {
+  while ((option = getopt(argc, argv,
+                          "t:o:n:p:b:d:sT:m:r:j:c:B:x:C:N:P:")) != -1) {
     switch (option) {
       case 't':
         test_params.num_threads = std::atoi(optarg);
@@ -172,11 +639,72 @@ int main(int argc, char* argv[]) {
         test_params.oper = std::atoi(optarg);
         break;
       case 'n':
-        test_params.tot_num_entries = std::atoi(optarg);
+        if (!absl::SimpleAtoi(optarg, &test_params.tot_num_entries) ||
+            test_params.tot_num_entries == 0) {
+          std::cerr << "Invalid number of entries: " << optarg << std::endl;
+          PrintUsage(argv[0]);
+          return INVALID_ARG;
+        }
         break;
       case 'p':
         test_params.profile = std::atoi(optarg);
         break;
+      case 'b':
+        test_params.batch_size = std::strtoull(optarg, nullptr, 10);
+        break;
+      case 'd':
+        test_params.max_inflight = std::atoi(optarg);
+        break;
+      case 's':
+        test_params.shared_session = true;
+        break;
+      case 'T':
+        test_params.duration = std::atof(optarg);
+        break;
+      case 'm':
+        if (!ParseChurnMix(optarg, test_params.churn_mix)) {
+          std::cerr << "Invalid churn ratios: " << optarg << std::endl;
+          PrintUsage(argv[0]);
+          return INVALID_ARG;
+        }
+        break;
+      case 'r':
+        if (!ParseRates(optarg, &rates)) {
+          std::cerr << "Invalid rates: " << optarg << std::endl;
+          PrintUsage(argv[0]);
+          return INVALID_ARG;
+        }
+        test_params.rate = rates[0];
+        break;
+      case 'j':
+        output_params.json_path = optarg;
+        break;
+      case 'c':
+        output_params.csv_path = optarg;
+        break;
+      case 'B':
+        output_params.baseline_path = optarg;
+        break;
+      case 'x':
+        output_params.threshold = std::atof(optarg);
+        break;
+      case 'C':
+        if (!ParseCpuList(optarg, &placement_params.cpus)) {
+          std::cerr << "Invalid CPU list: " << optarg << std::endl;
+          PrintUsage(argv[0]);
+          return INVALID_ARG;
+        }
+        break;
+      case 'N':
+        placement_params.numa_node = std::atoi(optarg);
+        break;
+      case 'P':
+        if (!ParseServerPlacement(optarg, &placement_params.server)) {
+          std::cerr << "Invalid server placement: " << optarg << std::endl;
+          PrintUsage(argv[0]);
+          return INVALID_ARG;
+        }
+        break;
       default:
         PrintUsage(argv[0]);
         return INVALID_ARG;
@@ -187,6 +715,11 @@ int main(int argc, char* argv[]) {
   if ((status = ValidateInput(argv[0])) != SUCCESS) {
     return status;
   }
+  if (rates.size() > 1 && test_params.oper != ADD) {
+    std::cerr << "A sweep of rates needs the ADD operation" << std::endl;
+    PrintUsage(argv[0]);
+    return INVALID_ARG;
+  }
 
   // print test data
   std::cout << "Total num of entries: " << test_params.tot_num_entries
@@ -194,51 +727,64 @@ int main(int argc, char* argv[]) {
   std::cout << "Number of threads: " << test_params.num_threads << std::endl;
   std::cout << "Operation: " << test_params.oper << std::endl;
   std::cout << "Test Profile: " << test_params.profile << std::endl;
-
-  // populate per thread entries
-  PopulateThreadInfo();
-
-  cpu_set_t cpuset;
-  std::thread client_threads[MAX_THREADS];
-  for (int index = 0; index < test_params.num_threads; index++) {
-    client_threads[index] = std::thread(RunPerfTest, index);
-
-    /* Assign Thread Affinity */
-    CPU_ZERO(&cpuset);
-    CPU_SET(core_id[index], &cpuset);
-    if ((pthread_setaffinity_np(client_threads[index].native_handle(),
-                                sizeof(cpuset), &cpuset))) {
-      std::cout << "setting affinity failed. Moving on" << std::endl;
-    }
+  std::cout << "Batch size: " << test_params.batch_size << std::endl;
+  std::cout << "Max requests in flight: " << test_params.max_inflight
+            << std::endl;
+  std::cout << "Shared session: " << (test_params.shared_session ? "yes" : "no")
+            << std::endl;
+  if (!rates.empty()) {
+    std::cout << "Write requests per second:";
+    for (double rate : rates) std::cout << " " << rate;
+    std::cout << std::endl;
   }
-
-  // Wait for all threads to finish
-  for (int index = 0; index < test_params.num_threads; index++) {
-    client_threads[index].join();
+  if (IsReadOperation(test_params.oper)) {
+    std::cout << "Read duration: " << test_params.duration << " seconds"
+              << std::endl;
+  }
+  if (test_params.oper == CHURN) {
+    std::cout << "Churn duration: " << test_params.duration << " seconds"
+              << std::endl;
+    std::cout << "Churn ratios: " << test_params.churn_mix[CHURN_INSERT] << ":"
+              << test_params.churn_mix[CHURN_MODIFY] << ":"
+              << test_params.churn_mix[CHURN_DELETE] << ":"
+              << test_params.churn_mix[CHURN_READ] << std::endl;
   }
 
-  // check if any of the threads exited with an error
-  for (int index = 0; index < test_params.num_threads; index++) {
-    if (thread_data[index].status != SUCCESS) {
-      std::cerr << "Thread: " << index << " exited with error" << std::endl;
-      status = thread_data[index].status;
+  // pick the CPU of each thread, and populate per thread entries
+  status = PlaceThreads(placement_params, test_params.num_threads,
+                        &thread_cpus);
+  if (status != SUCCESS) return status;
+  PopulateThreadInfo(thread_cpus);
+
+  // With a shared session, a single client is primary and all the threads
+  // issue concurrent Write RPCs on its stub.
+  std::unique_ptr<P4rtSession> shared_session;
+  ::p4::config::v1::P4Info shared_p4info;
+  if (test_params.shared_session) {
+    if ((status = OpenSession(&shared_session, &shared_p4info)) != SUCCESS) {
+      return status;
     }
   }
 
-  // evaluate and print perf numbers
-  // in the case of multiple threads, use the maximum time taken by a thread to
-  // calcuate perf
-  double max_time = 0;
-  for (int index = 0; index < test_params.num_threads; index++) {
-    if (thread_data[index].time_taken > max_time) {
-      max_time = thread_data[index].time_taken;
+  ::google::protobuf::Struct results = MakeResults(
+      profileToStr[test_params.profile], absl::GetFlag(FLAGS_grpc_addr));
+  if (IsReadOperation(test_params.oper)) {
+    status = RunReadBenchmark(shared_session.get(), &shared_p4info, &results);
+  } else if (rates.size() > 1) {
+    status =
+        RunRateSweep(rates, shared_session.get(), &shared_p4info, &results);
+  } else {
+    status = RunThreads(shared_session.get(), &shared_p4info);
+    AddThreadResults(thread_data.data(), thread_data.size(), &results);
+
+    // evaluate and print perf numbers
+    if (test_params.oper == CHURN) {
+      PrintChurnResults(&results);
+    } else {
+      PrintWriteResults(CollectWriteResults(), &results);
     }
   }
-  std::cout << "Num of entries added: " << test_params.tot_num_entries
-            << std::endl;
-  std::cout << "Time taken: " << max_time << " seconds" << std::endl;
-  std::cout << "Number of entries per second: "
-            << test_params.tot_num_entries / max_time << std::endl;
 
-  return status;
+  const int report_status = ReportResults(output_params, results);
+  return (status != SUCCESS) ? status : report_status;
 }
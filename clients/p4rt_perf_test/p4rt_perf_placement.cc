@@ -0,0 +1,216 @@
+// Copyright 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "p4rt_perf_placement.h"
+
+#include <dirent.h>
+#include <sched.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <tuple>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
+#include "p4rt_perf_test.h"
+
+namespace {
+
+// Name of the P4Runtime server process.
+constexpr char kServerProcess[] = "infrap4d";
+
+std::string ReadFirstLine(const std::string& path) {
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+std::vector<int> ReadCpuListFile(const std::string& path) {
+  std::vector<int> cpus;
+  ParseCpuList(ReadFirstLine(path), &cpus);
+  return cpus;
+}
+
+// Returns the CPUs a process may run on (0: this process).
+std::vector<int> ProcessCpus(pid_t pid) {
+  std::vector<int> cpus;
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  if (sched_getaffinity(pid, sizeof(cpuset), &cpuset) != 0) return cpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &cpuset)) cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+// Returns the NUMA node of each online CPU. Without NUMA support, all the
+// CPUs are on node 0.
+std::map<int, int> CpuNodes() {
+  std::map<int, int> nodes;
+  for (int cpu : ReadCpuListFile("/sys/devices/system/cpu/online")) {
+    nodes[cpu] = 0;
+  }
+  for (int node : ReadCpuListFile("/sys/devices/system/node/online")) {
+    const std::string path =
+        "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+    for (int cpu : ReadCpuListFile(path)) nodes[cpu] = node;
+  }
+  return nodes;
+}
+
+// Returns the process id of the first process with the given name, or -1.
+pid_t FindProcess(const std::string& name) {
+  DIR* proc = opendir("/proc");
+  if (proc == nullptr) return -1;
+  pid_t found = -1;
+  while (struct dirent* entry = readdir(proc)) {
+    pid_t pid;
+    if (!absl::SimpleAtoi(entry->d_name, &pid)) continue;
+    if (ReadFirstLine("/proc/" + std::string(entry->d_name) + "/comm") ==
+        name) {
+      found = pid;
+      break;
+    }
+  }
+  closedir(proc);
+  return found;
+}
+
+// Returns the CPUs the threads of a process last ran on.
+std::vector<int> LastRunCpus(pid_t pid) {
+  // Field 39 of /proc/<pid>/task/<tid>/stat, counting from the state
+  // field, which is the third one and follows the parenthesized name.
+  constexpr int kProcessorField = 39 - 3;
+
+  std::set<int> cpus;
+  const std::string task_path = "/proc/" + std::to_string(pid) + "/task";
+  DIR* tasks = opendir(task_path.c_str());
+  if (tasks == nullptr) return {};
+  while (struct dirent* entry = readdir(tasks)) {
+    if (entry->d_name[0] == '.') continue;
+    const std::string stat =
+        ReadFirstLine(task_path + "/" + entry->d_name + "/stat");
+    const size_t name_end = stat.rfind(')');
+    if (name_end == std::string::npos) continue;
+    std::istringstream fields(stat.substr(name_end + 1));
+    std::string field;
+    for (int index = 0; index <= kProcessorField; index++) fields >> field;
+    int cpu;
+    if (fields && absl::SimpleAtoi(field, &cpu)) cpus.insert(cpu);
+  }
+  closedir(tasks);
+  return std::vector<int>(cpus.begin(), cpus.end());
+}
+
+// Returns the CPUs of the server, as described in PlaceThreads.
+int ServerCpus(const std::map<int, int>& cpu_nodes, std::set<int>* cpus) {
+  const pid_t pid = FindProcess(kServerProcess);
+  if (pid < 0) {
+    std::cerr << kServerProcess << " is not running" << std::endl;
+    return INVALID_ARG;
+  }
+  std::vector<int> allowed = ProcessCpus(pid);
+  if (allowed.size() >= cpu_nodes.size()) allowed = LastRunCpus(pid);
+  if (allowed.empty()) {
+    std::cerr << "Failed to get the CPUs of " << kServerProcess << std::endl;
+    return INTERNAL_ERR;
+  }
+  cpus->insert(allowed.begin(), allowed.end());
+  return SUCCESS;
+}
+
+}  // namespace
+
+bool ParseCpuList(const std::string& text, std::vector<int>* cpus) {
+  cpus->clear();
+  for (absl::string_view range :
+       absl::StrSplit(absl::StripAsciiWhitespace(text), ',')) {
+    std::vector<absl::string_view> bounds = absl::StrSplit(range, '-');
+    int first;
+    int last;
+    if (bounds.size() > 2 || !absl::SimpleAtoi(bounds[0], &first) ||
+        !absl::SimpleAtoi(bounds.back(), &last) || first < 0 ||
+        last < first || last >= CPU_SETSIZE) {
+      return false;
+    }
+    for (int cpu = first; cpu <= last; cpu++) cpus->push_back(cpu);
+  }
+  return !cpus->empty();
+}
+
+bool ParseServerPlacement(const std::string& text, uint32_t* server) {
+  if (text == "colocate") {
+    *server = SERVER_COLOCATE;
+  } else if (text == "isolate") {
+    *server = SERVER_ISOLATE;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+int PlaceThreads(const PlacementParams& params, uint32_t num_threads,
+                 std::vector<int>* thread_cpus) {
+  const std::map<int, int> cpu_nodes = CpuNodes();
+  auto node_of = [&cpu_nodes](int cpu) {
+    auto node = cpu_nodes.find(cpu);
+    return (node == cpu_nodes.end()) ? -1 : node->second;
+  };
+
+  std::vector<int> cpus = params.cpus.empty() ? ProcessCpus(0) : params.cpus;
+  if (params.numa_node >= 0) {
+    cpus.erase(std::remove_if(cpus.begin(), cpus.end(),
+                              [&](int cpu) {
+                                return node_of(cpu) != params.numa_node;
+                              }),
+               cpus.end());
+  }
+
+  std::set<int> server_cpus;
+  std::set<int> server_nodes;
+  if (params.server != SERVER_ANY) {
+    int status = ServerCpus(cpu_nodes, &server_cpus);
+    if (status != SUCCESS) return status;
+    for (int cpu : server_cpus) server_nodes.insert(node_of(cpu));
+    const bool keep_server_cpus = (params.server == SERVER_COLOCATE);
+    cpus.erase(std::remove_if(cpus.begin(), cpus.end(),
+                              [&](int cpu) {
+                                return (server_cpus.count(cpu) > 0) !=
+                                       keep_server_cpus;
+                              }),
+               cpus.end());
+  }
+
+  // CPUs given on the command line keep their order. Otherwise the threads
+  // fill one NUMA node before the next.
+  if (params.cpus.empty()) {
+    auto rank = [&](int cpu) {
+      const int node = node_of(cpu);
+      return std::make_tuple(server_nodes.count(node) == 0, node, cpu);
+    };
+    std::stable_sort(cpus.begin(), cpus.end(), [&](int a, int b) {
+      return rank(a) < rank(b);
+    });
+  }
+
+  if (cpus.empty()) {
+    std::cerr << "No CPU left to run the threads on" << std::endl;
+    return INVALID_ARG;
+  }
+  if (num_threads > cpus.size()) {
+    std::cerr << "Warning: " << num_threads << " threads share "
+              << cpus.size() << " CPUs" << std::endl;
+  }
+  thread_cpus->clear();
+  for (uint32_t index = 0; index < num_threads; index++) {
+    thread_cpus->push_back(cpus[index % cpus.size()]);
+  }
+  return SUCCESS;
+}
@@ -0,0 +1,45 @@
+// Copyright 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef P4RT_PERF_PLACEMENT_H
+#define P4RT_PERF_PLACEMENT_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// Placement of the client threads relative to the P4Runtime server.
+enum SERVER_PLACEMENT {
+  SERVER_ANY = 0,
+  SERVER_COLOCATE = 1,  // on the CPUs the server runs on
+  SERVER_ISOLATE = 2,   // off the CPUs the server runs on
+};
+
+struct PlacementParams {
+  // CPUs to run the threads on, in order. Empty: the CPUs the process may
+  // run on, grouped by NUMA node.
+  std::vector<int> cpus;
+  int numa_node = -1;  // -1: any node
+  uint32_t server = SERVER_ANY;
+};
+
+// Parses a CPU list such as "0-3,8,10-11", in the format of cpuset(7).
+bool ParseCpuList(const std::string& text, std::vector<int>* cpus);
+
+// Parses "colocate" or "isolate".
+bool ParseServerPlacement(const std::string& text, uint32_t* server);
+
+// Picks the CPU each thread is pinned to. The CPUs are restricted to the
+// NUMA node and server placement of the parameters, and handed out in
+// order. When the threads outnumber them, they are handed out again from
+// the first one.
+//
+// The CPUs of the server are the ones infrap4d may run on, or if it may
+// run on all of them, the ones its threads last ran on. Isolated threads
+// prefer the NUMA nodes of the server, so that they do not pay for remote
+// memory accesses either.
+int PlaceThreads(const PlacementParams& params, uint32_t num_threads,
+                 std::vector<int>* thread_cpus);
+
+#endif  // P4RT_PERF_PLACEMENT_H
@@ -0,0 +1,146 @@
+// Copyright 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "p4rt_perf_read.h"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <set>
+
+#include "absl/time/clock.h"
+#include "p4/v1/p4runtime.grpc.pb.h"
+
+extern TestParams test_params;
+
+bool IsReadOperation(uint32_t oper) {
+  return oper == READ_TABLE || oper == READ_ENTRY || oper == READ_COUNTER;
+}
+
+namespace {
+
+// Sends a read request and consumes its ReadResponses as they arrive,
+// without keeping them, so that the client holds no more than one chunk.
+::absl::Status StreamRead(P4rtSession* session,
+                          const p4::v1::ReadRequest& read_request,
+                          ThreadInfo& t_data) {
+  ReadStats& stats = t_data.read;
+  grpc::ClientContext context;
+  p4::v1::ReadResponse response;
+
+  const absl::Time start = absl::Now();
+  auto reader = session->Stub().Read(&context, read_request);
+  bool first = true;
+  while (reader->Read(&response)) {
+    if (first) {
+      stats.first_response.Record(absl::Now() - start);
+      first = false;
+    }
+    const uint64_t num_entities = response.entities_size();
+    const uint64_t num_bytes = response.ByteSizeLong();
+    stats.num_entities += num_entities;
+    stats.num_responses++;
+    stats.response_bytes += num_bytes;
+    stats.max_response_entities =
+        std::max(stats.max_response_entities, num_entities);
+    stats.max_response_bytes = std::max(stats.max_response_bytes, num_bytes);
+  }
+  grpc::Status status = reader->Finish();
+  const absl::Duration latency = absl::Now() - start;
+
+  t_data.num_requests++;
+  t_data.request_time += absl::ToDoubleSeconds(latency);
+  t_data.latency.Record(latency);
+  return GrpcStatusToAbslStatus(status);
+}
+
+// Returns the ids of the tables an entry of the profile is programmed in.
+int GetProfileTables(P4rtSession* session,
+                     const ::p4::config::v1::P4Info& p4info,
+                     ThreadInfo& t_data, const BatchBuilder& build_batch,
+                     std::set<uint32_t>* table_ids) {
+  p4::v1::WriteRequest write_request;
+  int status = build_batch(session, p4info, DEL, t_data.start + 1, 1,
+                           &write_request);
+  if (status != SUCCESS) return status;
+  for (const auto& update : write_request.updates()) {
+    table_ids->insert(update.entity().table_entry().table_id());
+  }
+  return SUCCESS;
+}
+
+// Sets up the wildcard reads of a READ_TABLE or READ_COUNTER run.
+int PrepareWildcardRead(const ::p4::config::v1::P4Info& p4info,
+                        uint32_t oper, const std::set<uint32_t>& table_ids,
+                        p4::v1::ReadRequest* read_request) {
+  for (uint32_t table_id : table_ids) {
+    if (oper == READ_TABLE) {
+      read_request->add_entities()->mutable_table_entry()->set_table_id(
+          table_id);
+      continue;
+    }
+    for (const auto& counter : p4info.direct_counters()) {
+      if (counter.direct_table_id() != table_id) continue;
+      read_request->add_entities()
+          ->mutable_direct_counter_entry()
+          ->mutable_table_entry()
+          ->set_table_id(table_id);
+    }
+  }
+  if (read_request->entities_size() == 0) {
+    std::cerr << "The tables of the profile have no direct counters"
+              << std::endl;
+    return INVALID_ARG;
+  }
+  return SUCCESS;
+}
+
+}  // namespace
+
+int RunReadTest(P4rtSession* session, const ::p4::config::v1::P4Info& p4info,
+                ThreadInfo& t_data, const BatchBuilder& build_batch) {
+  if (t_data.num_entries == 0) return SUCCESS;
+
+  p4::v1::ReadRequest read_request;
+  read_request.set_device_id(session->DeviceId());
+  if (t_data.oper != READ_ENTRY) {
+    std::set<uint32_t> table_ids;
+    int status =
+        GetProfileTables(session, p4info, t_data, build_batch, &table_ids);
+    if (status != SUCCESS) return status;
+    status = PrepareWildcardRead(p4info, t_data.oper, table_ids,
+                                 &read_request);
+    if (status != SUCCESS) return status;
+  }
+
+  std::mt19937_64 rng(t_data.tid);
+  std::uniform_int_distribution<uint64_t> pick_key(
+      t_data.start + 1, t_data.start + t_data.num_entries);
+  p4::v1::WriteRequest write_request;
+
+  const absl::Time start = absl::Now();
+  const absl::Time end = start + absl::Seconds(test_params.duration);
+  do {
+    // A single entry is read with the key its delete is built with.
+    if (t_data.oper == READ_ENTRY) {
+      ResetWriteRequest(session, &write_request);
+      int status = build_batch(session, p4info, DEL, pick_key(rng), 1,
+                               &write_request);
+      if (status != SUCCESS) return status;
+      read_request.clear_entities();
+      for (const auto& update : write_request.updates()) {
+        *read_request.add_entities() = update.entity();
+      }
+    }
+
+    auto sts = StreamRead(session, read_request, t_data);
+    if (!sts.ok() && t_data.num_failed_requests++ == 0) {
+      std::cerr << "Thread " << t_data.tid
+                << ": read request failed: " << sts.message() << std::endl;
+    }
+  } while (absl::Now() < end);
+  t_data.time_taken = absl::ToDoubleSeconds(absl::Now() - start);
+
+  return (t_data.num_failed_requests == 0) ? SUCCESS : INTERNAL_ERR;
+}
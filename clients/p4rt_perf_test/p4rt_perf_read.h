@@ -0,0 +1,27 @@
+// Copyright 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef P4RT_PERF_READ_H
+#define P4RT_PERF_READ_H
+
+#include <stdint.h>
+
+#include "p4/config/v1/p4info.pb.h"
+#include "p4rt_perf_session.h"
+#include "p4rt_perf_test.h"
+#include "p4rt_perf_write.h"
+
+// Returns true for the operations that read entries back.
+bool IsReadOperation(uint32_t oper);
+
+// Reads the entries of the profile for test_params.duration seconds, once
+// they have all been programmed. Depending on t_data.oper, each request is
+//   READ_TABLE:   a wildcard read of the tables of the profile,
+//   READ_ENTRY:   a read of one of the thread's entries, picked at random,
+//   READ_COUNTER: a wildcard read of the direct counters of these tables.
+// At least one request is sent. The ReadResponses are consumed as they
+// arrive, and their statistics are recorded in t_data.read.
+int RunReadTest(P4rtSession* session, const ::p4::config::v1::P4Info& p4info,
+                ThreadInfo& t_data, const BatchBuilder& build_batch);
+
+#endif  // P4RT_PERF_READ_H
@@ -0,0 +1,396 @@
+// Copyright 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "p4rt_perf_results.h"
+
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_replace.h"
+#include "absl/time/clock.h"
+#include "google/protobuf/util/json_util.h"
+#include "p4rt_perf_read.h"
+
+extern TestParams test_params;
+
+using ::google::protobuf::ListValue;
+using ::google::protobuf::Struct;
+using ::google::protobuf::Value;
+
+namespace {
+
+void SetNumber(Struct* object, const std::string& key, double number) {
+  (*object->mutable_fields())[key].set_number_value(number);
+}
+
+void SetString(Struct* object, const std::string& key,
+               const std::string& text) {
+  (*object->mutable_fields())[key].set_string_value(text);
+}
+
+void SetBool(Struct* object, const std::string& key, bool flag) {
+  (*object->mutable_fields())[key].set_bool_value(flag);
+}
+
+Struct* SetStruct(Struct* object, const std::string& key) {
+  return (*object->mutable_fields())[key].mutable_struct_value();
+}
+
+ListValue* SetList(Struct* object, const std::string& key) {
+  return (*object->mutable_fields())[key].mutable_list_value();
+}
+
+// Accessors that return an empty value for a missing field.
+const Struct& GetStruct(const Struct& object, const std::string& key) {
+  auto field = object.fields().find(key);
+  return (field == object.fields().end())
+             ? Struct::default_instance()
+             : field->second.struct_value();
+}
+
+const Value& GetValue(const Struct& object, const std::string& key) {
+  auto field = object.fields().find(key);
+  return (field == object.fields().end()) ? Value::default_instance()
+                                          : field->second;
+}
+
+double GetNumber(const Struct& object, const std::string& key) {
+  return GetValue(object, key).number_value();
+}
+
+std::string GetString(const Struct& object, const std::string& key) {
+  return GetValue(object, key).string_value();
+}
+
+// Returns the first value of a "key: value" line of a /proc file.
+std::string ReadProcField(const std::string& path, const std::string& key) {
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.rfind(key, 0) != 0) continue;
+    const size_t colon = line.find(':');
+    if (colon == std::string::npos) continue;
+    const size_t start = line.find_first_not_of(" \t", colon + 1);
+    return (start == std::string::npos) ? "" : line.substr(start);
+  }
+  return "";
+}
+
+Struct HostResults() {
+  Struct host;
+  char hostname[256] = {};
+  if (gethostname(hostname, sizeof(hostname) - 1) == 0) {
+    SetString(&host, "hostname", hostname);
+  }
+  struct utsname uts;
+  if (uname(&uts) == 0) {
+    SetString(&host, "kernel", absl::StrFormat("%s %s", uts.sysname,
+                                                uts.release));
+    SetString(&host, "machine", uts.machine);
+  }
+  SetString(&host, "cpu_model", ReadProcField("/proc/cpuinfo", "model name"));
+  SetNumber(&host, "num_cpus", sysconf(_SC_NPROCESSORS_ONLN));
+  SetString(&host, "mem_total", ReadProcField("/proc/meminfo", "MemTotal"));
+  SetString(&host, "time",
+            absl::FormatTime(absl::RFC3339_sec, absl::Now(),
+                             absl::UTCTimeZone()));
+  return host;
+}
+
+Struct ChurnResults(const OpStats stats[NUM_CHURN_OPS]) {
+  static const char* const kChurnOpNames[NUM_CHURN_OPS] = {
+      "insert", "modify", "delete", "read"};
+
+  Struct churn;
+  for (int op = 0; op < NUM_CHURN_OPS; op++) {
+    Struct* op_results = SetStruct(&churn, kChurnOpNames[op]);
+    SetNumber(op_results, "num_requests", stats[op].num_requests);
+    SetNumber(op_results, "num_failed_requests",
+              stats[op].num_failed_requests);
+    *SetStruct(op_results, "latency") = LatencyResults(stats[op].latency);
+  }
+  return churn;
+}
+
+Struct ReadResults(const ReadStats& stats) {
+  Struct read;
+  SetNumber(&read, "num_entities", stats.num_entities);
+  SetNumber(&read, "num_responses", stats.num_responses);
+  SetNumber(&read, "response_bytes", stats.response_bytes);
+  SetNumber(&read, "max_response_entities", stats.max_response_entities);
+  SetNumber(&read, "max_response_bytes", stats.max_response_bytes);
+  *SetStruct(&read, "first_response") = LatencyResults(stats.first_response);
+  return read;
+}
+
+// Percent change from a baseline value, for display.
+std::string FormatChange(double value, double baseline) {
+  if (baseline == 0) return "n/a";
+  return absl::StrFormat("%+.1f%%", (value - baseline) / baseline * 100);
+}
+
+// Formats a field of a CSV row, quoting it if needed.
+std::string CsvField(const Value& value) {
+  switch (value.kind_case()) {
+    case Value::kNumberValue:
+      return absl::StrFormat("%.15g", value.number_value());
+    case Value::kBoolValue:
+      return value.bool_value() ? "1" : "0";
+    case Value::kStringValue: {
+      const std::string& text = value.string_value();
+      if (text.find_first_of(",\"\n") == std::string::npos) return text;
+      return "\"" + absl::StrReplaceAll(text, {{"\"", "\"\""}}) + "\"";
+    }
+    default:
+      return "";
+  }
+}
+
+}  // namespace
+
+Struct MakeResults(const std::string& profile_name,
+                   const std::string& grpc_addr) {
+  Struct results;
+  Struct* params = SetStruct(&results, "params");
+  SetNumber(params, "oper", test_params.oper);
+  SetNumber(params, "profile", test_params.profile);
+  SetString(params, "profile_name", profile_name);
+  SetNumber(params, "num_threads", test_params.num_threads);
+  SetNumber(params, "tot_num_entries", test_params.tot_num_entries);
+  SetNumber(params, "batch_size", test_params.batch_size);
+  SetNumber(params, "max_inflight", test_params.max_inflight);
+  SetNumber(params, "rate", test_params.rate);
+  SetBool(params, "shared_session", test_params.shared_session);
+  SetNumber(params, "duration", test_params.duration);
+  ListValue* churn_mix = SetList(params, "churn_mix");
+  for (uint32_t ratio : test_params.churn_mix) {
+    churn_mix->add_values()->set_number_value(ratio);
+  }
+  SetString(params, "grpc_addr", grpc_addr);
+
+  *SetStruct(&results, "host") = HostResults();
+  return results;
+}
+
+Struct LatencyResults(const LatencyHistogram& latency) {
+  Struct object;
+  SetNumber(&object, "count", latency.Count());
+  SetNumber(&object, "p50_us",
+            absl::ToDoubleMicroseconds(latency.Percentile(50)));
+  SetNumber(&object, "p90_us",
+            absl::ToDoubleMicroseconds(latency.Percentile(90)));
+  SetNumber(&object, "p99_us",
+            absl::ToDoubleMicroseconds(latency.Percentile(99)));
+  SetNumber(&object, "p99_9_us",
+            absl::ToDoubleMicroseconds(latency.Percentile(99.9)));
+  SetNumber(&object, "max_us", absl::ToDoubleMicroseconds(latency.Max()));
+
+  // Each bucket holds the values up to its highest one, and above the
+  // highest one of the previous bucket.
+  ListValue* histogram = SetList(&object, "histogram");
+  for (const LatencyHistogram::Bucket& bucket : latency.Buckets()) {
+    Struct* entry = histogram->add_values()->mutable_struct_value();
+    SetNumber(entry, "highest_us",
+              absl::ToDoubleMicroseconds(bucket.highest));
+    SetNumber(entry, "count", bucket.count);
+  }
+  return object;
+}
+
+void AddThreadResults(const ThreadInfo* threads, uint32_t num_threads,
+                      Struct* results) {
+  ListValue* list = SetList(results, "threads");
+  for (uint32_t index = 0; index < num_threads; index++) {
+    const ThreadInfo& t_data = threads[index];
+    Struct* thread = list->add_values()->mutable_struct_value();
+    SetNumber(thread, "tid", t_data.tid);
+    SetNumber(thread, "core_id", t_data.core_id);
+    SetNumber(thread, "start", t_data.start);
+    SetNumber(thread, "num_entries", t_data.num_entries);
+    SetNumber(thread, "time_taken", t_data.time_taken);
+    SetNumber(thread, "num_requests", t_data.num_requests);
+    SetNumber(thread, "num_failed_requests", t_data.num_failed_requests);
+    SetNumber(thread, "request_time", t_data.request_time);
+    SetNumber(thread, "queue_time", t_data.queue_time);
+    *SetStruct(thread, "latency") = LatencyResults(t_data.latency);
+
+    if (t_data.oper == CHURN) {
+      *SetStruct(thread, "churn") = ChurnResults(t_data.churn);
+    }
+    if (IsReadOperation(t_data.oper)) {
+      *SetStruct(thread, "read") = ReadResults(t_data.read);
+    }
+  }
+}
+
+void SetChurnSummary(const OpStats stats[NUM_CHURN_OPS], Struct* results) {
+  *SetStruct(results, "churn") = ChurnResults(stats);
+}
+
+void SetReadSummary(const ReadStats& stats, uint64_t peak_memory_kb,
+                    Struct* results) {
+  Struct* read = SetStruct(results, "read");
+  *read = ReadResults(stats);
+  SetNumber(read, "peak_memory_kb", peak_memory_kb);
+}
+
+void AddSweepStep(double rate, double achieved,
+                  const LatencyHistogram& latency, Struct* results) {
+  Struct* step =
+      SetList(results, "sweep")->add_values()->mutable_struct_value();
+  SetNumber(step, "rate", rate);
+  SetNumber(step, "achieved", achieved);
+  *SetStruct(step, "latency") = LatencyResults(latency);
+}
+
+void SetSummary(double throughput, const std::string& unit,
+                uint64_t num_requests, uint64_t num_failed_requests,
+                const LatencyHistogram& latency, Struct* results) {
+  Struct* summary = SetStruct(results, "summary");
+  SetNumber(summary, "throughput", throughput);
+  SetString(summary, "unit", unit);
+  SetNumber(summary, "num_requests", num_requests);
+  SetNumber(summary, "num_failed_requests", num_failed_requests);
+  *SetStruct(summary, "latency") = LatencyResults(latency);
+}
+
+int WriteJsonResults(const std::string& path, const Struct& results) {
+  google::protobuf::util::JsonPrintOptions options;
+  options.add_whitespace = true;
+  std::string json;
+  auto status =
+      google::protobuf::util::MessageToJsonString(results, &json, options);
+  if (!status.ok()) {
+    std::cerr << "Failed to format the results: " << status.ToString()
+              << std::endl;
+    return INTERNAL_ERR;
+  }
+
+  std::ofstream file(path);
+  file << json;
+  if (!file) {
+    std::cerr << "Failed to write the results to " << path << std::endl;
+    return INTERNAL_ERR;
+  }
+  return SUCCESS;
+}
+
+int AppendCsvResults(const std::string& path, const Struct& results) {
+  static const char* const kParamColumns[] = {
+      "oper",       "profile",      "num_threads", "tot_num_entries",
+      "batch_size", "max_inflight", "rate",        "shared_session"};
+  static const char* const kSummaryColumns[] = {
+      "throughput", "unit", "num_requests", "num_failed_requests"};
+  static const char* const kLatencyColumns[] = {"p50_us", "p90_us", "p99_us",
+                                                "p99_9_us", "max_us"};
+
+  const Struct& host = GetStruct(results, "host");
+  const Struct& params = GetStruct(results, "params");
+  const Struct& summary = GetStruct(results, "summary");
+  const Struct& latency = GetStruct(summary, "latency");
+  std::vector<std::string> header = {"time", "hostname"};
+  std::vector<std::string> row = {CsvField(GetValue(host, "time")),
+                                  CsvField(GetValue(host, "hostname"))};
+  for (const char* column : kParamColumns) {
+    header.push_back(column);
+    row.push_back(CsvField(GetValue(params, column)));
+  }
+  for (const char* column : kSummaryColumns) {
+    header.push_back(column);
+    row.push_back(CsvField(GetValue(summary, column)));
+  }
+  for (const char* column : kLatencyColumns) {
+    header.push_back(column);
+    row.push_back(CsvField(GetValue(latency, column)));
+  }
+
+  const bool is_new = !std::ifstream(path).good();
+  std::ofstream file(path, std::ios::app);
+  if (is_new) file << absl::StrJoin(header, ",") << "\n";
+  file << absl::StrJoin(row, ",") << "\n";
+  if (!file) {
+    std::cerr << "Failed to write the results to " << path << std::endl;
+    return INTERNAL_ERR;
+  }
+  return SUCCESS;
+}
+
+int CompareWithBaseline(const Struct& results, const std::string& path,
+                        double threshold) {
+  // Parameters that must match for the results to be comparable, and
+  // parameters that are only expected to.
+  static const char* const kRequiredParams[] = {"oper", "profile"};
+  static const char* const kExpectedParams[] = {
+      "num_threads", "tot_num_entries", "batch_size", "max_inflight", "rate"};
+
+  std::ifstream file(path);
+  if (!file) {
+    std::cerr << "Failed to open the baseline " << path << std::endl;
+    return INVALID_ARG;
+  }
+  std::stringstream json;
+  json << file.rdbuf();
+  Struct baseline;
+  auto parse_status =
+      google::protobuf::util::JsonStringToMessage(json.str(), &baseline);
+  if (!parse_status.ok()) {
+    std::cerr << "Failed to parse the baseline " << path << ": "
+              << parse_status.ToString() << std::endl;
+    return INVALID_ARG;
+  }
+
+  const Struct& params = GetStruct(results, "params");
+  const Struct& baseline_params = GetStruct(baseline, "params");
+  for (const char* param : kRequiredParams) {
+    if (GetNumber(params, param) != GetNumber(baseline_params, param)) {
+      std::cerr << "The baseline was run with another " << param << std::endl;
+      return INVALID_ARG;
+    }
+  }
+  for (const char* param : kExpectedParams) {
+    if (GetNumber(params, param) != GetNumber(baseline_params, param)) {
+      std::cerr << "Warning: the baseline was run with another " << param
+                << std::endl;
+    }
+  }
+
+  const Struct& summary = GetStruct(results, "summary");
+  const Struct& baseline_summary = GetStruct(baseline, "summary");
+  const std::string unit = GetString(summary, "unit");
+  if (unit != GetString(baseline_summary, "unit")) {
+    std::cerr << "The baseline has no comparable summary" << std::endl;
+    return INVALID_ARG;
+  }
+  const double throughput = GetNumber(summary, "throughput");
+  const double baseline_throughput = GetNumber(baseline_summary, "throughput");
+  const double p99 = GetNumber(GetStruct(summary, "latency"), "p99_us");
+  const double baseline_p99 =
+      GetNumber(GetStruct(baseline_summary, "latency"), "p99_us");
+
+  std::cout << "Baseline throughput: " << baseline_throughput << " " << unit
+            << ", now " << throughput << " ("
+            << FormatChange(throughput, baseline_throughput) << ")"
+            << std::endl;
+  std::cout << "Baseline p99 latency: " << baseline_p99 << " us, now " << p99
+            << " us (" << FormatChange(p99, baseline_p99) << ")" << std::endl;
+
+  int status = SUCCESS;
+  if (throughput < baseline_throughput * (1 - threshold / 100)) {
+    std::cerr << "Regression: throughput dropped by more than " << threshold
+              << "%" << std::endl;
+    status = REGRESSION;
+  }
+  if (p99 > baseline_p99 * (1 + threshold / 100)) {
+    std::cerr << "Regression: p99 latency grew by more than " << threshold
+              << "%" << std::endl;
+    status = REGRESSION;
+  }
+  return status;
+}
@@ -0,0 +1,72 @@
+// Copyright 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef P4RT_PERF_RESULTS_H
+#define P4RT_PERF_RESULTS_H
+
+#include <stdint.h>
+
+#include <string>
+
+#include "google/protobuf/struct.pb.h"
+#include "p4rt_perf_histogram.h"
+#include "p4rt_perf_test.h"
+
+// Machine-readable results of a run. They are held in a protobuf Struct,
+// which maps to a JSON object:
+//   "params":  the test parameters,
+//   "host":    the client host and the time of the run,
+//   "threads": the statistics of each thread,
+//   "summary": the throughput and latency of all the threads together,
+// along with the statistics specific to the operation.
+
+// Starts the results of a run with the test parameters and host details.
+::google::protobuf::Struct MakeResults(const std::string& profile_name,
+                                       const std::string& grpc_addr);
+
+// Returns the percentiles, maximum and buckets of a latency histogram.
+::google::protobuf::Struct LatencyResults(const LatencyHistogram& latency);
+
+// Adds the statistics of each thread.
+void AddThreadResults(const ThreadInfo* threads, uint32_t num_threads,
+                      ::google::protobuf::Struct* results);
+
+// Sets the headline results of a run, which are compared with a baseline:
+// its throughput, in units per second, and the latency of its requests.
+void SetSummary(double throughput, const std::string& unit,
+                uint64_t num_requests, uint64_t num_failed_requests,
+                const LatencyHistogram& latency,
+                ::google::protobuf::Struct* results);
+
+// Sets the statistics of each kind of request of a churn run, for all the
+// threads together.
+void SetChurnSummary(const OpStats stats[NUM_CHURN_OPS],
+                     ::google::protobuf::Struct* results);
+
+// Sets the ReadResponse statistics of a read run, for all the threads
+// together, and the peak client memory.
+void SetReadSummary(const ReadStats& stats, uint64_t peak_memory_kb,
+                    ::google::protobuf::Struct* results);
+
+// Adds the results at one rate of a rate sweep.
+void AddSweepStep(double rate, double achieved,
+                  const LatencyHistogram& latency,
+                  ::google::protobuf::Struct* results);
+
+// Writes the results to a file as JSON.
+int WriteJsonResults(const std::string& path,
+                     const ::google::protobuf::Struct& results);
+
+// Appends the parameters and summary of the results to a CSV file, one
+// row per run. The header is written when the file is new.
+int AppendCsvResults(const std::string& path,
+                     const ::google::protobuf::Struct& results);
+
+// Compares the summary of the results with the one of a baseline, read
+// from a JSON results file. Returns REGRESSION if the throughput is lower,
+// or the p99 latency higher, than the baseline by more than threshold
+// percent.
+int CompareWithBaseline(const ::google::protobuf::Struct& results,
+                        const std::string& path, double threshold);
+
+#endif  // P4RT_PERF_RESULTS_H
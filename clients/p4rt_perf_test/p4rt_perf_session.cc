@@ -152,6 +152,12 @@ absl::Status SendWriteRequest(P4rtSession* session,
   return GrpcStatusToAbslStatus(status);
 }
 
+void ResetWriteRequest(P4rtSession* session, ::p4::v1::WriteRequest* req) {
+  req->Clear();
+  req->set_device_id(session->DeviceId());
+  *req->mutable_election_id() = session->ElectionId();
+}
+
 ::p4::v1::TableEntry* SetupTableEntryToInsert(P4rtSession* session,
                                               ::p4::v1::WriteRequest* req) {
   auto* update = req->add_updates();
@@ -84,6 +84,8 @@ std::unique_ptr<p4::v1::P4Runtime::Stub> CreateP4RuntimeStub(
     const std::string& address,
     const std::shared_ptr<grpc::ChannelCredentials>& credentials);
 
+::absl::Status GrpcStatusToAbslStatus(const grpc::Status& status);
+
 // Functions that operate on a P4rtSession.
 
 ::absl::StatusOr<p4::v1::ReadResponse> SendReadRequest(
@@ -95,6 +97,10 @@ std::unique_ptr<p4::v1::P4Runtime::Stub> CreateP4RuntimeStub(
 ::absl::Status GetForwardingPipelineConfig(P4rtSession* session,
                                            p4::config::v1::P4Info* p4info);
 
+// Clears a write request and addresses it to the device of the session,
+// with the election id that makes it the primary controller's.
+void ResetWriteRequest(P4rtSession* session, ::p4::v1::WriteRequest* req);
+
 ::p4::v1::TableEntry* SetupTableEntryToInsert(P4rtSession* session,
                                               ::p4::v1::WriteRequest* req);
 
@@ -3,10 +3,11 @@
 
 #include "p4rt_perf_simple_l2_demo.h"
 
+#include "p4rt_perf_churn.h"
+#include "p4rt_perf_read.h"
 #include "p4rt_perf_test.h"
 #include "p4rt_perf_util.h"
-
-extern TestParams test_params;
+#include "p4rt_perf_write.h"
 
 void PrepareSimpleL2DemoTableEntry(p4::v1::TableEntry* table_entry,
                                    const SimpleL2DemoMacInfo& mac_info,
@@ -40,61 +41,61 @@ void PrepareSimpleL2DemoTableEntry(p4::v1::TableEntry* table_entry,
   return;
 }
 
-int SimpleL2DemoTest(P4rtSession* session,
-                     const ::p4::config::v1::P4Info& p4info,
-                     ThreadInfo& t_data) {
+// Fills in the MAC addresses of the entry with the specified index.
+void MakeSimpleL2DemoMacInfo(uint64_t index, SimpleL2DemoMacInfo* mac_info) {
+  auto src_int = index;
+  mac_info->src_mac[0] = (src_int >> 40) & 0xFF;
+  mac_info->src_mac[1] = (src_int >> 32) & 0xFF;
+  mac_info->src_mac[2] = (src_int >> 24) & 0xFF;
+  mac_info->src_mac[3] = (src_int >> 16) & 0xFF;
+  mac_info->src_mac[4] = (src_int >> 8) & 0xFF;
+  mac_info->src_mac[5] = src_int & 0xFF;
+
+  src_int = index + 1;
+  mac_info->dst_mac[0] = (src_int >> 40) & 0xFF;
+  mac_info->dst_mac[1] = (src_int >> 32) & 0xFF;
+  mac_info->dst_mac[2] = (src_int >> 24) & 0xFF;
+  mac_info->dst_mac[3] = (src_int >> 16) & 0xFF;
+  mac_info->dst_mac[4] = (src_int >> 8) & 0xFF;
+  mac_info->dst_mac[5] = src_int & 0xFF;
+}
+
+// Adds the updates for the entries [first, first + num_entries) to the
+// request.
+int BuildSimpleL2DemoBatch(P4rtSession* session,
+                           const ::p4::config::v1::P4Info& p4info,
+                           uint32_t oper, uint64_t first, uint64_t num_entries,
+                           p4::v1::WriteRequest* write_request) {
   ::p4::v1::TableEntry* table_entry;
   SimpleL2DemoMacInfo mac_info;
-  p4::v1::WriteRequest write_request;
-
-  int batch_size = t_data.num_entries;
-  uint64_t count = t_data.start + 1;
 
-  write_request.set_device_id(session->DeviceId());
-  *write_request.mutable_election_id() = session->ElectionId();
-  for (uint64_t j = 0; j < t_data.num_entries; j++) {
-    switch (t_data.oper) {
+  for (uint64_t index = first; index < first + num_entries; index++) {
+    switch (oper) {
       case ADD:
-        table_entry = SetupTableEntryToInsert(session, &write_request);
+        table_entry = SetupTableEntryToInsert(session, write_request);
         break;
       case DEL:
-        table_entry = SetupTableEntryToDelete(session, &write_request);
+        table_entry = SetupTableEntryToDelete(session, write_request);
         break;
       default:
         std::cerr << "Invalid operation" << std::endl;
         return INVALID_ARG;
     }
 
-    auto src_int = count;
-    mac_info.src_mac[0] = (src_int >> 40) & 0xFF;
-    mac_info.src_mac[1] = (src_int >> 32) & 0xFF;
-    mac_info.src_mac[2] = (src_int >> 24) & 0xFF;
-    mac_info.src_mac[3] = (src_int >> 16) & 0xFF;
-    mac_info.src_mac[4] = (src_int >> 8) & 0xFF;
-    mac_info.src_mac[5] = src_int;  // & 0xFF;
-
-    src_int = count + 1;
-    mac_info.dst_mac[0] = (src_int >> 40) & 0xFF;
-    mac_info.dst_mac[1] = (src_int >> 32) & 0xFF;
-    mac_info.dst_mac[2] = (src_int >> 24) & 0xFF;
-    mac_info.dst_mac[3] = (src_int >> 16) & 0xFF;
-    mac_info.dst_mac[4] = (src_int >> 8) & 0xFF;
-    mac_info.dst_mac[5] = src_int & 0xFF;
-
-    PrepareSimpleL2DemoTableEntry(table_entry, mac_info, p4info,
-                                  t_data.oper == ADD);
-    count++;
+    MakeSimpleL2DemoMacInfo(index, &mac_info);
+    PrepareSimpleL2DemoTableEntry(table_entry, mac_info, p4info, oper == ADD);
   }
-
-  absl::Time timestamp = absl::Now();
-
-  auto sts = SendWriteRequest(session, write_request);
-
-  absl::Time end_timestamp = absl::Now();
-  absl::Duration duration = end_timestamp - timestamp;
-  double seconds = absl::ToDoubleSeconds(duration);
-  t_data.time_taken = seconds;
-
-  std::cout << "count: " << count - 1 << std::endl;
   return SUCCESS;
 }
+
+int SimpleL2DemoTest(P4rtSession* session,
+                     const ::p4::config::v1::P4Info& p4info,
+                     ThreadInfo& t_data) {
+  if (t_data.oper == CHURN) {
+    return RunChurnTest(session, p4info, t_data, BuildSimpleL2DemoBatch);
+  }
+  if (IsReadOperation(t_data.oper)) {
+    return RunReadTest(session, p4info, t_data, BuildSimpleL2DemoBatch);
+  }
+  return RunWriteTest(session, p4info, t_data, BuildSimpleL2DemoBatch);
+}
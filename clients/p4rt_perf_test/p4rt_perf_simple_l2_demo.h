@@ -13,6 +13,13 @@ void PrepareSimpleL2DemoTableEntry(p4::v1::TableEntry* table_entry,
                                    const ::p4::config::v1::P4Info& p4info,
                                    bool insert_entry);
 
+void MakeSimpleL2DemoMacInfo(uint64_t index, SimpleL2DemoMacInfo* mac_info);
+
+int BuildSimpleL2DemoBatch(P4rtSession* session,
+                           const ::p4::config::v1::P4Info& p4info,
+                           uint32_t oper, uint64_t first, uint64_t num_entries,
+                           p4::v1::WriteRequest* write_request);
+
 int SimpleL2DemoTest(P4rtSession* session,
                      const ::p4::config::v1::P4Info& p4info,
                      ThreadInfo& t_data);
@@ -6,11 +6,60 @@
 
 #include <stdint.h>
 
-enum OPER { ADD = 1, DEL = 2 };
+#include "p4rt_perf_histogram.h"
 
-enum TEST_PROFILE { SIMPLE_L2_DEMO = 1 };
+enum OPER {
+  ADD = 1,
+  DEL = 2,
+  CHURN = 3,
+  READ_TABLE = 4,
+  READ_ENTRY = 5,
+  READ_COUNTER = 6
+};
+
+// Requests of a churn workload.
+enum CHURN_OP {
+  CHURN_INSERT = 0,
+  CHURN_MODIFY = 1,
+  CHURN_DELETE = 2,
+  CHURN_READ = 3,
+  NUM_CHURN_OPS = 4
+};
+
+enum TEST_PROFILE {
+  SIMPLE_L2_DEMO = 1,
+  // linux_networking profiles
+  LN_L2_FWD = 2,
+  LN_L2_TUNNEL_V4 = 3,
+  LN_L2_TUNNEL_V6 = 4,  // ES2K only
+  LN_VXLAN_ENCAP = 5,
+  LN_TUNNEL_TERM = 6,
+  LN_TX_ACC_VSI = 7,  // ES2K only
+};
 
-enum STATUS { SUCCESS = 0, INVALID_ARG = 1, INTERNAL_ERR = 2 };
+enum STATUS {
+  SUCCESS = 0,
+  INVALID_ARG = 1,
+  INTERNAL_ERR = 2,
+  REGRESSION = 3  // worse than the baseline
+};
+
+// Statistics of one kind of request.
+struct OpStats {
+  uint64_t num_requests;
+  uint64_t num_failed_requests;
+  LatencyHistogram latency;
+};
+
+// Statistics of the ReadResponses of a read run.
+struct ReadStats {
+  uint64_t num_entities;
+  uint64_t num_responses;
+  uint64_t response_bytes;
+  uint64_t max_response_entities;
+  uint64_t max_response_bytes;
+  LatencyHistogram first_response;  // from sending each request
+};
 
 struct ThreadInfo {
   uint32_t tid;
@@ -19,6 +68,14 @@ struct ThreadInfo {
   uint64_t num_entries;
   uint32_t oper;
   double time_taken;
+  double request_time;  // sum of the write request latencies
+  double queue_time;    // sum of the time requests waited for the window,
+                        // or were late on their schedule
+  LatencyHistogram latency;  // of each write request
+  uint64_t num_requests;
+  uint64_t num_failed_requests;
+  OpStats churn[NUM_CHURN_OPS];  // with the CHURN operation
+  ReadStats read;                // with the READ_* operations
   int status;
 };
 
@@ -27,6 +84,15 @@ struct TestParams {
   uint32_t oper = 0;
   uint64_t tot_num_entries = 1000000;
   uint32_t profile = SIMPLE_L2_DEMO;
+  uint64_t batch_size = 1000;  // 0: all entries of a thread in one request
+  uint32_t max_inflight = 0;   // 0: blocking write requests
+  // Write requests per second of all threads together, sent open loop.
+  // 0: each request is sent when the previous one completes.
+  double rate = 0;
+  bool shared_session = false;  // all threads write through one session
+  double duration = 10;         // seconds, for CHURN and READ_*
+  // Ratios of the requests of a churn workload, indexed by CHURN_OP.
+  uint32_t churn_mix[NUM_CHURN_OPS] = {1, 1, 1, 1};
 };
 
 struct SimpleL2DemoMacInfo {
@@ -0,0 +1,163 @@
+// Copyright 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "p4rt_perf_write.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "absl/time/clock.h"
+#include "p4rt_perf_async_writer.h"
+
+extern TestParams test_params;
+
+// Window of an open-loop run when test_params.max_inflight is not set. It
+// only bounds the memory held by requests in flight: a request that waits
+// for room is counted late.
+constexpr uint32_t kOpenLoopMaxInflight = 1024;
+
+// Copies the request statistics of a writer to the thread, once flushed.
+static int SaveWriterStats(AsyncWriter& writer, ThreadInfo& t_data) {
+  t_data.request_time = absl::ToDoubleSeconds(writer.RequestTime());
+  t_data.queue_time = absl::ToDoubleSeconds(writer.QueueTime());
+  t_data.latency = writer.Latency();
+  t_data.num_requests = writer.NumRequests();
+  t_data.num_failed_requests = writer.NumFailedRequests();
+  if (t_data.num_failed_requests != 0) {
+    std::cerr << "Thread " << t_data.tid << ": write request failed: "
+              << writer.FirstError().message() << std::endl;
+    return INTERNAL_ERR;
+  }
+  return SUCCESS;
+}
+
+// Waits until the given time. Sleeps can overshoot by tens of
+// microseconds, so the last stretch is spent spinning.
+static void WaitUntil(absl::Time deadline) {
+  constexpr absl::Duration kSpinTime = absl::Microseconds(100);
+  const absl::Duration wait = deadline - absl::Now();
+  if (wait > kSpinTime) absl::SleepFor(wait - kSpinTime);
+  while (absl::Now() < deadline) {
+  }
+}
+
+// Keeps up to test_params.max_inflight write requests outstanding. The
+// next batch is built while the previous ones are in flight, so the time
+// taken is the wall time of the whole run.
+static int RunPipelinedWriteTest(P4rtSession* session,
+                                 const ::p4::config::v1::P4Info& p4info,
+                                 ThreadInfo& t_data, uint64_t batch_size,
+                                 const BatchBuilder& build_batch) {
+  p4::v1::WriteRequest write_request;
+  uint64_t count = t_data.start + 1;
+  uint64_t remaining = t_data.num_entries;
+  AsyncWriter writer(session, test_params.max_inflight);
+
+  absl::Time start = absl::Now();
+  while (remaining > 0) {
+    const uint64_t num_entries = std::min(batch_size, remaining);
+    ResetWriteRequest(session, &write_request);
+    int status = build_batch(session, p4info, t_data.oper, count,
+                             num_entries, &write_request);
+    if (status != SUCCESS) return status;
+
+    writer.Write(write_request);
+    count += num_entries;
+    remaining -= num_entries;
+  }
+  writer.Flush();
+  t_data.time_taken = absl::ToDoubleSeconds(absl::Now() - start);
+
+  std::cout << "count: " << count - 1 << std::endl;
+  return SaveWriterStats(writer, t_data);
+}
+
+// Sends write requests on a fixed schedule, at the thread's share of
+// test_params.rate, whether or not the server keeps up. Latencies are
+// measured from the time each request was due, so the delay a slow
+// response causes to the requests behind it is not hidden (coordinated
+// omission). Each batch is built before waiting for its slot.
+static int RunOpenLoopWriteTest(P4rtSession* session,
+                                const ::p4::config::v1::P4Info& p4info,
+                                ThreadInfo& t_data, uint64_t batch_size,
+                                const BatchBuilder& build_batch) {
+  const absl::Duration interval =
+      absl::Seconds(test_params.num_threads / test_params.rate);
+  p4::v1::WriteRequest write_request;
+  uint64_t count = t_data.start + 1;
+  uint64_t remaining = t_data.num_entries;
+  AsyncWriter writer(session, test_params.max_inflight > 0
+                                  ? test_params.max_inflight
+                                  : kOpenLoopMaxInflight);
+
+  const absl::Time start = absl::Now();
+  for (int64_t index = 0; remaining > 0; index++) {
+    const uint64_t num_entries = std::min(batch_size, remaining);
+    ResetWriteRequest(session, &write_request);
+    int status = build_batch(session, p4info, t_data.oper, count,
+                             num_entries, &write_request);
+    if (status != SUCCESS) return status;
+
+    const absl::Time scheduled = start + index * interval;
+    WaitUntil(scheduled);
+    writer.WriteScheduled(write_request, scheduled);
+    count += num_entries;
+    remaining -= num_entries;
+  }
+  writer.Flush();
+  t_data.time_taken = absl::ToDoubleSeconds(absl::Now() - start);
+
+  std::cout << "count: " << count - 1 << std::endl;
+  return SaveWriterStats(writer, t_data);
+}
+
+int RunWriteTest(P4rtSession* session, const ::p4::config::v1::P4Info& p4info,
+                 ThreadInfo& t_data, const BatchBuilder& build_batch) {
+  p4::v1::WriteRequest write_request;
+  const uint64_t batch_size = (test_params.batch_size == 0)
+                                  ? t_data.num_entries
+                                  : test_params.batch_size;
+  if (test_params.rate > 0) {
+    return RunOpenLoopWriteTest(session, p4info, t_data, batch_size,
+                                build_batch);
+  }
+  if (test_params.max_inflight > 0) {
+    return RunPipelinedWriteTest(session, p4info, t_data, batch_size,
+                                 build_batch);
+  }
+
+  uint64_t count = t_data.start + 1;
+  uint64_t remaining = t_data.num_entries;
+  absl::Duration duration;
+
+  // Each batch is built before it is timed, so only the time spent in
+  // Write RPCs is measured.
+  while (remaining > 0) {
+    const uint64_t num_entries = std::min(batch_size, remaining);
+    ResetWriteRequest(session, &write_request);
+    int status = build_batch(session, p4info, t_data.oper, count,
+                             num_entries, &write_request);
+    if (status != SUCCESS) return status;
+
+    absl::Time timestamp = absl::Now();
+    auto sts = SendWriteRequest(session, write_request);
+    const absl::Duration latency = absl::Now() - timestamp;
+    duration += latency;
+    t_data.latency.Record(latency);
+
+    t_data.num_requests++;
+    if (!sts.ok()) {
+      if (t_data.num_failed_requests++ == 0) {
+        std::cerr << "Thread " << t_data.tid
+                  << ": write request failed: " << sts.message() << std::endl;
+      }
+    }
+    count += num_entries;
+    remaining -= num_entries;
+  }
+  t_data.time_taken = absl::ToDoubleSeconds(duration);
+  t_data.request_time = t_data.time_taken;
+
+  std::cout << "count: " << count - 1 << std::endl;
+  return (t_data.num_failed_requests == 0) ? SUCCESS : INTERNAL_ERR;
+}
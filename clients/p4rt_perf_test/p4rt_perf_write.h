@@ -0,0 +1,31 @@
+// Copyright 2024 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef P4RT_PERF_WRITE_H
+#define P4RT_PERF_WRITE_H
+
+#include <stdint.h>
+
+#include <functional>
+
+#include "p4/v1/p4runtime.pb.h"
+#include "p4rt_perf_session.h"
+#include "p4rt_perf_test.h"
+
+// Adds the updates for the entries [first, first + num_entries) of a test
+// profile to a write request, which the caller set up with
+// ResetWriteRequest.
+using BatchBuilder = std::function<int(
+    P4rtSession* session, const ::p4::config::v1::P4Info& p4info,
+    uint32_t oper, uint64_t first, uint64_t num_entries,
+    p4::v1::WriteRequest* write_request)>;
+
+// Programs the entries of a thread in batches of test_params.batch_size,
+// with blocking write requests, or pipelined ones if test_params.max_inflight
+// is set. If test_params.rate is set, the requests are instead sent open
+// loop at that rate. Fills in the time taken and request statistics of the
+// thread.
+int RunWriteTest(P4rtSession* session, const ::p4::config::v1::P4Info& p4info,
+                 ThreadInfo& t_data, const BatchBuilder& build_batch);
+
+#endif  // P4RT_PERF_WRITE_H
@@ -0,0 +1,263 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// Microbenchmark for the table entry builders.
+//
+// Runs each Prepare* builder of the target against the P4Info of the
+// pipeline (the p4info.txt file generated by p4c for linux_networking),
+// once for an insert and once for a delete. Besides the time per entry,
+// each benchmark reports the heap allocations made per entry and the
+// size of the serialized entry.
+//
+// Example:
+//   ovs_p4rt_bench --p4info=linux_networking.p4info.txt
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <new>
+#include <sstream>
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "benchmark/benchmark.h"
+#include "google/protobuf/text_format.h"
+#include "openvswitch/ovs-p4rt.h"
+#include "ovs_p4rt_builders.h"
+#include "p4/config/v1/p4info.pb.h"
+#include "p4/v1/p4runtime.pb.h"
+
+ABSL_FLAG(std::string, p4info, "",
+          "P4Info of the pipeline, in text or binary format.");
+
+namespace {
+
+std::atomic<int64_t> num_allocations{0};
+
+}  // namespace
+
+// Counts the heap allocations made by the builders.
+void* operator new(size_t size) {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  void* ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+namespace ovs_p4rt {
+namespace {
+
+using Builder = std::function<void(p4::v1::TableEntry*,
+                                   const ::p4::config::v1::P4Info&, bool)>;
+
+void SetIpv4(struct p4_ipaddr* addr, const char* text) {
+  addr->family = AF_INET;
+  addr->prefix_len = 32;
+  inet_pton(AF_INET, text, &addr->ip.v4addr);
+}
+
+void SetIpv6(struct p4_ipaddr* addr, const char* text) {
+  addr->family = AF_INET6;
+  addr->prefix_len = 128;
+  inet_pton(AF_INET6, text, &addr->ip.v6addr);
+}
+
+struct tunnel_info MakeTunnel(bool ipv6) {
+  struct tunnel_info tunnel_info;
+  memset(&tunnel_info, 0, sizeof(tunnel_info));
+  tunnel_info.ifindex = 10;
+  tunnel_info.port_id = 20;
+  tunnel_info.src_port = 30;
+  tunnel_info.dst_port = 4789;
+  tunnel_info.vni = 100;
+  tunnel_info.bridge_id = 1;
+  tunnel_info.vlan_info.port_vlan_mode = P4_PORT_VLAN_NATIVE_TAGGED;
+  tunnel_info.vlan_info.port_vlan = 10;
+  if (ipv6) {
+    SetIpv6(&tunnel_info.local_ip, "2001:db8::1");
+    SetIpv6(&tunnel_info.remote_ip, "2001:db8::2");
+  } else {
+    SetIpv4(&tunnel_info.local_ip, "192.168.1.1");
+    SetIpv4(&tunnel_info.remote_ip, "192.168.1.2");
+  }
+  return tunnel_info;
+}
+
+struct mac_learning_info MakeLearn(bool is_tunnel, bool ipv6) {
+  static const uint8_t kMac[6] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
+  struct mac_learning_info learn_info;
+  memset(&learn_info, 0, sizeof(learn_info));
+  memcpy(learn_info.mac_addr, kMac, sizeof(kMac));
+  learn_info.bridge_id = 1;
+  learn_info.src_port = 5;
+  learn_info.vlan_info.port_vlan_mode = P4_PORT_VLAN_NATIVE_TAGGED;
+  learn_info.vlan_info.port_vlan = 10;
+  learn_info.is_tunnel = is_tunnel;
+  if (is_tunnel) {
+    learn_info.tnl_info = MakeTunnel(ipv6);
+  } else {
+    learn_info.is_vlan = true;
+    learn_info.vln_info.vlan_id = 10;
+  }
+  return learn_info;
+}
+
+struct src_port_info MakeSrcPort() {
+  struct src_port_info sp;
+  memset(&sp, 0, sizeof(sp));
+  sp.bridge_id = 1;
+  sp.vlan_id = 10;
+  sp.src_port = 5;
+  return sp;
+}
+
+// Adapts a builder that takes OVS information of type Info.
+template <typename Info, typename Param>
+Builder Bind(void (*prepare)(p4::v1::TableEntry*, Param,
+                             const ::p4::config::v1::P4Info&, bool),
+             const Info& info) {
+  return [prepare, info](p4::v1::TableEntry* table_entry,
+                         const ::p4::config::v1::P4Info& p4info,
+                         bool insert_entry) {
+    prepare(table_entry, info, p4info, insert_entry);
+  };
+}
+
+void BM_Builder(benchmark::State& state, const Builder& build,
+                const ::p4::config::v1::P4Info* p4info, bool insert_entry) {
+  const int64_t allocations_before = num_allocations.load();
+  for (auto _ : state) {
+    p4::v1::TableEntry table_entry;
+    build(&table_entry, *p4info, insert_entry);
+    benchmark::DoNotOptimize(&table_entry);
+  }
+  const int64_t allocations = num_allocations.load() - allocations_before;
+
+  p4::v1::TableEntry table_entry;
+  build(&table_entry, *p4info, insert_entry);
+
+  state.SetItemsProcessed(state.iterations());
+  state.counters["allocs_per_entry"] =
+      benchmark::Counter(allocations, benchmark::Counter::kAvgIterations);
+  state.counters["bytes_per_entry"] = table_entry.ByteSizeLong();
+}
+
+void RegisterBuilder(const std::string& name, const Builder& build,
+                     const ::p4::config::v1::P4Info* p4info) {
+  benchmark::RegisterBenchmark((name + "/insert").c_str(), BM_Builder,
+                               build, p4info, true);
+  benchmark::RegisterBenchmark((name + "/delete").c_str(), BM_Builder,
+                               build, p4info, false);
+}
+
+void RegisterBuilders(const ::p4::config::v1::P4Info* p4info) {
+  const struct mac_learning_info learn = MakeLearn(false, false);
+  const struct mac_learning_info tunnel_learn = MakeLearn(true, false);
+  const struct tunnel_info tunnel = MakeTunnel(false);
+
+  RegisterBuilder("FdbTxVlan", Bind(&PrepareFdbTxVlanTableEntry, learn),
+                  p4info);
+  RegisterBuilder("FdbRxVlan", Bind(&PrepareFdbRxVlanTableEntry, learn),
+                  p4info);
+  RegisterBuilder("FdbV4Tunnel",
+                  Bind(&PrepareFdbTableEntryforV4Tunnel, tunnel_learn),
+                  p4info);
+  RegisterBuilder("Encap", Bind(&PrepareEncapTableEntry, tunnel), p4info);
+  RegisterBuilder("TunnelTerm", Bind(&PrepareTunnelTermTableEntry, tunnel),
+                  p4info);
+
+#if defined(ES2K_TARGET)
+  const struct mac_learning_info tunnel_learn_v6 = MakeLearn(true, true);
+  const struct tunnel_info tunnel_v6 = MakeTunnel(true);
+  const struct src_port_info sp = MakeSrcPort();
+
+  RegisterBuilder("FdbSmac", Bind(&PrepareFdbSmacTableEntry, learn), p4info);
+  RegisterBuilder("L2ToTunnelV4", Bind(&PrepareL2ToTunnelV4, tunnel_learn),
+                  p4info);
+  RegisterBuilder("L2ToTunnelV6",
+                  Bind(&PrepareL2ToTunnelV6, tunnel_learn_v6), p4info);
+  RegisterBuilder("V6Encap", Bind(&PrepareV6EncapTableEntry, tunnel_v6),
+                  p4info);
+  RegisterBuilder("EncapAndVlanPop",
+                  Bind(&PrepareEncapAndVlanPopTableEntry, tunnel), p4info);
+  RegisterBuilder("V6EncapAndVlanPop",
+                  Bind(&PrepareV6EncapAndVlanPopTableEntry, tunnel_v6),
+                  p4info);
+  RegisterBuilder("RxTunnel", Bind(&PrepareRxTunnelTableEntry, tunnel),
+                  p4info);
+  RegisterBuilder("V6RxTunnel",
+                  Bind(&PrepareV6RxTunnelTableEntry, tunnel_v6), p4info);
+  RegisterBuilder("V6TunnelTerm",
+                  Bind(&PrepareV6TunnelTermTableEntry, tunnel_v6), p4info);
+  RegisterBuilder("DecapMod", Bind(&PrepareDecapModTableEntry, tunnel),
+                  p4info);
+  RegisterBuilder("DecapModAndVlanPush",
+                  Bind(&PrepareDecapModAndVlanPushTableEntry, tunnel),
+                  p4info);
+  RegisterBuilder("VlanPush", Bind(&PrepareVlanPushTableEntry, uint16_t{10}),
+                  p4info);
+  RegisterBuilder("VlanPop", Bind(&PrepareVlanPopTableEntry, uint16_t{10}),
+                  p4info);
+  RegisterBuilder("SrcPort", Bind(&PrepareSrcPortTableEntry, sp), p4info);
+  RegisterBuilder(
+      "TxAccVsi",
+      [](p4::v1::TableEntry* table_entry,
+         const ::p4::config::v1::P4Info& p4info, bool) {
+        PrepareTxAccVsiTableEntry(table_entry, 5, p4info);
+      },
+      p4info);
+#endif
+}
+
+bool ReadP4Info(const std::string& path, ::p4::config::v1::P4Info* p4info) {
+  std::ifstream file(path);
+  if (!file) return false;
+  std::stringstream contents;
+  contents << file.rdbuf();
+  if (google::protobuf::TextFormat::ParseFromString(contents.str(), p4info)) {
+    return true;
+  }
+  p4info->Clear();
+  return p4info->ParseFromString(contents.str());
+}
+
+}  // namespace
+}  // namespace ovs_p4rt
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  absl::ParseCommandLine(argc, argv);
+
+  const std::string path = absl::GetFlag(FLAGS_p4info);
+  if (path.empty()) {
+    printf("Usage: %s --p4info=<p4info.txt> [benchmark options]\n", argv[0]);
+    return 1;
+  }
+
+  // The P4Info lives until the process exits.
+  auto* p4info = new ::p4::config::v1::P4Info();
+  if (!ovs_p4rt::ReadP4Info(path, p4info)) {
+    printf("Unable to read P4Info from %s\n", path.c_str());
+    return 1;
+  }
+  if (p4info->tables_size() == 0) {
+    printf("%s holds no tables\n", path.c_str());
+    return 1;
+  }
+
+  ovs_p4rt::RegisterBuilders(p4info);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,211 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// Microbenchmark for device worker thread placement.
+//
+// Measures the round-trip latency of a request handed to a worker thread
+// the way OvsP4rtShard::Submit hands one over, with and without datapath
+// load on the other CPUs. The worker applies the placement given by the
+// --worker_cpus, --worker_numa_node, --worker_sched_policy and
+// --worker_sched_priority flags. The load threads stream through a buffer
+// larger than the last-level cache, like OVS PMD threads forwarding
+// packets, and are pinned to --load_cpus (by default, the CPUs the worker
+// may not use).
+//
+// Example, with the datapath on CPUs 0-7 and the workers on CPU 8:
+//   ovs_p4rt_placement_bench --worker_cpus=8 --load_cpus=0-7
+
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/synchronization/mutex.h"
+#include "benchmark/benchmark.h"
+#include "ovs_p4rt_placement.h"
+
+ABSL_FLAG(std::string, load_cpus, "",
+          "CPUs to run the datapath load threads on, one thread per CPU. "
+          "Empty means the CPUs the worker threads may not use.");
+ABSL_FLAG(int32_t, load_buffer_mb, 64,
+          "Size of the buffer each load thread streams through, in MB.");
+
+namespace ovs_p4rt {
+namespace {
+
+// A worker thread that serves one request at a time.
+class Worker {
+ public:
+  Worker() : thread_(&Worker::Loop, this) {}
+
+  ~Worker() {
+    {
+      absl::MutexLock lock(&mu_);
+      stop_ = true;
+    }
+    cond_var_.Signal();
+    thread_.join();
+  }
+
+  // Hands a request to the worker and waits for its reply.
+  void RoundTrip() {
+    absl::MutexLock lock(&mu_);
+    pending_ = true;
+    cond_var_.Signal();
+    while (pending_) {
+      cond_var_.Wait(&mu_);
+    }
+  }
+
+ private:
+  void Loop() {
+    absl::Status status = ApplyThreadPlacement(WorkerPlacement());
+    if (!status.ok()) {
+      printf("Unable to place worker thread: %s\n",
+             std::string(status.message()).c_str());
+    }
+
+    absl::MutexLock lock(&mu_);
+    while (true) {
+      while (!pending_ && !stop_) {
+        cond_var_.Wait(&mu_);
+      }
+      if (stop_) return;
+      Serve();
+      pending_ = false;
+      cond_var_.Signal();
+    }
+  }
+
+  // Stands in for building a P4Runtime write request.
+  void Serve() {
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < 256; i++) {
+      hash = (hash ^ i) * 1099511628211ULL;
+    }
+    benchmark::DoNotOptimize(hash);
+  }
+
+  absl::Mutex mu_;
+  absl::CondVar cond_var_;
+  bool pending_ ABSL_GUARDED_BY(mu_) = false;
+  bool stop_ ABSL_GUARDED_BY(mu_) = false;
+  std::thread thread_;
+};
+
+std::vector<int> LoadCpus() {
+  const std::string flag = absl::GetFlag(FLAGS_load_cpus);
+  if (!flag.empty()) {
+    auto status_or_cpus = ParseCpuList(flag);
+    if (status_or_cpus.ok()) return status_or_cpus.value();
+    printf("Ignoring --load_cpus: %s\n",
+           std::string(status_or_cpus.status().message()).c_str());
+  }
+
+  const std::vector<int>& worker_cpus = WorkerPlacement().cpus;
+  std::vector<int> cpus;
+  const int num_cpus = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+  for (int cpu = 0; cpu < num_cpus; cpu++) {
+    if (!std::binary_search(worker_cpus.begin(), worker_cpus.end(), cpu)) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+// Threads that keep the other CPUs and the memory system busy.
+class DatapathLoad {
+ public:
+  DatapathLoad() {
+    const size_t size =
+        static_cast<size_t>(absl::GetFlag(FLAGS_load_buffer_mb)) << 20;
+    for (int cpu : LoadCpus()) {
+      threads_.emplace_back([this, cpu, size] {
+        ThreadPlacement placement;
+        placement.cpus.push_back(cpu);
+        (void)ApplyThreadPlacement(placement);
+
+        std::vector<uint64_t> buffer(size / sizeof(uint64_t), 1);
+        while (!stop_.load(std::memory_order_relaxed)) {
+          for (uint64_t& word : buffer) {
+            word = word * 3 + 1;
+          }
+          benchmark::DoNotOptimize(buffer.data());
+        }
+      });
+    }
+  }
+
+  ~DatapathLoad() {
+    stop_.store(true);
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  size_t NumThreads() const { return threads_.size(); }
+
+ private:
+  std::atomic<bool> stop_{false};
+  std::vector<std::thread> threads_;
+};
+
+double Percentile(std::vector<double>* samples, double percentile) {
+  if (samples->empty()) return 0;
+  const size_t index = std::min(
+      samples->size() - 1,
+      static_cast<size_t>(percentile / 100 * samples->size()));
+  std::nth_element(samples->begin(), samples->begin() + index,
+                   samples->end());
+  return (*samples)[index];
+}
+
+// Arg 0 runs without load, arg 1 with the datapath load threads.
+void BM_RoundTrip(benchmark::State& state) {
+  Worker worker;
+  std::unique_ptr<DatapathLoad> load;
+  if (state.range(0) != 0) load = std::make_unique<DatapathLoad>();
+
+  std::vector<double> samples;
+  for (auto _ : state) {
+    const auto start = std::chrono::steady_clock::now();
+    worker.RoundTrip();
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    state.SetIterationTime(elapsed.count());
+    samples.push_back(elapsed.count() * 1e6);
+  }
+
+  state.counters["p50_us"] = Percentile(&samples, 50);
+  state.counters["p99_us"] = Percentile(&samples, 99);
+  state.counters["p999_us"] = Percentile(&samples, 99.9);
+  state.counters["load_threads"] = load ? load->NumThreads() : 0;
+}
+BENCHMARK(BM_RoundTrip)
+    ->ArgName("load")
+    ->Arg(0)
+    ->Arg(1)
+    ->UseManualTime()
+    ->MinTime(2.0);
+
+}  // namespace
+}  // namespace ovs_p4rt
+
+int main(int argc, char** argv) {
+  // Google Benchmark removes the arguments it recognizes; the rest are
+  // placement flags.
+  benchmark::Initialize(&argc, argv);
+  absl::ParseCommandLine(argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
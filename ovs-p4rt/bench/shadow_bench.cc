@@ -0,0 +1,126 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// Microbenchmark for concurrent shadow table access.
+//
+// Compares ShadowTable, whose lookups are lock-free, with a table that
+// guards an absl::flat_hash_map with a mutex. Each thread looks up FDB
+// entries at random; in the Mixed benchmarks, one operation in 16 updates
+// an entry instead, as a worker shard does when a MAC moves.
+
+#include <stdint.h>
+
+#include <random>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "benchmark/benchmark.h"
+#include "ovs_p4rt_shadow.h"
+
+namespace ovs_p4rt {
+namespace {
+
+constexpr int kNumEntries = 64 * 1024;
+
+// The shadow table as it was before lookups became lock-free.
+class MutexShadowTable {
+ public:
+  bool Find(uint64_t key, ShadowEntry* entry) const {
+    absl::MutexLock lock(&mu_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) return false;
+    *entry = it->second;
+    return true;
+  }
+
+  void Insert(uint64_t key, const ShadowEntry& entry) {
+    absl::MutexLock lock(&mu_);
+    entries_[key] = entry;
+  }
+
+ private:
+  mutable absl::Mutex mu_;
+  absl::flat_hash_map<uint64_t, ShadowEntry> entries_ ABSL_GUARDED_BY(mu_);
+};
+
+ShadowEntry MakeFdbEntry(int i) {
+  ShadowEntry entry = {};
+  entry.kind = ShadowKind::kFdb;
+  entry.learn_info.bridge_id = i % 4;
+  for (int b = 0; b < 6; b++) {
+    entry.learn_info.mac_addr[b] = (i >> (8 * (5 - b))) & 0xff;
+  }
+  entry.learn_info.mac_addr[0] = 0x02;
+  entry.learn_info.src_port = i;
+  return entry;
+}
+
+const std::vector<ShadowEntry>& Entries() {
+  static const auto* entries = [] {
+    auto* entries = new std::vector<ShadowEntry>();
+    for (int i = 0; i < kNumEntries; i++) {
+      entries->push_back(MakeFdbEntry(i));
+    }
+    return entries;
+  }();
+  return *entries;
+}
+
+template <typename Table>
+Table* SharedTable() {
+  static Table* table = [] {
+    auto* table = new Table();
+    for (const auto& entry : Entries()) {
+      table->Insert(FdbShadowKey(entry.learn_info), entry);
+    }
+    return table;
+  }();
+  return table;
+}
+
+template <typename Table>
+void BM_Access(benchmark::State& state, int write_interval) {
+  Table* table = SharedTable<Table>();
+  const std::vector<ShadowEntry>& entries = Entries();
+  std::minstd_rand rng(state.thread_index());
+  int found = 0;
+  int ops = 0;
+
+  for (auto _ : state) {
+    const ShadowEntry& entry = entries[rng() % entries.size()];
+    const uint64_t key = FdbShadowKey(entry.learn_info);
+    if (write_interval != 0 && ++ops % write_interval == 0) {
+      table->Insert(key, entry);
+    } else {
+      ShadowEntry found_entry;
+      found += table->Find(key, &found_entry);
+    }
+  }
+  benchmark::DoNotOptimize(found);
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <typename Table>
+void BM_Find(benchmark::State& state) {
+  BM_Access<Table>(state, 0);
+}
+
+template <typename Table>
+void BM_Mixed(benchmark::State& state) {
+  BM_Access<Table>(state, 16);
+}
+
+BENCHMARK_TEMPLATE(BM_Find, ShadowTable)->ThreadRange(1, 32)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Find, MutexShadowTable)
+    ->ThreadRange(1, 32)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Mixed, ShadowTable)->ThreadRange(1, 32)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Mixed, MutexShadowTable)
+    ->ThreadRange(1, 32)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace ovs_p4rt
+
+BENCHMARK_MAIN();
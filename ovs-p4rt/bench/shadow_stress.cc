@@ -0,0 +1,322 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// Stress test for the lock-free shadow table and epoch-based reclamation.
+//
+// Reader threads look up and walk a ShadowTable while writer threads, each
+// owning part of the keys as the worker shards of a device do, insert,
+// replace and erase entries. Every round ends with a Clear() while the
+// readers go on, so the table is retired and grown back again and again.
+// Each entry carries a check value derived from its generation, and a
+// reader that sees an entry whose key or check value is wrong has seen a
+// torn or reclaimed entry.
+//
+// A second part checks the EpochDomain directly: a writer keeps replacing
+// a shared object and retires the old one, and readers check that an
+// object they hold inside a guard is not recycled under them. Retired
+// objects go back to a pool rather than being freed, so that a premature
+// reclamation is detected instead of being undefined behavior.
+//
+// The test exits with status 1 if any check fails.
+//
+// Example:
+//   ovs_p4rt_shadow_stress --readers=16 --writers=4 --seconds=60
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "ovs_p4rt_epoch.h"
+#include "ovs_p4rt_shadow.h"
+
+ABSL_FLAG(int32_t, readers, 8, "Number of reader threads.");
+ABSL_FLAG(int32_t, writers, 4,
+          "Number of writer threads, each owning an equal part of the keys.");
+ABSL_FLAG(int32_t, keys, 256 * 1024, "Number of distinct shadow keys.");
+ABSL_FLAG(int32_t, seconds, 10, "Duration of the test.");
+ABSL_FLAG(int32_t, round_ms, 200,
+          "Duration of each round, at the end of which the table is "
+          "cleared.");
+
+namespace ovs_p4rt {
+namespace {
+
+// Reader operations between two walks of the whole table.
+constexpr uint64_t kWalkInterval = 4096;
+
+// Returns the FDB entry for key index i at a generation. The generation is
+// stored along with its complement, which a reader checks.
+ShadowEntry MakeEntry(uint32_t i, uint32_t generation) {
+  ShadowEntry entry = {};
+  entry.kind = ShadowKind::kFdb;
+  entry.learn_info.bridge_id = i % 4;
+  entry.learn_info.mac_addr[0] = 0x02;
+  for (int b = 1; b < 6; b++) {
+    entry.learn_info.mac_addr[b] = (i >> (8 * (5 - b))) & 0xff;
+  }
+  entry.learn_info.src_port = generation;
+  entry.learn_info.tnl_info.src_port = ~generation;
+  return entry;
+}
+
+uint64_t KeyOf(uint32_t i) { return FdbShadowKey(MakeEntry(i, 0).learn_info); }
+
+bool IsValid(uint64_t key, const ShadowEntry& entry) {
+  return entry.kind == ShadowKind::kFdb &&
+         FdbShadowKey(entry.learn_info) == key &&
+         entry.learn_info.tnl_info.src_port == ~entry.learn_info.src_port;
+}
+
+struct Counters {
+  std::atomic<uint64_t> reads{0};
+  std::atomic<uint64_t> walked{0};
+  std::atomic<uint64_t> writes{0};
+  std::atomic<uint64_t> failures{0};
+};
+
+void Fail(Counters* counters, const char* what, uint64_t key) {
+  if (counters->failures.fetch_add(1) < 10) {
+    printf("FAIL: %s (key %016" PRIx64 ")\n", what, key);
+  }
+}
+
+void ShadowReader(const ShadowTable* table, uint32_t num_keys, int seed,
+                  const std::atomic<bool>* stop, Counters* counters) {
+  std::minstd_rand rng(seed);
+  uint64_t reads = 0;
+  uint64_t walked = 0;
+
+  while (!stop->load(std::memory_order_relaxed)) {
+    const uint64_t key = KeyOf(rng() % num_keys);
+    ShadowEntry entry;
+    if (table->Find(key, &entry) && !IsValid(key, entry)) {
+      Fail(counters, "Find returned a corrupt entry", key);
+    }
+    table->Contains(key);
+
+    if (++reads % kWalkInterval == 0) {
+      table->ForEach([&](uint64_t key, const ShadowEntry& entry) {
+        if (!IsValid(key, entry)) {
+          Fail(counters, "ForEach visited a corrupt entry", key);
+        }
+        walked++;
+      });
+    }
+  }
+  counters->reads += reads;
+  counters->walked += walked;
+}
+
+// Writes the keys i with i % num_writers == index. A writer owns its keys,
+// so it reads back what it wrote.
+void ShadowWriter(ShadowTable* table, uint32_t num_keys, int index,
+                  int num_writers, absl::Time end, Counters* counters) {
+  std::minstd_rand rng(1000 + index);
+  std::vector<uint32_t> generations(num_keys / num_writers + 1);
+  uint64_t writes = 0;
+
+  while (absl::Now() < end) {
+    const uint32_t slot = rng() % generations.size();
+    const uint32_t i = slot * num_writers + index;
+    if (i >= num_keys) continue;
+    const uint64_t key = KeyOf(i);
+
+    ShadowEntry entry;
+    if (rng() % 4 == 0) {
+      table->Erase(key);
+      if (table->Find(key, &entry)) Fail(counters, "Erased key found", key);
+    } else {
+      const uint32_t generation = ++generations[slot];
+      table->Insert(key, MakeEntry(i, generation));
+      if (!table->Find(key, &entry) ||
+          entry.learn_info.src_port != generation) {
+        Fail(counters, "Inserted entry not found", key);
+      }
+    }
+    writes++;
+  }
+  counters->writes += writes;
+}
+
+// An object handed to readers through an atomic pointer. Its id changes
+// only when it is recycled.
+struct Canary {
+  std::atomic<uint64_t> id{0};
+};
+
+// Retired canaries come back here instead of being freed.
+class CanaryPool {
+ public:
+  Canary* Get() {
+    absl::MutexLock lock(&mu_);
+    if (free_.empty()) {
+      all_.push_back(absl::make_unique<Canary>());
+      return all_.back().get();
+    }
+    Canary* canary = free_.back();
+    free_.pop_back();
+    return canary;
+  }
+
+  void Put(Canary* canary) {
+    absl::MutexLock lock(&mu_);
+    free_.push_back(canary);
+    reclaimed_++;
+  }
+
+  size_t allocated() {
+    absl::MutexLock lock(&mu_);
+    return all_.size();
+  }
+
+  uint64_t reclaimed() {
+    absl::MutexLock lock(&mu_);
+    return reclaimed_;
+  }
+
+ private:
+  absl::Mutex mu_;
+  std::vector<std::unique_ptr<Canary>> all_ ABSL_GUARDED_BY(mu_);
+  std::vector<Canary*> free_ ABSL_GUARDED_BY(mu_);
+  uint64_t reclaimed_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+void EpochReader(const std::atomic<Canary*>* current,
+                 const std::atomic<bool>* stop, Counters* counters) {
+  uint64_t reads = 0;
+  while (!stop->load(std::memory_order_relaxed)) {
+    EpochDomain::ReadGuard guard;
+    Canary* canary = current->load();
+    const uint64_t id = canary->id.load();
+    // Stay in the guard for a while, so that the writer retires the
+    // canary meanwhile.
+    for (int i = 0; i < 64; i++) {
+      if (canary->id.load(std::memory_order_relaxed) != id) {
+        Fail(counters, "Canary recycled inside a read guard", id);
+        break;
+      }
+    }
+    reads++;
+  }
+  counters->reads += reads;
+}
+
+void EpochWriter(std::atomic<Canary*>* current, CanaryPool* pool,
+                 absl::Time end, Counters* counters) {
+  uint64_t next_id = 1;
+  uint64_t writes = 0;
+  while (absl::Now() < end) {
+    Canary* canary = pool->Get();
+    canary->id.store(++next_id);
+    Canary* old = current->exchange(canary);
+    EpochDomain::Instance().Retire([pool, old] { pool->Put(old); });
+    writes++;
+  }
+  counters->writes += writes;
+}
+
+int RunShadowStress(int num_readers, int num_writers, uint32_t num_keys,
+                    absl::Duration duration, absl::Duration round) {
+  ShadowTable table;
+  Counters counters;
+  std::atomic<bool> stop{false};
+
+  std::vector<std::thread> readers;
+  for (int i = 0; i < num_readers; i++) {
+    readers.emplace_back(ShadowReader, &table, num_keys, i, &stop, &counters);
+  }
+
+  const absl::Time end = absl::Now() + duration;
+  int rounds = 0;
+  while (absl::Now() < end) {
+    const absl::Time round_end = std::min(end, absl::Now() + round);
+    std::vector<std::thread> writers;
+    for (int i = 0; i < num_writers; i++) {
+      writers.emplace_back(ShadowWriter, &table, num_keys, i, num_writers,
+                           round_end, &counters);
+    }
+    for (auto& writer : writers) {
+      writer.join();
+    }
+    table.Clear();
+    if (table.size() != 0) Fail(&counters, "Table not empty after Clear", 0);
+    rounds++;
+  }
+
+  stop = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  printf("Shadow table: %d rounds, %" PRIu64 " writes, %" PRIu64
+         " lookups, %" PRIu64 " entries walked, %" PRIu64 " failures\n",
+         rounds, counters.writes.load(), counters.reads.load(),
+         counters.walked.load(), counters.failures.load());
+  return counters.failures.load() == 0 ? 0 : 1;
+}
+
+int RunEpochStress(int num_readers, absl::Duration duration) {
+  CanaryPool pool;
+  Counters counters;
+  std::atomic<bool> stop{false};
+  std::atomic<Canary*> current{pool.Get()};
+
+  std::vector<std::thread> readers;
+  for (int i = 0; i < num_readers; i++) {
+    readers.emplace_back(EpochReader, &current, &stop, &counters);
+  }
+  EpochWriter(&current, &pool, absl::Now() + duration, &counters);
+  stop = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  // Objects are reclaimed in batches, so a few are always pending. If the
+  // readers held reclamation back for good, every retired object would
+  // have needed a new one.
+  const uint64_t retired = counters.writes.load();
+  const uint64_t reclaimed = pool.reclaimed();
+  if (retired > 0 && reclaimed == 0) {
+    Fail(&counters, "No retired object was reclaimed", 0);
+  }
+
+  printf("Epoch domain: %" PRIu64 " retired, %" PRIu64
+         " reclaimed, %zu allocated, %" PRIu64 " guarded reads, %" PRIu64
+         " failures\n",
+         retired, reclaimed, pool.allocated(), counters.reads.load(),
+         counters.failures.load());
+  return counters.failures.load() == 0 ? 0 : 1;
+}
+
+}  // namespace
+}  // namespace ovs_p4rt
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+
+  const int num_readers = std::max(absl::GetFlag(FLAGS_readers), 1);
+  const int num_writers = std::max(absl::GetFlag(FLAGS_writers), 1);
+  const uint32_t num_keys = std::max(absl::GetFlag(FLAGS_keys), num_writers);
+  const absl::Duration duration = absl::Seconds(absl::GetFlag(FLAGS_seconds));
+  const absl::Duration round = absl::Milliseconds(
+      std::max(absl::GetFlag(FLAGS_round_ms), 1));
+
+  // Each part gets half of the time.
+  int status = ovs_p4rt::RunShadowStress(num_readers, num_writers, num_keys,
+                                         duration / 2, round);
+  status |= ovs_p4rt::RunEpochStress(num_readers, duration / 2);
+  return status;
+}
@@ -3,11 +3,26 @@
 // TODO: ovs-p4rt logging
 
 #include <arpa/inet.h>
+#include <string.h>
 
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
 #include "absl/flags/flag.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
 #include "openvswitch/ovs-p4rt.h"
+#include "ovs_p4rt_builders.h"
+#include "ovs_p4rt_bulk.h"
+#include "ovs_p4rt_device.h"
 #include "ovs_p4rt_session.h"
-#include "ovs_p4rt_tls_credentials.h"
+#include "ovs_p4rt_trace.h"
 
 #if defined(DPDK_TARGET)
 #include "dpdk/p4_name_mapping.h"
@@ -15,9 +30,11 @@
 #include "es2k/p4_name_mapping.h"
 #endif
 
-ABSL_FLAG(std::string, grpc_addr, "localhost:9559",
-          "P4Runtime server address.");
-ABSL_FLAG(uint64_t, device_id, 1, "P4Runtime device ID.");
+ABSL_FLAG(int32_t, write_batch_size, 1000,
+          "Maximum number of updates per WriteRequest when reconciling.");
+ABSL_FLAG(int32_t, learn_batch_size, 64,
+          "Maximum number of queued MAC learns a worker shard applies "
+          "together. 1 applies each learn on its own.");
 
 namespace ovs_p4rt {
 
@@ -1426,47 +1443,123 @@ absl::Status ConfigTunnelTermTableEntry(ovs_p4rt::OvsP4rtSession* session,
   return ovs_p4rt::SendWriteRequest(session, write_request);
 }
 
-}  // namespace ovs_p4rt
-
 //----------------------------------------------------------------------
-// Functions with C interfaces
+// Request handlers (run on the device worker thread)
 //----------------------------------------------------------------------
 
 #if defined(ES2K_TARGET)
-void ConfigFdbTableEntry(struct mac_learning_info learn_info,
-                         bool insert_entry) {
-  using namespace ovs_p4rt;
+// Reads the host port that was configured for a VSI in tx_acc_vsi.
+absl::StatusOr<uint32_t> GetVsiHostPort(
+    OvsP4rtSession* session, uint32_t sp,
+    const ::p4::config::v1::P4Info& p4info) {
+  auto status_or_read_response = GetTxAccVsiTableEntry(session, sp, p4info);
+  if (!status_or_read_response.ok()) return status_or_read_response.status();
 
-  // Start a new client session.
-  auto status_or_session = ovs_p4rt::OvsP4rtSession::Create(
-      absl::GetFlag(FLAGS_grpc_addr), GenerateClientCredentials(),
-      absl::GetFlag(FLAGS_device_id));
-  if (!status_or_session.ok()) return;
+  ::p4::v1::ReadResponse read_response =
+      std::move(status_or_read_response).value();
 
-  // Unwrap the session from the StatusOr object.
-  std::unique_ptr<ovs_p4rt::OvsP4rtSession> session =
-      std::move(status_or_session).value();
-  ::p4::config::v1::P4Info p4info;
-  ::absl::Status status =
-      ovs_p4rt::GetForwardingPipelineConfig(session.get(), &p4info);
-  if (!status.ok()) return;
+  int param_id =
+      GetParamId(p4info, TX_ACC_VSI_TABLE_ACTION_L2_FWD_AND_BYPASS_BRIDGE,
+                 ACTION_L2_FWD_AND_BYPASS_BRIDGE_PARAM_PORT);
+
+  uint32_t host_sp = 0;
+  for (const auto& entity : read_response.entities()) {
+    const auto& action = entity.table_entry().action().action();
+    for (const auto& param : action.params()) {
+      if (param_id == param.param_id()) {
+        const std::string& value = param.value();
+        for (int param_bytes = 0; param_bytes < 4; param_bytes++) {
+          host_sp = host_sp << 8 | int(value[param_bytes]);
+        }
+        break;
+      }
+    }
+  }
+  return host_sp;
+}
+
+// Adds the MACs in the l2_to_tunnel tables to the filter, so that it
+// covers the entries installed before it was created.
+absl::Status SeedTunnelMacFilter(OvsP4rtSession* session,
+                                 const ::p4::config::v1::P4Info& p4info,
+                                 TunnelMacFilter* tunnel_macs) {
+  const struct {
+    const char* table;
+    const char* key_da;
+  } tables[] = {
+      {L2_TO_TUNNEL_V4_TABLE, L2_TO_TUNNEL_V4_KEY_DA},
+      {L2_TO_TUNNEL_V6_TABLE, L2_TO_TUNNEL_V6_KEY_DA},
+  };
+
+  for (const auto& t : tables) {
+    // A table entry without match fields reads the whole table.
+    ::p4::v1::ReadRequest read_request;
+    SetupTableEntryToRead(session, &read_request)
+        ->set_table_id(GetTableId(p4info, t.table));
+
+    auto status_or_read_response = SendReadRequest(session, read_request);
+    if (!status_or_read_response.ok()) {
+      return status_or_read_response.status();
+    }
+
+    const uint32_t field_id = GetMatchFieldId(p4info, t.table, t.key_da);
+    for (const auto& entity : status_or_read_response.value().entities()) {
+      for (const auto& match : entity.table_entry().match()) {
+        if (match.field_id() != field_id) continue;
+        uint64_t mac = 0;
+        for (unsigned char byte : match.exact().value()) {
+          mac = (mac << 8) | byte;
+        }
+        tunnel_macs->Add(mac);
+      }
+    }
+  }
+  return absl::OkStatus();
+}
+
+// Returns true if the MAC of an FDB entry being deleted may have been
+// learned on a tunnel, seeding the filter on first use.
+bool MayBeTunnelMac(OvsP4rtSession* session,
+                    const ::p4::config::v1::P4Info& p4info,
+                    TunnelMacFilter* tunnel_macs, uint64_t mac) {
+  if (tunnel_macs == nullptr) return true;
+
+  if (!tunnel_macs->IsSeeded()) {
+    absl::Status status = tunnel_macs->SeedOnce([&]() {
+      return SeedTunnelMacFilter(session, p4info, tunnel_macs);
+    });
+    if (!status.ok()) return true;
+  }
+  return tunnel_macs->MayContain(mac);
+}
+
+absl::Status ConfigFdbTableEntry(OvsP4rtSession* session,
+                                 struct mac_learning_info learn_info,
+                                 const ::p4::config::v1::P4Info& p4info,
+                                 bool insert_entry,
+                                 TunnelMacFilter* tunnel_macs) {
+  ::absl::Status status;
+  const uint64_t mac = MacToInt(learn_info.mac_addr);
 
   /* Hack: When we delete an FDB entry based on current logic  we will not know
    * we will not know if its an Tunnel learn FDB or regular VSI learn FDB.
    * This hack, during delete case check if entry is present in l2_to_tunnel_v4
    * and l2_to_tunnel_v6. if any of these 2 tables is true then go ahead and
    * delete the entry.
+   * The reads are skipped if the caller knows the entry is a tunnel entry,
+   * or if the filter of tunnel-learned MACs rules it out.
    */
 
-  if (!insert_entry) {
+  if (!insert_entry && !learn_info.is_tunnel &&
+      MayBeTunnelMac(session, p4info, tunnel_macs, mac)) {
     auto status_or_read_response =
-        GetL2ToTunnelV4TableEntry(session.get(), learn_info, p4info);
+        GetL2ToTunnelV4TableEntry(session, learn_info, p4info);
     if (status_or_read_response.ok()) {
       learn_info.is_tunnel = true;
     }
 
     status_or_read_response =
-        GetL2ToTunnelV6TableEntry(session.get(), learn_info, p4info);
+        GetL2ToTunnelV6TableEntry(session, learn_info, p4info);
     if (status_or_read_response.ok()) {
       learn_info.is_tunnel = true;
     }
@@ -1475,299 +1568,1437 @@ void ConfigFdbTableEntry(struct mac_learning_info learn_info,
   if (learn_info.is_tunnel) {
     if (insert_entry) {
       auto status_or_read_response =
-          GetFdbTunnelTableEntry(session.get(), learn_info, p4info);
+          GetFdbTunnelTableEntry(session, learn_info, p4info);
       if (status_or_read_response.ok()) {
-        return;
+        return absl::OkStatus();
       }
+      if (tunnel_macs != nullptr) tunnel_macs->Add(mac);
     }
 
-    status = ConfigFdbTunnelTableEntry(session.get(), learn_info, p4info,
-                                       insert_entry);
+    status =
+        ConfigFdbTunnelTableEntry(session, learn_info, p4info, insert_entry);
     if (!status.ok())
       printf("%s: Failed to program l2_fwd_tx_table for tunnel\n",
              insert_entry ? "ADD" : "DELETE");
 
-    status = ConfigL2TunnelTableEntry(session.get(), learn_info, p4info,
-                                      insert_entry);
+    status =
+        ConfigL2TunnelTableEntry(session, learn_info, p4info, insert_entry);
     if (!status.ok())
       printf("%s: Failed to program l2_tunnel_to_v4_table for tunnel\n",
              insert_entry ? "ADD" : "DELETE");
+    else if (!insert_entry && tunnel_macs != nullptr)
+      tunnel_macs->Remove(mac);
 
-    status = ConfigFdbSmacTableEntry(session.get(), learn_info, p4info,
-                                     insert_entry);
+    status = ConfigFdbSmacTableEntry(session, learn_info, p4info, insert_entry);
     if (!status.ok())
       printf("%s: Failed to program l2_fwd_smac_table\n",
              insert_entry ? "ADD" : "DELETE");
   } else {
     if (insert_entry) {
       auto status_or_read_response =
-          GetFdbVlanTableEntry(session.get(), learn_info, p4info);
+          GetFdbVlanTableEntry(session, learn_info, p4info);
       if (status_or_read_response.ok()) {
-        return;
+        return absl::OkStatus();
       }
 
-      status_or_read_response =
-          GetTxAccVsiTableEntry(session.get(), learn_info.src_port, p4info);
-      if (!status_or_read_response.ok()) return;
-
-      ::p4::v1::ReadResponse read_response =
-          std::move(status_or_read_response).value();
-      std::vector<::p4::v1::TableEntry> table_entries;
-
-      table_entries.reserve(read_response.entities().size());
-
-      int param_id =
-          GetParamId(p4info, TX_ACC_VSI_TABLE_ACTION_L2_FWD_AND_BYPASS_BRIDGE,
-                     ACTION_L2_FWD_AND_BYPASS_BRIDGE_PARAM_PORT);
-
-      uint32_t host_sp = 0;
-      for (const auto& entity : read_response.entities()) {
-        p4::v1::TableEntry table_entry_1 = entity.table_entry();
-        auto* table_action = table_entry_1.mutable_action();
-        auto* action = table_action->mutable_action();
-        for (const auto& param : action->params()) {
-          if (param_id == param.param_id()) {
-            const std::string& s1 = param.value();
-            std::string s2 = s1;
-            for (int param_bytes = 0; param_bytes < 4; param_bytes++) {
-              host_sp = host_sp << 8 | int(s2[param_bytes]);
-            }
-            break;
-          }
-        }
-      }
+      auto status_or_host_sp =
+          GetVsiHostPort(session, learn_info.src_port, p4info);
+      if (!status_or_host_sp.ok()) return status_or_host_sp.status();
 
-      learn_info.src_port = host_sp;
+      learn_info.src_port = status_or_host_sp.value();
     }
 
-    status = ConfigFdbTxVlanTableEntry(session.get(), learn_info, p4info,
-                                       insert_entry);
+    status =
+        ConfigFdbTxVlanTableEntry(session, learn_info, p4info, insert_entry);
     if (!status.ok())
       printf("%s: Failed to program l2_fwd_tx_table\n",
              insert_entry ? "ADD" : "DELETE");
 
-    status = ConfigFdbRxVlanTableEntry(session.get(), learn_info, p4info,
-                                       insert_entry);
+    status =
+        ConfigFdbRxVlanTableEntry(session, learn_info, p4info, insert_entry);
     if (!status.ok())
       printf("%s: Failed to program l2_fwd_rx_table\n",
              insert_entry ? "ADD" : "DELETE");
-    status = ConfigFdbSmacTableEntry(session.get(), learn_info, p4info,
-                                     insert_entry);
+    status = ConfigFdbSmacTableEntry(session, learn_info, p4info, insert_entry);
     if (!status.ok())
       printf("%s: Failed to program l2_fwd_smac_table\n",
              insert_entry ? "ADD" : "DELETE");
   }
-  if (!status.ok()) return;
-  return;
+  return status;
 }
 
-void ConfigIpTunnelTermTableEntry(struct tunnel_info tunnel_info,
+absl::Status HandleSrcPortRequest(OvsP4rtSession* session,
+                                  const ::p4::config::v1::P4Info& p4info,
+                                  struct src_port_info vsi_sp,
                                   bool insert_entry) {
-  using namespace ovs_p4rt;
+  auto status_or_host_sp = GetVsiHostPort(session, vsi_sp.src_port, p4info);
+  if (!status_or_host_sp.ok()) return status_or_host_sp.status();
 
-  // Start a new client session.
-  auto status_or_session = OvsP4rtSession::Create(
-      absl::GetFlag(FLAGS_grpc_addr), GenerateClientCredentials(),
-      absl::GetFlag(FLAGS_device_id));
-  if (!status_or_session.ok()) return;
+  vsi_sp.src_port = status_or_host_sp.value();
 
-  // Unwrap the session from the StatusOr object.
-  std::unique_ptr<OvsP4rtSession> session =
-      std::move(status_or_session).value();
-  ::p4::config::v1::P4Info p4info;
-  ::absl::Status status = GetForwardingPipelineConfig(session.get(), &p4info);
-  if (!status.ok()) return;
+  return ConfigureVsiSrcPortTableEntry(session, vsi_sp, p4info, insert_entry);
+}
 
-  status = ConfigTunnelTermTableEntry(session.get(), tunnel_info, p4info,
-                                      insert_entry);
-  if (!status.ok()) return;
+absl::Status HandleTunnelSrcPortRequest(OvsP4rtSession* session,
+                                        const ::p4::config::v1::P4Info& p4info,
+                                        const struct src_port_info& tnl_sp,
+                                        bool insert_entry) {
+  p4::v1::WriteRequest write_request;
+  ::p4::v1::TableEntry* table_entry;
 
-  return;
+  if (insert_entry) {
+    table_entry = SetupTableEntryToInsert(session, &write_request);
+  } else {
+    table_entry = SetupTableEntryToDelete(session, &write_request);
+  }
+
+  PrepareSrcPortTableEntry(table_entry, tnl_sp, p4info, insert_entry);
+
+  return SendWriteRequest(session, write_request);
 }
 
-void ConfigRxTunnelSrcTableEntry(struct tunnel_info tunnel_info,
+absl::Status HandleVlanRequest(OvsP4rtSession* session,
+                               const ::p4::config::v1::P4Info& p4info,
+                               uint16_t vlan_id, bool insert_entry) {
+  absl::Status status =
+      ConfigVlanPushTableEntry(session, vlan_id, p4info, insert_entry);
+  if (!status.ok()) return status;
+
+  return ConfigVlanPopTableEntry(session, vlan_id, p4info, insert_entry);
+}
+#else
+
+// DPDK target. The filter of tunnel-learned MACs is not used: deletes
+// never read the tunnel tables here.
+absl::Status ConfigFdbTableEntry(OvsP4rtSession* session,
+                                 const struct mac_learning_info& learn_info,
+                                 const ::p4::config::v1::P4Info& p4info,
+                                 bool insert_entry,
+                                 TunnelMacFilter* /*tunnel_macs*/) {
+  absl::Status status;
+
+  if (learn_info.is_tunnel) {
+    status =
+        ConfigFdbTunnelTableEntry(session, learn_info, p4info, insert_entry);
+  } else if (learn_info.is_vlan) {
+    status =
+        ConfigFdbTxVlanTableEntry(session, learn_info, p4info, insert_entry);
+    if (!status.ok()) return status;
+
+    status =
+        ConfigFdbRxVlanTableEntry(session, learn_info, p4info, insert_entry);
+  }
+  return status;
+}
+#endif
+
+bool SameIpAddr(const struct p4_ipaddr& a, const struct p4_ipaddr& b) {
+  if (a.family != b.family) return false;
+  if (a.family == AF_INET6) {
+    return memcmp(&a.ip.v6addr, &b.ip.v6addr, sizeof(a.ip.v6addr)) == 0;
+  }
+  return a.ip.v4addr.s_addr == b.ip.v4addr.s_addr;
+}
+
+// Returns true if both requests program identical FDB entries.
+bool FdbEntriesMatch(const struct mac_learning_info& a,
+                     const struct mac_learning_info& b) {
+  if (a.is_tunnel != b.is_tunnel || a.is_vlan != b.is_vlan) return false;
+
+  if (a.is_tunnel) {
+#if defined(ES2K_TARGET)
+    if (a.vlan_info.port_vlan_mode != b.vlan_info.port_vlan_mode) return false;
+#endif
+    return a.tnl_info.vni == b.tnl_info.vni &&
+           SameIpAddr(a.tnl_info.local_ip, b.tnl_info.local_ip) &&
+           SameIpAddr(a.tnl_info.remote_ip, b.tnl_info.remote_ip);
+  }
+
+#if defined(ES2K_TARGET)
+  return a.src_port == b.src_port &&
+         a.vlan_info.port_vlan_mode == b.vlan_info.port_vlan_mode &&
+         a.vlan_info.port_vlan == b.vlan_info.port_vlan;
+#else
+  return a.vln_info.vlan_id == b.vln_info.vlan_id;
+#endif
+}
+
+// Returns true if an FDB entry is written to the device. On DPDK, MACs
+// learned on ports without a VLAN have no table entries.
+bool IsFdbProgrammed(const struct mac_learning_info& learn_info) {
+#if defined(DPDK_TARGET)
+  return learn_info.is_tunnel || learn_info.is_vlan;
+#else
+  return true;
+#endif
+}
+
+// Returns true if an FDB entry can be moved from old_info to new_info by
+// modifying the actions of its table entries, i.e. both program the same
+// set of tables with the same match keys.
+bool IsFdbModifiable(const struct mac_learning_info& old_info,
+                     const struct mac_learning_info& new_info) {
+  if (old_info.is_tunnel != new_info.is_tunnel) return false;
+  if (old_info.is_tunnel) {
+    return old_info.tnl_info.local_ip.family ==
+               new_info.tnl_info.local_ip.family &&
+           old_info.tnl_info.remote_ip.family ==
+               new_info.tnl_info.remote_ip.family;
+  }
+#if defined(DPDK_TARGET)
+  return old_info.is_vlan && new_info.is_vlan;
+#else
+  return true;
+#endif
+}
+
+// Moves an existing FDB entry to a new port, VLAN or tunnel by sending a
+// single WriteRequest with one MODIFY per table.
+absl::Status ModifyFdbTableEntries(OvsP4rtSession* session,
+                                   struct mac_learning_info learn_info,
+                                   const ::p4::config::v1::P4Info& p4info) {
+  ::p4::v1::WriteRequest write_request;
+
+  if (learn_info.is_tunnel) {
+    PrepareFdbTableEntryforV4Tunnel(
+        SetupTableEntryToModify(session, &write_request), learn_info, p4info,
+        true);
+#if defined(ES2K_TARGET)
+    ::p4::v1::TableEntry* table_entry =
+        SetupTableEntryToModify(session, &write_request);
+    if (learn_info.tnl_info.local_ip.family == AF_INET6 &&
+        learn_info.tnl_info.remote_ip.family == AF_INET6) {
+      PrepareL2ToTunnelV6(table_entry, learn_info, p4info, true);
+    } else {
+      PrepareL2ToTunnelV4(table_entry, learn_info, p4info, true);
+    }
+#endif
+  } else {
+#if defined(ES2K_TARGET)
+    auto status_or_host_sp =
+        GetVsiHostPort(session, learn_info.src_port, p4info);
+    if (!status_or_host_sp.ok()) return status_or_host_sp.status();
+
+    learn_info.src_port = status_or_host_sp.value();
+#endif
+    PrepareFdbTxVlanTableEntry(SetupTableEntryToModify(session, &write_request),
+                               learn_info, p4info, true);
+    PrepareFdbRxVlanTableEntry(SetupTableEntryToModify(session, &write_request),
+                               learn_info, p4info, true);
+  }
+
+  return SendWriteRequest(session, write_request);
+}
+
+// Programs an FDB entry, using the shadow state to detect station moves.
+// When a known MAC reappears on a different port, VLAN or tunnel, the
+// installed entries are modified in place instead of being deleted and
+// re-inserted, so the MAC keeps forwarding throughout the move.
+absl::Status HandleFdbRequest(OvsP4rtSession* session,
+                              const ::p4::config::v1::P4Info& p4info,
+                              ShadowTable* shadow,
+                              TunnelMacFilter* tunnel_macs,
+                              const struct mac_learning_info& learn_info,
+                              bool insert_entry) {
+  const uint64_t key = FdbShadowKey(learn_info);
+  absl::Status status;
+
+  if (!insert_entry) {
+    // The shadow knows whether a known MAC was learned on a tunnel.
+    ShadowEntry installed;
+    const struct mac_learning_info& info =
+        (shadow->Find(key, &installed) && installed.learn_info.is_tunnel)
+            ? installed.learn_info
+            : learn_info;
+    status = ConfigFdbTableEntry(session, info, p4info, false, tunnel_macs);
+    shadow->Erase(key);
+    return status;
+  }
+
+  ShadowEntry installed;
+  if (shadow->Find(key, &installed)) {
+    const struct mac_learning_info& old_info = installed.learn_info;
+    if (FdbEntriesMatch(old_info, learn_info)) return absl::OkStatus();
+
+    if (IsFdbModifiable(old_info, learn_info)) {
+      status = ModifyFdbTableEntries(session, learn_info, p4info);
+      if (!status.ok()) {
+        printf("MODIFY: Failed to move FDB entry\n");
+        shadow->Erase(key);
+        return status;
+      }
+      ShadowEntry entry = {};
+      entry.kind = ShadowKind::kFdb;
+      entry.learn_info = learn_info;
+      shadow->Insert(key, entry);
+      return status;
+    }
+
+    // The entry moves between table sets (e.g. VSI to tunnel), which
+    // cannot be expressed as a modification.
+    ConfigFdbTableEntry(session, old_info, p4info, false, tunnel_macs)
+        .IgnoreError();
+    shadow->Erase(key);
+  }
+
+  status = ConfigFdbTableEntry(session, learn_info, p4info, true, tunnel_macs);
+  if (status.ok() && IsFdbProgrammed(learn_info)) {
+    ShadowEntry entry = {};
+    entry.kind = ShadowKind::kFdb;
+    entry.learn_info = learn_info;
+    shadow->Insert(key, entry);
+  }
+  return status;
+}
+
+absl::Status HandleTunnelRequest(OvsP4rtSession* session,
+                                 const ::p4::config::v1::P4Info& p4info,
+                                 const struct tunnel_info& tunnel_info,
                                  bool insert_entry) {
-  using namespace ovs_p4rt;
+  absl::Status status =
+      ConfigEncapTableEntry(session, tunnel_info, p4info, insert_entry);
+  if (!status.ok()) return status;
 
-  // Start a new client session.
-  auto status_or_session = OvsP4rtSession::Create(
-      absl::GetFlag(FLAGS_grpc_addr), GenerateClientCredentials(),
-      absl::GetFlag(FLAGS_device_id));
-  if (!status_or_session.ok()) return;
+#if defined(ES2K_TARGET)
+  status = ConfigDecapTableEntry(session, tunnel_info, p4info, insert_entry);
+  if (!status.ok()) return status;
+#endif
 
-  // Unwrap the session from the StatusOr object.
-  std::unique_ptr<OvsP4rtSession> session =
-      std::move(status_or_session).value();
-  ::p4::config::v1::P4Info p4info;
-  ::absl::Status status = GetForwardingPipelineConfig(session.get(), &p4info);
-  if (!status.ok()) return;
+  return ConfigTunnelTermTableEntry(session, tunnel_info, p4info,
+                                    insert_entry);
+}
 
-  status = ConfigRxTunnelSrcPortTableEntry(session.get(), tunnel_info, p4info,
-                                           insert_entry);
-  if (!status.ok()) return;
+// Records the entry programmed by a successful request in the shadow, so
+// that a later reconciliation knows it is installed. FDB entries are
+// tracked by HandleFdbRequest.
+void RecordShadowEntry(ShadowTable* shadow, const OvsP4rtRequest& request) {
+  ShadowEntry entry = {};
+  uint64_t key;
+
+  switch (request.type) {
+    case RequestType::kTunnel:
+      entry.kind = ShadowKind::kTunnel;
+      entry.tunnel_info = request.tunnel_info;
+      key = TunnelShadowKey(request.tunnel_info);
+      break;
+    case RequestType::kRxTunnelSrc:
+      entry.kind = ShadowKind::kRxTunnelSrc;
+      entry.tunnel_info = request.tunnel_info;
+      key = RxTunnelSrcShadowKey(request.tunnel_info);
+      break;
+    case RequestType::kVlan:
+      entry.kind = ShadowKind::kVlan;
+      entry.vlan_id = request.vlan_id;
+      key = VlanShadowKey(request.vlan_id);
+      break;
+    case RequestType::kSrcPort:
+    case RequestType::kTunnelSrcPort:
+      entry.kind = (request.type == RequestType::kSrcPort)
+                       ? ShadowKind::kSrcPort
+                       : ShadowKind::kTunnelSrcPort;
+      entry.sp_info = request.sp_info;
+      key = SrcPortShadowKey(entry.kind, request.sp_info);
+      break;
+    default:
+      return;
+  }
 
-  return;
+  if (request.insert_entry) {
+    shadow->Insert(key, entry);
+  } else {
+    shadow->Erase(key);
+  }
 }
 
-void ConfigTunnelSrcPortTableEntry(struct src_port_info tnl_sp,
-                                   bool insert_entry) {
-  using namespace ovs_p4rt;
+//----------------------------------------------------------------------
+// Desired-state reconciliation (run on the device worker thread)
+//----------------------------------------------------------------------
 
-  p4::v1::WriteRequest write_request;
-  ::p4::v1::TableEntry* table_entry;
+using HostPortCache = absl::flat_hash_map<uint32_t, uint32_t>;
 
-  // Start a new client session.
-  auto status_or_session = OvsP4rtSession::Create(
-      absl::GetFlag(FLAGS_grpc_addr), GenerateClientCredentials(),
-      absl::GetFlag(FLAGS_device_id));
-  if (!status_or_session.ok()) return;
+// Returns true if both requests program identical tunnel entries.
+bool TunnelEntriesMatch(const struct tunnel_info& a,
+                        const struct tunnel_info& b) {
+#if defined(ES2K_TARGET)
+  if (a.vlan_info.port_vlan_mode != b.vlan_info.port_vlan_mode ||
+      a.vlan_info.port_vlan != b.vlan_info.port_vlan) {
+    return false;
+  }
+#endif
+  return a.dst_port == b.dst_port && SameIpAddr(a.local_ip, b.local_ip) &&
+         SameIpAddr(a.remote_ip, b.remote_ip);
+}
 
-  // Unwrap the session from the StatusOr object.
-  std::unique_ptr<OvsP4rtSession> session =
-      std::move(status_or_session).value();
-  ::p4::config::v1::P4Info p4info;
-  ::absl::Status status = GetForwardingPipelineConfig(session.get(), &p4info);
-  if (!status.ok()) return;
+// Returns true if both entries program identical table entries. VLAN and
+// source port entries are fully described by their shadow key.
+bool ShadowEntriesMatch(const ShadowEntry& a, const ShadowEntry& b) {
+  switch (a.kind) {
+    case ShadowKind::kFdb:
+      return FdbEntriesMatch(a.learn_info, b.learn_info);
+    case ShadowKind::kTunnel:
+    case ShadowKind::kRxTunnelSrc:
+      return TunnelEntriesMatch(a.tunnel_info, b.tunnel_info);
+    default:
+      return true;
+  }
+}
 
-  if (insert_entry) {
-    table_entry =
-        ovs_p4rt::SetupTableEntryToInsert(session.get(), &write_request);
+#if defined(ES2K_TARGET)
+// Returns the host port of a VSI, reading each VSI from the device only
+// once per reconciliation.
+absl::StatusOr<uint32_t> ResolveHostPort(OvsP4rtSession* session,
+                                         const ::p4::config::v1::P4Info& p4info,
+                                         uint32_t sp,
+                                         HostPortCache* host_ports) {
+  auto it = host_ports->find(sp);
+  if (it != host_ports->end()) return it->second;
+
+  auto status_or_host_sp = GetVsiHostPort(session, sp, p4info);
+  if (!status_or_host_sp.ok()) return status_or_host_sp.status();
+
+  (*host_ports)[sp] = status_or_host_sp.value();
+  return status_or_host_sp.value();
+}
+#endif
+
+// Adds the updates that program an FDB entry to the batch. For VSI entries
+// on ES2K, learn_info.src_port must hold the host port.
+void AddFdbUpdates(WriteBatch* batch, uint64_t tag,
+                   ::p4::v1::Update::Type type,
+                   const struct mac_learning_info& learn_info,
+                   const ::p4::config::v1::P4Info& p4info) {
+  const bool insert_entry = (type != ::p4::v1::Update::DELETE);
+
+  if (learn_info.is_tunnel) {
+    PrepareFdbTableEntryforV4Tunnel(batch->Add(type, tag), learn_info, p4info,
+                                    insert_entry);
+#if defined(ES2K_TARGET)
+    ::p4::v1::TableEntry* table_entry = batch->Add(type, tag);
+    if (learn_info.tnl_info.local_ip.family == AF_INET6 &&
+        learn_info.tnl_info.remote_ip.family == AF_INET6) {
+      PrepareL2ToTunnelV6(table_entry, learn_info, p4info, insert_entry);
+    } else {
+      PrepareL2ToTunnelV4(table_entry, learn_info, p4info, insert_entry);
+    }
+#endif
   } else {
-    table_entry =
-        ovs_p4rt::SetupTableEntryToDelete(session.get(), &write_request);
+#if defined(DPDK_TARGET)
+    if (!learn_info.is_vlan) return;
+#endif
+    PrepareFdbTxVlanTableEntry(batch->Add(type, tag), learn_info, p4info,
+                               insert_entry);
+    PrepareFdbRxVlanTableEntry(batch->Add(type, tag), learn_info, p4info,
+                               insert_entry);
   }
 
-  PrepareSrcPortTableEntry(table_entry, tnl_sp, p4info, insert_entry);
+#if defined(ES2K_TARGET)
+  // The source MAC entry does not change when the MAC moves.
+  if (type != ::p4::v1::Update::MODIFY) {
+    PrepareFdbSmacTableEntry(batch->Add(type, tag), learn_info, p4info,
+                             insert_entry);
+  }
+#endif
+}
+
+// Adds the updates that program a tunnel to the batch.
+void AddTunnelUpdates(WriteBatch* batch, uint64_t tag,
+                      ::p4::v1::Update::Type type,
+                      const struct tunnel_info& tunnel_info,
+                      const ::p4::config::v1::P4Info& p4info) {
+  const bool insert_entry = (type != ::p4::v1::Update::DELETE);
+
+#if defined(DPDK_TARGET)
+  PrepareEncapTableEntry(batch->Add(type, tag), tunnel_info, p4info,
+                         insert_entry);
+  PrepareTunnelTermTableEntry(batch->Add(type, tag), tunnel_info, p4info,
+                              insert_entry);
+#else
+  const bool ipv4 = tunnel_info.local_ip.family == AF_INET &&
+                    tunnel_info.remote_ip.family == AF_INET;
+  const bool ipv6 = tunnel_info.local_ip.family == AF_INET6 &&
+                    tunnel_info.remote_ip.family == AF_INET6;
+  if (!ipv4 && !ipv6) return;
+
+  const uint8_t vlan_mode = tunnel_info.vlan_info.port_vlan_mode;
+
+  ::p4::v1::TableEntry* table_entry = batch->Add(type, tag);
+  if (vlan_mode == P4_PORT_VLAN_NATIVE_UNTAGGED) {
+    if (ipv4) {
+      PrepareEncapAndVlanPopTableEntry(table_entry, tunnel_info, p4info,
+                                       insert_entry);
+    } else {
+      PrepareV6EncapAndVlanPopTableEntry(table_entry, tunnel_info, p4info,
+                                         insert_entry);
+    }
+  } else if (ipv4) {
+    PrepareEncapTableEntry(table_entry, tunnel_info, p4info, insert_entry);
+  } else {
+    PrepareV6EncapTableEntry(table_entry, tunnel_info, p4info, insert_entry);
+  }
 
-  status = ovs_p4rt::SendWriteRequest(session.get(), write_request);
+  table_entry = batch->Add(type, tag);
+  if (vlan_mode == P4_PORT_VLAN_NATIVE_TAGGED) {
+    PrepareDecapModTableEntry(table_entry, tunnel_info, p4info, insert_entry);
+  } else {
+    PrepareDecapModAndVlanPushTableEntry(table_entry, tunnel_info, p4info,
+                                         insert_entry);
+  }
 
-  if (!status.ok()) return;
+  table_entry = batch->Add(type, tag);
+  if (ipv4) {
+    PrepareTunnelTermTableEntry(table_entry, tunnel_info, p4info,
+                                insert_entry);
+  } else {
+    PrepareV6TunnelTermTableEntry(table_entry, tunnel_info, p4info,
+                                  insert_entry);
+  }
+#endif
 }
 
-void ConfigSrcPortTableEntry(struct src_port_info vsi_sp, bool insert_entry) {
-  using namespace ovs_p4rt;
+#if defined(ES2K_TARGET)
+// Adds the update that maps a tunnel to its source port on receive.
+void AddRxTunnelSrcUpdate(WriteBatch* batch, uint64_t tag,
+                          ::p4::v1::Update::Type type,
+                          const struct tunnel_info& tunnel_info,
+                          const ::p4::config::v1::P4Info& p4info) {
+  const bool insert_entry = (type != ::p4::v1::Update::DELETE);
 
-  p4::v1::WriteRequest write_request;
-  ::p4::v1::TableEntry* table_entry;
+  if (tunnel_info.local_ip.family == AF_INET &&
+      tunnel_info.remote_ip.family == AF_INET) {
+    PrepareRxTunnelTableEntry(batch->Add(type, tag), tunnel_info, p4info,
+                              insert_entry);
+  } else if (tunnel_info.local_ip.family == AF_INET6 &&
+             tunnel_info.remote_ip.family == AF_INET6) {
+    PrepareV6RxTunnelTableEntry(batch->Add(type, tag), tunnel_info, p4info,
+                                insert_entry);
+  }
+}
+#endif
 
-  // Start a new client session.
-  auto status_or_session = OvsP4rtSession::Create(
-      absl::GetFlag(FLAGS_grpc_addr), GenerateClientCredentials(),
-      absl::GetFlag(FLAGS_device_id));
-  if (!status_or_session.ok()) return;
+// Adds the updates for a shadow entry to the batch, tagged with its key.
+absl::Status AddEntryUpdates(OvsP4rtSession* session,
+                             const ::p4::config::v1::P4Info& p4info,
+                             HostPortCache* host_ports, WriteBatch* batch,
+                             uint64_t key, ::p4::v1::Update::Type type,
+                             const ShadowEntry& entry) {
+#if defined(ES2K_TARGET)
+  const bool insert_entry = (type != ::p4::v1::Update::DELETE);
+#endif
 
-  // Unwrap the session from the StatusOr object.
-  std::unique_ptr<OvsP4rtSession> session =
-      std::move(status_or_session).value();
-  ::p4::config::v1::P4Info p4info;
-  ::absl::Status status = GetForwardingPipelineConfig(session.get(), &p4info);
-  if (!status.ok()) return;
+  switch (entry.kind) {
+    case ShadowKind::kFdb: {
+      struct mac_learning_info learn_info = entry.learn_info;
+#if defined(ES2K_TARGET)
+      if (!learn_info.is_tunnel && insert_entry) {
+        auto status_or_host_sp =
+            ResolveHostPort(session, p4info, learn_info.src_port, host_ports);
+        if (!status_or_host_sp.ok()) return status_or_host_sp.status();
+        learn_info.src_port = status_or_host_sp.value();
+      }
+#endif
+      AddFdbUpdates(batch, key, type, learn_info, p4info);
+      break;
+    }
+    case ShadowKind::kTunnel:
+      AddTunnelUpdates(batch, key, type, entry.tunnel_info, p4info);
+      break;
+#if defined(ES2K_TARGET)
+    case ShadowKind::kVlan:
+      PrepareVlanPushTableEntry(batch->Add(type, key), entry.vlan_id, p4info,
+                                insert_entry);
+      PrepareVlanPopTableEntry(batch->Add(type, key), entry.vlan_id, p4info,
+                               insert_entry);
+      break;
+    case ShadowKind::kSrcPort: {
+      struct src_port_info sp_info = entry.sp_info;
+      auto status_or_host_sp =
+          ResolveHostPort(session, p4info, sp_info.src_port, host_ports);
+      if (!status_or_host_sp.ok()) return status_or_host_sp.status();
+      sp_info.src_port = status_or_host_sp.value();
+      PrepareSrcPortTableEntry(batch->Add(type, key), sp_info, p4info,
+                               insert_entry);
+      break;
+    }
+    case ShadowKind::kTunnelSrcPort:
+      PrepareSrcPortTableEntry(batch->Add(type, key), entry.sp_info, p4info,
+                               insert_entry);
+      break;
+    case ShadowKind::kRxTunnelSrc:
+      AddRxTunnelSrcUpdate(batch, key, type, entry.tunnel_info, p4info);
+      break;
+#endif
+    default:
+      /* Unimplemented for this target */
+      break;
+  }
+  return absl::OkStatus();
+}
 
-  auto status_or_read_response =
-      GetTxAccVsiTableEntry(session.get(), vsi_sp.src_port, p4info);
-  if (!status_or_read_response.ok()) return;
+// Reconciliation is applied in phases. Entries are removed before the
+// entries they depend on and added after them. Each phase is flushed before
+// the next one starts, since the updates in a WriteRequest may be applied
+// in any order.
+enum ReconcilePhase {
+  kDeleteFdbPhase,
+  kDeleteOtherPhase,
+  kAddOtherPhase,
+  kAddFdbPhase,
+  kNumReconcilePhases,
+};
+
+struct PendingUpdate {
+  uint64_t key;
+  ::p4::v1::Update::Type type;
+};
+
+struct ReconcileStats {
+  int inserted = 0;
+  int modified = 0;
+  int deleted = 0;
+  int failed = 0;
+  int requests = 0;
+};
+
+// Writes one reconciliation phase and brings the shadow in line with the
+// updates that were applied. Entries are deleted as recorded in the shadow
+// or, if they are not in it, as given in desired. The keys of the updates
+// that failed are added to *failed, and their shadow entries are left as
+// they were: a failed update leaves the device entry unchanged.
+//
+// The shadow may not know every entry on the device, after a restart of
+// ovs-vswitchd without a snapshot for example. An INSERT of an entry that
+// is already installed fails with ALREADY_EXISTS, and is retried as a
+// MODIFY. A DELETE of an entry that is already gone fails with NOT_FOUND,
+// which leaves the entry deleted as desired.
+absl::Status ApplyReconcilePhase(OvsP4rtSession* session,
+                                 const ::p4::config::v1::P4Info& p4info,
+                                 ShadowTable* shadow,
+                                 TunnelMacFilter* tunnel_macs,
+                                 const DesiredEntries& desired,
+                                 const std::vector<PendingUpdate>& updates,
+                                 HostPortCache* host_ports,
+                                 ReconcileStats* stats,
+                                 absl::flat_hash_set<uint64_t>* failed) {
+  if (updates.empty()) return absl::OkStatus();
+
+  WriteBatch batch(session, absl::GetFlag(FLAGS_write_batch_size));
+  // Tunnel-learned MACs being deleted, by shadow key.
+  absl::flat_hash_map<uint64_t, uint64_t> tunnel_deletes;
+
+  for (const auto& update : updates) {
+    ShadowEntry entry;
+    if (update.type == ::p4::v1::Update::DELETE) {
+      if (!shadow->Find(update.key, &entry)) {
+        auto it = desired.find(update.key);
+        if (it == desired.end()) continue;
+        entry = it->second;
+      }
+    } else {
+      entry = desired.at(update.key);
+    }
 
-  ::p4::v1::ReadResponse read_response =
-      std::move(status_or_read_response).value();
-  std::vector<::p4::v1::TableEntry> table_entries;
+    if (entry.kind == ShadowKind::kFdb && entry.learn_info.is_tunnel) {
+      const uint64_t mac = MacToInt(entry.learn_info.mac_addr);
+      if (update.type == ::p4::v1::Update::DELETE) {
+        tunnel_deletes[update.key] = mac;
+      } else {
+        tunnel_macs->Add(mac);
+      }
+    }
 
-  table_entries.reserve(read_response.entities().size());
+    absl::Status status = AddEntryUpdates(session, p4info, host_ports, &batch,
+                                          update.key, update.type, entry);
+    if (!status.ok()) failed->insert(update.key);
+  }
 
-  int param_id =
-      GetParamId(p4info, TX_ACC_VSI_TABLE_ACTION_L2_FWD_AND_BYPASS_BRIDGE,
-                 ACTION_L2_FWD_AND_BYPASS_BRIDGE_PARAM_PORT);
+  absl::Status status = batch.Flush();
+  stats->requests += batch.NumRequests();
+
+  absl::flat_hash_set<uint64_t> existing;
+  for (const auto& error : batch.Errors()) {
+    if (error.type == ::p4::v1::Update::INSERT &&
+        error.code == absl::StatusCode::kAlreadyExists) {
+      existing.insert(error.tag);
+    } else if (error.type != ::p4::v1::Update::DELETE ||
+               error.code != absl::StatusCode::kNotFound) {
+      failed->insert(error.tag);
+    }
+  }
 
-  uint32_t host_sp = 0;
-  for (const auto& entity : read_response.entities()) {
-    p4::v1::TableEntry table_entry_1 = entity.table_entry();
-    auto* table_action = table_entry_1.mutable_action();
-    auto* action = table_action->mutable_action();
-    for (const auto& param : action->params()) {
-      if (param_id == param.param_id()) {
-        const std::string& s1 = param.value();
-        std::string s2 = s1;
-        for (int param_bytes = 0; param_bytes < 4; param_bytes++) {
-          host_sp = host_sp << 8 | int(s2[param_bytes]);
+  if (!existing.empty()) {
+    WriteBatch retry(session, absl::GetFlag(FLAGS_write_batch_size));
+    for (uint64_t key : existing) {
+      if (failed->contains(key)) continue;
+      absl::Status entry_status =
+          AddEntryUpdates(session, p4info, host_ports, &retry, key,
+                          ::p4::v1::Update::MODIFY, desired.at(key));
+      if (!entry_status.ok()) failed->insert(key);
+    }
+    absl::Status retry_status = retry.Flush();
+    stats->requests += retry.NumRequests();
+    failed->insert(retry.FailedTags().begin(), retry.FailedTags().end());
+    if (!retry_status.ok()) status = retry_status;
+  }
+
+  bool all_applied = true;
+  for (const auto& update : updates) {
+    if (failed->contains(update.key)) {
+      stats->failed++;
+      all_applied = false;
+      continue;
+    }
+
+    switch (update.type) {
+      case ::p4::v1::Update::DELETE: {
+        auto it = tunnel_deletes.find(update.key);
+        if (it != tunnel_deletes.end()) tunnel_macs->Remove(it->second);
+        shadow->Erase(update.key);
+        stats->deleted++;
+        break;
+      }
+      case ::p4::v1::Update::MODIFY:
+        shadow->Insert(update.key, desired.at(update.key));
+        stats->modified++;
+        break;
+      default:
+        shadow->Insert(update.key, desired.at(update.key));
+        if (existing.contains(update.key)) {
+          stats->modified++;
+        } else {
+          stats->inserted++;
         }
         break;
+    }
+  }
+  // The errors that were resolved above do not fail the phase.
+  return all_applied ? absl::OkStatus() : status;
+}
+
+// Plans the updates that install a desired entry: none if the shadow shows
+// it installed as desired, a modification if a known FDB entry moved, and
+// an insert (preceded by a delete of the old entry if needed) otherwise.
+// An FDB entry that is not written to the device only removes the entry
+// it replaces.
+void PlanDesiredEntry(ShadowTable* shadow, uint64_t key,
+                      const ShadowEntry& entry,
+                      std::vector<PendingUpdate>* phases) {
+  const bool is_fdb = (entry.kind == ShadowKind::kFdb);
+  std::vector<PendingUpdate>& add_phase =
+      phases[is_fdb ? kAddFdbPhase : kAddOtherPhase];
+  ShadowEntry installed;
+
+  if (is_fdb && !IsFdbProgrammed(entry.learn_info)) {
+    if (shadow->Contains(key)) {
+      phases[kDeleteFdbPhase].push_back({key, ::p4::v1::Update::DELETE});
+    }
+  } else if (!shadow->Find(key, &installed)) {
+    add_phase.push_back({key, ::p4::v1::Update::INSERT});
+  } else if (ShadowEntriesMatch(installed, entry)) {
+    return;
+  } else if (is_fdb &&
+             IsFdbModifiable(installed.learn_info, entry.learn_info)) {
+    add_phase.push_back({key, ::p4::v1::Update::MODIFY});
+  } else {
+    phases[is_fdb ? kDeleteFdbPhase : kDeleteOtherPhase].push_back(
+        {key, ::p4::v1::Update::DELETE});
+    add_phase.push_back({key, ::p4::v1::Update::INSERT});
+  }
+}
+
+ShadowPartition::ShadowPartition(OvsP4rtDevice* device)
+    : device_(device),
+      remaining_(device->Shards().size()),
+      keys_(device->Shards().size()) {}
+
+const std::vector<uint64_t>& ShadowPartition::KeysOf(OvsP4rtShard* shard) {
+  absl::MutexLock lock(&mu_);
+  ArriveLocked();
+  auto ready = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return remaining_ == 0;
+  };
+  mu_.Await(absl::Condition(&ready));
+  return keys_[shard->index()];
+}
+
+void ShadowPartition::Skip() {
+  absl::MutexLock lock(&mu_);
+  ArriveLocked();
+}
+
+void ShadowPartition::ArriveLocked() {
+  if (--remaining_ > 0) return;
+  device_->Shadow()->ForEach([this](uint64_t key, const ShadowEntry&) {
+    keys_[device_->ShardForKey(key)->index()].push_back(key);
+  });
+}
+
+// Brings the entries installed for the keys a shard owns in line with the
+// desired entries. The diff is computed against the shadow keys of the
+// shard, and only the entries that differ are written.
+absl::Status ReconcileShard(OvsP4rtShard* shard, OvsP4rtSession* session,
+                            const ::p4::config::v1::P4Info& p4info,
+                            const DesiredEntries& desired,
+                            const std::vector<uint64_t>& shadow_keys) {
+  OvsP4rtDevice* device = shard->device();
+  ShadowTable* shadow = device->Shadow();
+  std::vector<PendingUpdate> phases[kNumReconcilePhases];
+
+  for (uint64_t key : shadow_keys) {
+    if (!desired.contains(key)) {
+      ReconcilePhase phase = (ShadowKeyKind(key) == ShadowKind::kFdb)
+                                 ? kDeleteFdbPhase
+                                 : kDeleteOtherPhase;
+      phases[phase].push_back({key, ::p4::v1::Update::DELETE});
+    }
+  }
+
+  for (const auto& kv : desired) {
+    PlanDesiredEntry(shadow, kv.first, kv.second, phases);
+  }
+
+  HostPortCache host_ports;
+  ReconcileStats stats;
+  absl::flat_hash_set<uint64_t> failed;
+  absl::Status status;
+
+  for (const auto& updates : phases) {
+    absl::Status phase_status = ApplyReconcilePhase(
+        session, p4info, shadow, device->TunnelMacs(), desired, updates,
+        &host_ports, &stats, &failed);
+    if (status.ok()) status = phase_status;
+    if (absl::IsUnavailable(phase_status)) break;
+  }
+
+  printf(
+      "Reconciled device %u shard %d: %d inserted, %d modified, %d deleted, "
+      "%d failed, %d write requests\n",
+      device->DeviceId(), shard->index(), stats.inserted, stats.modified,
+      stats.deleted, stats.failed, stats.requests);
+  return status;
+}
+
+// Number of times a shard tries to reinstall the entries it lost.
+constexpr int kMaxResyncAttempts = 3;
+
+// Reinstalls entries a shard owns that are missing on the device, after
+// the server restarted or the pipeline changed for example. Keys that are
+// no longer in the shadow are skipped. The others stay in the shadow while
+// they are written, so that they are not lost if the write fails: the
+// keys that failed or were not written are requeued, up to
+// kMaxResyncAttempts times in all. If the server became unavailable, they
+// are left to the next connection, which reads the tables back.
+absl::Status ResyncShard(OvsP4rtShard* shard, OvsP4rtSession* session,
+                         const ::p4::config::v1::P4Info& p4info,
+                         const std::vector<uint64_t>& keys, int attempt) {
+  OvsP4rtDevice* device = shard->device();
+  ShadowTable* shadow = device->Shadow();
+  DesiredEntries desired;
+  std::vector<PendingUpdate> phases[kNumReconcilePhases];
+
+  for (uint64_t key : keys) {
+    ShadowEntry entry;
+    if (!shadow->Find(key, &entry)) continue;
+    desired[key] = entry;
+    // An entry the device still holds fails with ALREADY_EXISTS, and is
+    // written again as a MODIFY.
+    ReconcilePhase phase = (entry.kind == ShadowKind::kFdb)
+                               ? kAddFdbPhase
+                               : kAddOtherPhase;
+    phases[phase].push_back({key, ::p4::v1::Update::INSERT});
+  }
+
+  HostPortCache host_ports;
+  ReconcileStats stats;
+  absl::flat_hash_set<uint64_t> failed;
+  absl::Status status;
+  int phase = 0;
+
+  for (; phase < kNumReconcilePhases; phase++) {
+    absl::Status phase_status = ApplyReconcilePhase(
+        session, p4info, shadow, device->TunnelMacs(), desired,
+        phases[phase], &host_ports, &stats, &failed);
+    if (status.ok()) status = phase_status;
+    if (absl::IsUnavailable(phase_status)) break;
+  }
+
+  printf(
+      "Reinstalled entries of device %u shard %d: %d inserted, %d modified, "
+      "%d failed, %d write requests\n",
+      device->DeviceId(), shard->index(), stats.inserted, stats.modified,
+      stats.failed, stats.requests);
+  if (absl::IsUnavailable(status)) return status;
+
+  auto retry = absl::make_unique<std::vector<uint64_t>>(failed.begin(),
+                                                        failed.end());
+  for (phase++; phase < kNumReconcilePhases; phase++) {
+    for (const auto& update : phases[phase]) {
+      retry->push_back(update.key);
+    }
+  }
+  if (retry->empty()) return status;
+  if (attempt + 1 >= kMaxResyncAttempts) {
+    printf("Giving up reinstalling %zu entries of device %u shard %d\n",
+           retry->size(), device->DeviceId(), shard->index());
+    return status;
+  }
+
+  OvsP4rtRequest request = {};
+  request.type = RequestType::kResync;
+  request.resync.keys = retry.release();
+  request.resync.attempt = attempt + 1;
+  shard->Submit(request);
+  return status;
+}
+
+// Returns the match of a table entry in a canonical form, which identifies
+// the entry in its table. Values are compared without their leading zero
+// bytes, since the server may return them in canonical form.
+std::string MatchKey(const ::p4::v1::TableEntry& entry) {
+  auto value = [](const std::string& bytes) {
+    size_t first = 0;
+    while (first + 1 < bytes.size() && bytes[first] == '\0') first++;
+    return absl::StrCat(bytes.size() - first, ":", bytes.substr(first));
+  };
+
+  std::vector<std::string> fields;
+  for (const auto& match : entry.match()) {
+    std::string field = absl::StrCat(match.field_id(), "=");
+    switch (match.field_match_type_case()) {
+      case ::p4::v1::FieldMatch::kExact:
+        absl::StrAppend(&field, value(match.exact().value()));
+        break;
+      case ::p4::v1::FieldMatch::kTernary:
+        absl::StrAppend(&field, value(match.ternary().value()), "&",
+                        value(match.ternary().mask()));
+        break;
+      case ::p4::v1::FieldMatch::kLpm:
+        absl::StrAppend(&field, value(match.lpm().value()), "/",
+                        match.lpm().prefix_len());
+        break;
+      case ::p4::v1::FieldMatch::kRange:
+        absl::StrAppend(&field, value(match.range().low()), "-",
+                        value(match.range().high()));
+        break;
+      case ::p4::v1::FieldMatch::kOptional:
+        absl::StrAppend(&field, value(match.optional().value()));
+        break;
+      default:
+        break;
+    }
+    fields.push_back(std::move(field));
+  }
+  std::sort(fields.begin(), fields.end());
+  return absl::StrCat(entry.table_id(), "/", entry.priority(), "/",
+                      absl::StrJoin(fields, ","));
+}
+
+absl::Status FindMissingEntries(const DeviceConnection& connection,
+                                ShadowTable* shadow,
+                                std::vector<uint64_t>* missing) {
+  OvsP4rtSession* session = connection.session.get();
+  const ::p4::config::v1::P4Info& p4info = connection.p4info;
+
+  // Building an entry may read the device, so the shadow is copied first.
+  std::vector<std::pair<uint64_t, ShadowEntry>> entries;
+  shadow->ForEach([&entries](uint64_t key, const ShadowEntry& entry) {
+    entries.emplace_back(key, entry);
+  });
+
+  // The table entries of each shadow entry, tagged with its key. The batch
+  // is never flushed.
+  WriteBatch expected(session, std::numeric_limits<int>::max());
+  HostPortCache host_ports;
+  absl::flat_hash_set<uint64_t> found;
+  for (const auto& kv : entries) {
+    absl::Status status =
+        AddEntryUpdates(session, p4info, &host_ports, &expected, kv.first,
+                        ::p4::v1::Update::INSERT, kv.second);
+    if (!status.ok() && found.insert(kv.first).second) {
+      missing->push_back(kv.first);
+    }
+  }
+
+  const auto& updates = expected.PendingRequest().updates();
+  absl::flat_hash_set<uint32_t> table_ids;
+  for (const auto& update : updates) {
+    table_ids.insert(update.entity().table_entry().table_id());
+  }
+
+  absl::flat_hash_set<std::string> installed;
+  for (uint32_t table_id : table_ids) {
+    ::p4::v1::ReadRequest read_request;
+    SetupTableEntryToRead(session, &read_request)->set_table_id(table_id);
+    auto status_or_read_response = SendReadRequest(session, read_request);
+    if (!status_or_read_response.ok()) {
+      return status_or_read_response.status();
+    }
+    for (const auto& entity : status_or_read_response.value().entities()) {
+      installed.insert(MatchKey(entity.table_entry()));
+    }
+  }
+
+  // An entry is missing if any of its table entries is.
+  const std::vector<uint64_t>& keys = expected.PendingTags();
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (!installed.contains(MatchKey(updates[i].entity().table_entry())) &&
+        found.insert(keys[i]).second) {
+      missing->push_back(keys[i]);
+    }
+  }
+  return absl::OkStatus();
+}
+
+//----------------------------------------------------------------------
+// Bulk request handlers (run on the device worker thread)
+//----------------------------------------------------------------------
+
+// Programs a set of tunnels with batched writes and records the result
+// for each of them.
+absl::Status HandleTunnelBatch(OvsP4rtSession* session,
+                               const ::p4::config::v1::P4Info& p4info,
+                               ShadowTable* shadow,
+                               const struct tunnel_info* tunnels,
+                               size_t n_tunnels, bool insert_entry,
+                               int* results) {
+  const ::p4::v1::Update::Type type =
+      insert_entry ? ::p4::v1::Update::INSERT : ::p4::v1::Update::DELETE;
+  WriteBatch batch(session, absl::GetFlag(FLAGS_write_batch_size));
+
+  // Tag 0 is reserved, so tunnel i is tagged i + 1.
+  for (size_t i = 0; i < n_tunnels; i++) {
+    AddTunnelUpdates(&batch, i + 1, type, tunnels[i], p4info);
+#if defined(ES2K_TARGET)
+    AddRxTunnelSrcUpdate(&batch, i + 1, type, tunnels[i], p4info);
+#endif
+  }
+
+  absl::Status status = batch.Flush();
+  absl::flat_hash_set<uint64_t> failed(batch.FailedTags().begin(),
+                                       batch.FailedTags().end());
+
+  for (size_t i = 0; i < n_tunnels; i++) {
+    if (failed.contains(i + 1)) {
+      results[i] = -1;
+      continue;
+    }
+    results[i] = 0;
+
+    const uint64_t key = TunnelShadowKey(tunnels[i]);
+    if (insert_entry) {
+      ShadowEntry entry = {};
+      entry.kind = ShadowKind::kTunnel;
+      entry.tunnel_info = tunnels[i];
+      shadow->Insert(key, entry);
+    } else {
+      shadow->Erase(key);
+    }
+#if defined(ES2K_TARGET)
+    const uint64_t rx_key = RxTunnelSrcShadowKey(tunnels[i]);
+    if (insert_entry) {
+      ShadowEntry entry = {};
+      entry.kind = ShadowKind::kRxTunnelSrc;
+      entry.tunnel_info = tunnels[i];
+      shadow->Insert(rx_key, entry);
+    } else {
+      shadow->Erase(rx_key);
+    }
+#endif
+  }
+  return status;
+}
+
+// Programs or removes a set of entries owned by one shard, as a partial
+// reconciliation: only the given keys are considered, and entries that
+// are already installed as requested are not written again. FDB entries
+// that are not in the shadow are deleted one at a time, since only the
+// device knows which tables they were written to.
+absl::Status HandleEntryBatch(OvsP4rtSession* session,
+                              const ::p4::config::v1::P4Info& p4info,
+                              ShadowTable* shadow,
+                              TunnelMacFilter* tunnel_macs,
+                              const ShadowEntry* entries,
+                              size_t n_entries, bool insert_entry,
+                              int* results) {
+  DesiredEntries requested;
+  std::vector<PendingUpdate> phases[kNumReconcilePhases];
+  absl::flat_hash_set<uint64_t> failed;
+  absl::Status status;
+
+  for (size_t i = 0; i < n_entries; i++) {
+    const uint64_t key = ShadowEntryKey(entries[i]);
+    if (!requested.emplace(key, entries[i]).second) continue;
+
+    if (insert_entry) {
+      PlanDesiredEntry(shadow, key, entries[i], phases);
+    } else if (entries[i].kind != ShadowKind::kFdb) {
+      phases[kDeleteOtherPhase].push_back({key, ::p4::v1::Update::DELETE});
+    } else if (shadow->Contains(key)) {
+      phases[kDeleteFdbPhase].push_back({key, ::p4::v1::Update::DELETE});
+    } else {
+      absl::Status entry_status = ConfigFdbTableEntry(
+          session, entries[i].learn_info, p4info, false, tunnel_macs);
+      if (!entry_status.ok()) {
+        failed.insert(key);
+        if (status.ok()) status = entry_status;
       }
     }
   }
 
-  vsi_sp.src_port = host_sp;
+  HostPortCache host_ports;
+  ReconcileStats stats;
+  for (const auto& updates : phases) {
+    absl::Status phase_status =
+        ApplyReconcilePhase(session, p4info, shadow, tunnel_macs, requested,
+                            updates, &host_ports, &stats, &failed);
+    if (status.ok()) status = phase_status;
+    if (absl::IsUnavailable(phase_status)) break;
+  }
 
-  status = ConfigureVsiSrcPortTableEntry(session.get(), vsi_sp, p4info,
-                                         insert_entry);
-  if (!status.ok()) return;
+  for (size_t i = 0; i < n_entries; i++) {
+    results[i] = failed.contains(ShadowEntryKey(entries[i])) ? -1 : 0;
+  }
+  return status;
+}
 
-  return;
+// Completes a bulk or resync request that could not be applied.
+void FailBulkRequest(const OvsP4rtRequest& request,
+                     const absl::Status& status) {
+  switch (request.type) {
+    case RequestType::kReconcile:
+      request.reconcile.partition->Skip();
+      *request.reconcile.status = status;
+      request.reconcile.done->Notify();
+      break;
+    case RequestType::kTunnelBatch:
+      for (size_t i = 0; i < request.tunnel_batch.n_tunnels; i++) {
+        request.tunnel_batch.results[i] = -1;
+      }
+      request.tunnel_batch.done->Notify();
+      break;
+    case RequestType::kEntryBatch:
+      for (size_t i = 0; i < request.entry_batch.n_entries; i++) {
+        request.entry_batch.results[i] = -1;
+      }
+      request.entry_batch.done->Notify();
+      break;
+    case RequestType::kResync:
+      // The entries stay in the shadow, so the next connection finds them
+      // missing when it reads the tables back.
+      delete request.resync.keys;
+      break;
+    default:
+      break;
+  }
 }
 
-void ConfigVlanTableEntry(uint16_t vlan_id, bool insert_entry) {
-  using namespace ovs_p4rt;
+// Applies a learn along with the learns queued right behind it, up to
+// --learn_batch_size of them, as one batch of entries: they are written
+// in a few WriteRequests rather than one per table for each learn. When a
+// MAC is learned more than once, its latest learn wins.
+absl::Status HandleLearnBatch(OvsP4rtShard* shard, OvsP4rtSession* session,
+                              const ::p4::config::v1::P4Info& p4info,
+                              const struct mac_learning_info& learn_info) {
+  OvsP4rtDevice* device = shard->device();
+  const int max_learns = absl::GetFlag(FLAGS_learn_batch_size);
+  std::vector<ShadowEntry> learns;
+  absl::flat_hash_map<uint64_t, size_t> index;
+
+  auto add_learn = [&learns, &index](const struct mac_learning_info& info) {
+    ShadowEntry entry = {};
+    entry.kind = ShadowKind::kFdb;
+    entry.learn_info = info;
+    auto result = index.emplace(FdbShadowKey(info), learns.size());
+    if (result.second) {
+      learns.push_back(entry);
+    } else {
+      learns[result.first->second] = entry;
+    }
+  };
+
+  add_learn(learn_info);
+  OvsP4rtRequest next;
+  for (int n_learns = 1;
+       n_learns < max_learns &&
+       shard->PopNextIf(
+           [](const OvsP4rtRequest& r) {
+             return r.type == RequestType::kFdb && r.insert_entry;
+           },
+           &next);
+       n_learns++) {
+    add_learn(next.learn_info);
+  }
 
-  p4::v1::WriteRequest write_request;
-  ::p4::v1::TableEntry* table_entry;
+  if (learns.size() == 1) {
+    return HandleFdbRequest(session, p4info, device->Shadow(),
+                            device->TunnelMacs(), learns[0].learn_info, true);
+  }
+  std::vector<int> results(learns.size());
+  return HandleEntryBatch(session, p4info, device->Shadow(),
+                          device->TunnelMacs(), learns.data(), learns.size(),
+                          true, results.data());
+}
+
+void ProcessRequest(OvsP4rtShard* shard, const OvsP4rtRequest& request) {
+  OvsP4rtDevice* device = shard->device();
+  auto status_or_connection = device->Connect();
+  if (!status_or_connection.ok()) {
+    printf("Unable to connect to P4Runtime device %u: %s\n",
+           device->DeviceId(),
+           std::string(status_or_connection.status().message()).c_str());
+    FailBulkRequest(request, status_or_connection.status());
+    return;
+  }
+
+  // Holds on to the connection even if another shard drops it meanwhile.
+  std::shared_ptr<const DeviceConnection> connection =
+      std::move(status_or_connection).value();
+  OvsP4rtSession* session = connection->session.get();
+  const ::p4::config::v1::P4Info& p4info = connection->p4info;
+  const bool insert_entry = request.insert_entry;
+  absl::Status status;
+
+  switch (request.type) {
+    case RequestType::kFdb: {
+      // OVS reports a station move as a delete immediately followed by an
+      // insert of the same MAC. If the insert is already queued and the
+      // entry is known, apply both as a single modification.
+      const uint64_t key = FdbShadowKey(request.learn_info);
+      OvsP4rtRequest next;
+      if (!insert_entry && device->Shadow()->Contains(key) &&
+          shard->PopNextIf(
+              [key](const OvsP4rtRequest& r) {
+                return r.type == RequestType::kFdb && r.insert_entry &&
+                       FdbShadowKey(r.learn_info) == key;
+              },
+              &next)) {
+        status = HandleFdbRequest(session, p4info, device->Shadow(),
+                                  device->TunnelMacs(), next.learn_info, true);
+      } else if (insert_entry) {
+        status = HandleLearnBatch(shard, session, p4info, request.learn_info);
+      } else {
+        status = HandleFdbRequest(session, p4info, device->Shadow(),
+                                  device->TunnelMacs(), request.learn_info,
+                                  insert_entry);
+      }
+      break;
+    }
+    case RequestType::kTunnel:
+      status = HandleTunnelRequest(session, p4info, request.tunnel_info,
+                                   insert_entry);
+      break;
+#if defined(ES2K_TARGET)
+    case RequestType::kIpTunnelTerm:
+      status = ConfigTunnelTermTableEntry(session, request.tunnel_info, p4info,
+                                          insert_entry);
+      break;
+    case RequestType::kRxTunnelSrc:
+      status = ConfigRxTunnelSrcPortTableEntry(session, request.tunnel_info,
+                                               p4info, insert_entry);
+      break;
+    case RequestType::kTunnelSrcPort:
+      status = HandleTunnelSrcPortRequest(session, p4info, request.sp_info,
+                                          insert_entry);
+      break;
+    case RequestType::kSrcPort:
+      status =
+          HandleSrcPortRequest(session, p4info, request.sp_info, insert_entry);
+      break;
+    case RequestType::kVlan:
+      status =
+          HandleVlanRequest(session, p4info, request.vlan_id, insert_entry);
+      break;
+#endif
+    case RequestType::kReconcile:
+      status = ReconcileShard(shard, session, p4info,
+                              *request.reconcile.desired,
+                              request.reconcile.partition->KeysOf(shard));
+      *request.reconcile.status = status;
+      request.reconcile.done->Notify();
+      break;
+    case RequestType::kResync:
+      status = ResyncShard(shard, session, p4info, *request.resync.keys,
+                           request.resync.attempt);
+      delete request.resync.keys;
+      break;
+    case RequestType::kTunnelBatch:
+      status = HandleTunnelBatch(
+          session, p4info, device->Shadow(), request.tunnel_batch.tunnels,
+          request.tunnel_batch.n_tunnels, insert_entry,
+          request.tunnel_batch.results);
+      request.tunnel_batch.done->Notify();
+      break;
+    case RequestType::kEntryBatch:
+      status = HandleEntryBatch(
+          session, p4info, device->Shadow(), device->TunnelMacs(),
+          request.entry_batch.entries, request.entry_batch.n_entries,
+          insert_entry, request.entry_batch.results);
+      request.entry_batch.done->Notify();
+      break;
+    default:
+      /* Unimplemented for this target */
+      break;
+  }
 
-  // Start a new client session.
-  auto status_or_session = OvsP4rtSession::Create(
-      absl::GetFlag(FLAGS_grpc_addr), GenerateClientCredentials(),
-      absl::GetFlag(FLAGS_device_id));
-  if (!status_or_session.ok()) return;
+  if (status.ok()) {
+    RecordShadowEntry(device->Shadow(), request);
+  }
 
-  // Unwrap the session from the StatusOr object.
-  std::unique_ptr<OvsP4rtSession> session =
-      std::move(status_or_session).value();
-  ::p4::config::v1::P4Info p4info;
-  ::absl::Status status = GetForwardingPipelineConfig(session.get(), &p4info);
-  if (!status.ok()) return;
+  // The server is gone (infrap4d restart, for example). Reconnect and
+  // refresh the P4Info on the next request.
+  if (absl::IsUnavailable(status)) {
+    device->ResetConnection(connection.get());
+  }
+}
 
-  status =
-      ConfigVlanPushTableEntry(session.get(), vlan_id, p4info, insert_entry);
-  if (!status.ok()) return;
+// Applies a batch of entries of one kind through the shards that own them,
+// and waits for the result of each. devices[i] programs entries[i].
+void ApplyEntryBatch(const std::vector<ShadowEntry>& entries,
+                     const std::vector<OvsP4rtDevice*>& devices,
+                     bool insert_entry, int* results) {
+  TraceWriter* trace = TraceWriter::Instance();
+  if (trace != nullptr) {
+    trace->AppendBatch(RequestType::kEntryBatch, insert_entry, entries);
+  }
 
-  status =
-      ConfigVlanPopTableEntry(session.get(), vlan_id, p4info, insert_entry);
-  if (!status.ok()) return;
+  struct ShardBatch {
+    std::vector<ShadowEntry> entries;
+    std::vector<size_t> indices;
+    std::vector<int> results;
+    absl::Notification done;
+  };
+  absl::flat_hash_map<OvsP4rtShard*, std::unique_ptr<ShardBatch>> batches;
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    auto& batch = batches[devices[i]->ShardForKey(ShadowEntryKey(entries[i]))];
+    if (!batch) batch = absl::make_unique<ShardBatch>();
+    batch->entries.push_back(entries[i]);
+    batch->indices.push_back(i);
+  }
 
-  return;
+  for (auto& kv : batches) {
+    ShardBatch* batch = kv.second.get();
+    batch->results.resize(batch->entries.size());
+
+    OvsP4rtRequest request = {};
+    request.type = RequestType::kEntryBatch;
+    request.insert_entry = insert_entry;
+    request.entry_batch.entries = batch->entries.data();
+    request.entry_batch.n_entries = batch->entries.size();
+    request.entry_batch.results = batch->results.data();
+    request.entry_batch.done = &batch->done;
+    kv.first->Submit(request);
+  }
+
+  for (auto& kv : batches) {
+    ShardBatch* batch = kv.second.get();
+    batch->done.WaitForNotification();
+    if (results == nullptr) continue;
+    for (size_t j = 0; j < batch->indices.size(); j++) {
+      results[batch->indices[j]] = batch->results[j];
+    }
+  }
 }
-#else
 
-// DPDK target
+}  // namespace ovs_p4rt
+
+//----------------------------------------------------------------------
+// Functions with C interfaces
+//----------------------------------------------------------------------
+
+// Requests are queued for the device that programs the bridge and are
+// applied asynchronously by its worker thread.
+
 void ConfigFdbTableEntry(struct mac_learning_info learn_info,
                          bool insert_entry) {
   using namespace ovs_p4rt;
 
-  // Start a new client session.
-  auto status_or_session = ovs_p4rt::OvsP4rtSession::Create(
-      absl::GetFlag(FLAGS_grpc_addr), GenerateClientCredentials(),
-      absl::GetFlag(FLAGS_device_id));
-  if (!status_or_session.ok()) return;
+  OvsP4rtRequest request = {};
+  request.type = RequestType::kFdb;
+  request.insert_entry = insert_entry;
+  request.learn_info = learn_info;
+  auto* device =
+      OvsP4rtDeviceRegistry::Instance().DeviceForBridge(learn_info.bridge_id);
+  device->Submit(request);
+}
 
-  // Unwrap the session from the StatusOr object.
-  std::unique_ptr<ovs_p4rt::OvsP4rtSession> session =
-      std::move(status_or_session).value();
-  ::p4::config::v1::P4Info p4info;
-  ::absl::Status status =
-      ovs_p4rt::GetForwardingPipelineConfig(session.get(), &p4info);
-  if (!status.ok()) return;
+void ConfigTunnelTableEntry(struct tunnel_info tunnel_info, bool insert_entry) {
+  using namespace ovs_p4rt;
 
-  if (learn_info.is_tunnel) {
-    status = ConfigFdbTunnelTableEntry(session.get(), learn_info, p4info,
-                                       insert_entry);
-  } else if (learn_info.is_vlan) {
-    status = ConfigFdbTxVlanTableEntry(session.get(), learn_info, p4info,
-                                       insert_entry);
-    if (!status.ok()) return;
+  OvsP4rtRequest request = {};
+  request.type = RequestType::kTunnel;
+  request.insert_entry = insert_entry;
+  request.tunnel_info = tunnel_info;
+  auto* device =
+      OvsP4rtDeviceRegistry::Instance().DeviceForBridge(tunnel_info.bridge_id);
+  device->Submit(request);
+}
 
-    status = ConfigFdbRxVlanTableEntry(session.get(), learn_info, p4info,
-                                       insert_entry);
-    if (!status.ok()) return;
-  }
-  return;
+#if defined(ES2K_TARGET)
+void ConfigIpTunnelTermTableEntry(struct tunnel_info tunnel_info,
+                                  bool insert_entry) {
+  using namespace ovs_p4rt;
+
+  OvsP4rtRequest request = {};
+  request.type = RequestType::kIpTunnelTerm;
+  request.insert_entry = insert_entry;
+  request.tunnel_info = tunnel_info;
+  auto* device =
+      OvsP4rtDeviceRegistry::Instance().DeviceForBridge(tunnel_info.bridge_id);
+  device->Submit(request);
+}
+
+void ConfigRxTunnelSrcTableEntry(struct tunnel_info tunnel_info,
+                                 bool insert_entry) {
+  using namespace ovs_p4rt;
+
+  OvsP4rtRequest request = {};
+  request.type = RequestType::kRxTunnelSrc;
+  request.insert_entry = insert_entry;
+  request.tunnel_info = tunnel_info;
+  auto* device =
+      OvsP4rtDeviceRegistry::Instance().DeviceForBridge(tunnel_info.bridge_id);
+  device->Submit(request);
 }
 
+void ConfigTunnelSrcPortTableEntry(struct src_port_info tnl_sp,
+                                   bool insert_entry) {
+  using namespace ovs_p4rt;
+
+  OvsP4rtRequest request = {};
+  request.type = RequestType::kTunnelSrcPort;
+  request.insert_entry = insert_entry;
+  request.sp_info = tnl_sp;
+  auto* device =
+      OvsP4rtDeviceRegistry::Instance().DeviceForBridge(tnl_sp.bridge_id);
+  device->Submit(request);
+}
+
+void ConfigSrcPortTableEntry(struct src_port_info vsi_sp, bool insert_entry) {
+  using namespace ovs_p4rt;
+
+  OvsP4rtRequest request = {};
+  request.type = RequestType::kSrcPort;
+  request.insert_entry = insert_entry;
+  request.sp_info = vsi_sp;
+  auto* device =
+      OvsP4rtDeviceRegistry::Instance().DeviceForBridge(vsi_sp.bridge_id);
+  device->Submit(request);
+}
+
+void ConfigVlanTableEntry(uint16_t vlan_id, bool insert_entry) {
+  using namespace ovs_p4rt;
+
+  // VLAN mod entries are not bridge-specific.
+  OvsP4rtRequest request = {};
+  request.type = RequestType::kVlan;
+  request.insert_entry = insert_entry;
+  request.vlan_id = vlan_id;
+  auto* device = OvsP4rtDeviceRegistry::Instance().DefaultDevice();
+  device->Submit(request);
+}
+#else
+
+// DPDK target
 void ConfigIpTunnelTermTableEntry(struct tunnel_info tunnel_info,
                                   bool insert_entry) {
   /* Unimplemented for DPDK target */
@@ -1796,34 +3027,268 @@ void ConfigSrcPortTableEntry(struct src_port_info vsi_sp, bool insert_entry) {
 }
 #endif
 
-void ConfigTunnelTableEntry(struct tunnel_info tunnel_info, bool insert_entry) {
+//----------------------------------------------------------------------
+// Bulk functions with C interfaces
+//----------------------------------------------------------------------
+
+void ReconcileTableEntries(const struct p4_desired_state* desired) {
   using namespace ovs_p4rt;
 
-  // Start a new client session.
-  auto status_or_session = OvsP4rtSession::Create(
-      absl::GetFlag(FLAGS_grpc_addr), GenerateClientCredentials(),
-      absl::GetFlag(FLAGS_device_id));
-  if (!status_or_session.ok()) return;
-
-  // Unwrap the session from the StatusOr object.
-  std::unique_ptr<OvsP4rtSession> session =
-      std::move(status_or_session).value();
-  ::p4::config::v1::P4Info p4info;
-  ::absl::Status status = GetForwardingPipelineConfig(session.get(), &p4info);
-  if (!status.ok()) return;
-  status =
-      ConfigEncapTableEntry(session.get(), tunnel_info, p4info, insert_entry);
-  if (!status.ok()) return;
+  // The shards of a device wait for each other (see ShadowPartition), so
+  // two reconciliations must not interleave their requests.
+  static absl::Mutex reconcile_mu;
+  absl::MutexLock reconcile_lock(&reconcile_mu);
+
+  auto& registry = OvsP4rtDeviceRegistry::Instance();
+  TraceWriter* trace = TraceWriter::Instance();
+
+  // Each shard reconciles the keys it owns. The trace records the desired
+  // state as it was passed in, without the entries a tunnel implies.
+  absl::flat_hash_map<OvsP4rtShard*, DesiredEntries> per_shard;
+  std::vector<ShadowEntry> traced;
+  auto add_entry = [&per_shard, &traced, trace](OvsP4rtDevice* device,
+                                                uint64_t key,
+                                                const ShadowEntry& entry) {
+    per_shard[device->ShardForKey(key)][key] = entry;
+    if (trace != nullptr && entry.kind != ShadowKind::kRxTunnelSrc) {
+      traced.push_back(entry);
+    }
+  };
+
+  for (size_t i = 0; i < desired->n_fdb_entries; i++) {
+    ShadowEntry entry = {};
+    entry.kind = ShadowKind::kFdb;
+    entry.learn_info = desired->fdb_entries[i];
+    auto* device = registry.DeviceForBridge(entry.learn_info.bridge_id);
+    add_entry(device, FdbShadowKey(entry.learn_info), entry);
+  }
 
+  for (size_t i = 0; i < desired->n_tunnels; i++) {
+    ShadowEntry entry = {};
+    entry.kind = ShadowKind::kTunnel;
+    entry.tunnel_info = desired->tunnels[i];
+    auto* device = registry.DeviceForBridge(entry.tunnel_info.bridge_id);
+    add_entry(device, TunnelShadowKey(entry.tunnel_info), entry);
 #if defined(ES2K_TARGET)
-  status =
-      ConfigDecapTableEntry(session.get(), tunnel_info, p4info, insert_entry);
-  if (!status.ok()) return;
+    // As in ConfigTunnelTableEntries, a tunnel comes with its receive
+    // source port entry.
+    entry.kind = ShadowKind::kRxTunnelSrc;
+    add_entry(device, RxTunnelSrcShadowKey(entry.tunnel_info), entry);
 #endif
+  }
 
-  status = ConfigTunnelTermTableEntry(session.get(), tunnel_info, p4info,
-                                      insert_entry);
-  if (!status.ok()) return;
+#if defined(ES2K_TARGET)
+  for (size_t i = 0; i < desired->n_vlans; i++) {
+    ShadowEntry entry = {};
+    entry.kind = ShadowKind::kVlan;
+    entry.vlan_id = desired->vlans[i];
+    add_entry(registry.DefaultDevice(), VlanShadowKey(entry.vlan_id), entry);
+  }
 
-  return;
+  for (size_t i = 0; i < desired->n_src_ports; i++) {
+    ShadowEntry entry = {};
+    entry.kind = ShadowKind::kSrcPort;
+    entry.sp_info = desired->src_ports[i];
+    auto* device = registry.DeviceForBridge(entry.sp_info.bridge_id);
+    add_entry(device, SrcPortShadowKey(entry.kind, entry.sp_info), entry);
+  }
+
+  for (size_t i = 0; i < desired->n_tunnel_src_ports; i++) {
+    ShadowEntry entry = {};
+    entry.kind = ShadowKind::kTunnelSrcPort;
+    entry.sp_info = desired->tunnel_src_ports[i];
+    auto* device = registry.DeviceForBridge(entry.sp_info.bridge_id);
+    add_entry(device, SrcPortShadowKey(entry.kind, entry.sp_info), entry);
+  }
+#endif
+
+  if (trace != nullptr) {
+    trace->AppendBatch(RequestType::kReconcile, true, traced);
+  }
+
+  // Devices that have entries installed are reconciled even if none of
+  // their entries are desired any more. Every shard of a device takes part,
+  // since they share the partition of its shadow.
+  absl::flat_hash_map<OvsP4rtDevice*, std::unique_ptr<ShadowPartition>>
+      partitions;
+  for (OvsP4rtDevice* device : registry.Devices()) {
+    partitions[device] = absl::make_unique<ShadowPartition>(device);
+    for (const auto& shard : device->Shards()) {
+      per_shard[shard.get()];
+    }
+  }
+
+  // The shards are reconciled concurrently by their worker threads.
+  struct ReconcileJob {
+    absl::Status status;
+    absl::Notification done;
+  };
+  std::vector<std::unique_ptr<ReconcileJob>> jobs;
+
+  for (auto& kv : per_shard) {
+    auto job = absl::make_unique<ReconcileJob>();
+    OvsP4rtRequest request = {};
+    request.type = RequestType::kReconcile;
+    request.reconcile.desired = &kv.second;
+    request.reconcile.partition = partitions[kv.first->device()].get();
+    request.reconcile.status = &job->status;
+    request.reconcile.done = &job->done;
+    kv.first->Submit(request);
+    jobs.push_back(std::move(job));
+  }
+
+  for (auto& job : jobs) {
+    job->done.WaitForNotification();
+  }
 }
+
+void ConfigTunnelTableEntries(const struct tunnel_info* tunnels,
+                              size_t n_tunnels, bool insert_entry,
+                              int* results) {
+  using namespace ovs_p4rt;
+
+  auto& registry = OvsP4rtDeviceRegistry::Instance();
+
+  // The tunnels of each device are programmed as one request.
+  struct TunnelBatch {
+    std::vector<struct tunnel_info> tunnels;
+    std::vector<size_t> indices;
+    std::vector<int> results;
+    absl::Notification done;
+  };
+  absl::flat_hash_map<OvsP4rtDevice*, std::unique_ptr<TunnelBatch>> batches;
+
+  TraceWriter* trace = TraceWriter::Instance();
+  if (trace != nullptr) {
+    std::vector<ShadowEntry> entries(n_tunnels);
+    for (size_t i = 0; i < n_tunnels; i++) {
+      entries[i].kind = ShadowKind::kTunnel;
+      entries[i].tunnel_info = tunnels[i];
+    }
+    trace->AppendBatch(RequestType::kTunnelBatch, insert_entry, entries);
+  }
+
+  for (size_t i = 0; i < n_tunnels; i++) {
+    auto& batch = batches[registry.DeviceForBridge(tunnels[i].bridge_id)];
+    if (!batch) batch = absl::make_unique<TunnelBatch>();
+    batch->tunnels.push_back(tunnels[i]);
+    batch->indices.push_back(i);
+  }
+
+  for (auto& kv : batches) {
+    TunnelBatch* batch = kv.second.get();
+    batch->results.resize(batch->tunnels.size());
+
+    OvsP4rtRequest request = {};
+    request.type = RequestType::kTunnelBatch;
+    request.insert_entry = insert_entry;
+    request.tunnel_batch.tunnels = batch->tunnels.data();
+    request.tunnel_batch.n_tunnels = batch->tunnels.size();
+    request.tunnel_batch.results = batch->results.data();
+    request.tunnel_batch.done = &batch->done;
+    kv.first->Submit(request);
+  }
+
+  for (auto& kv : batches) {
+    TunnelBatch* batch = kv.second.get();
+    batch->done.WaitForNotification();
+    if (results == nullptr) continue;
+    for (size_t j = 0; j < batch->indices.size(); j++) {
+      results[batch->indices[j]] = batch->results[j];
+    }
+  }
+}
+
+void ConfigFdbTableEntries(const struct mac_learning_info* learn_infos,
+                           size_t n_entries, bool insert_entry,
+                           int* results) {
+  using namespace ovs_p4rt;
+
+  auto& registry = OvsP4rtDeviceRegistry::Instance();
+  std::vector<ShadowEntry> entries(n_entries);
+  std::vector<OvsP4rtDevice*> devices(n_entries);
+
+  for (size_t i = 0; i < n_entries; i++) {
+    entries[i].kind = ShadowKind::kFdb;
+    entries[i].learn_info = learn_infos[i];
+    devices[i] = registry.DeviceForBridge(learn_infos[i].bridge_id);
+  }
+  ApplyEntryBatch(entries, devices, insert_entry, results);
+}
+
+#if defined(ES2K_TARGET)
+void ConfigVlanTableEntries(const uint16_t* vlan_ids, size_t n_vlans,
+                            bool insert_entry, int* results) {
+  using namespace ovs_p4rt;
+
+  // VLAN mod entries are not bridge-specific.
+  std::vector<ShadowEntry> entries(n_vlans);
+  std::vector<OvsP4rtDevice*> devices(
+      n_vlans, OvsP4rtDeviceRegistry::Instance().DefaultDevice());
+
+  for (size_t i = 0; i < n_vlans; i++) {
+    entries[i].kind = ShadowKind::kVlan;
+    entries[i].vlan_id = vlan_ids[i];
+  }
+  ApplyEntryBatch(entries, devices, insert_entry, results);
+}
+
+void ConfigSrcPortTableEntries(const struct src_port_info* vsi_sps,
+                               size_t n_entries, bool insert_entry,
+                               int* results) {
+  using namespace ovs_p4rt;
+
+  auto& registry = OvsP4rtDeviceRegistry::Instance();
+  std::vector<ShadowEntry> entries(n_entries);
+  std::vector<OvsP4rtDevice*> devices(n_entries);
+
+  for (size_t i = 0; i < n_entries; i++) {
+    entries[i].kind = ShadowKind::kSrcPort;
+    entries[i].sp_info = vsi_sps[i];
+    devices[i] = registry.DeviceForBridge(vsi_sps[i].bridge_id);
+  }
+  ApplyEntryBatch(entries, devices, insert_entry, results);
+}
+
+void ConfigTunnelSrcPortTableEntries(const struct src_port_info* tnl_sps,
+                                     size_t n_entries, bool insert_entry,
+                                     int* results) {
+  using namespace ovs_p4rt;
+
+  auto& registry = OvsP4rtDeviceRegistry::Instance();
+  std::vector<ShadowEntry> entries(n_entries);
+  std::vector<OvsP4rtDevice*> devices(n_entries);
+
+  for (size_t i = 0; i < n_entries; i++) {
+    entries[i].kind = ShadowKind::kTunnelSrcPort;
+    entries[i].sp_info = tnl_sps[i];
+    devices[i] = registry.DeviceForBridge(tnl_sps[i].bridge_id);
+  }
+  ApplyEntryBatch(entries, devices, insert_entry, results);
+}
+#else
+
+// DPDK target
+void ConfigVlanTableEntries(const uint16_t* vlan_ids, size_t n_vlans,
+                            bool insert_entry, int* results) {
+  /* Unimplemented for DPDK target */
+  if (results == nullptr) return;
+  std::fill(results, results + n_vlans, 0);
+}
+
+void ConfigSrcPortTableEntries(const struct src_port_info* vsi_sps,
+                               size_t n_entries, bool insert_entry,
+                               int* results) {
+  /* Unimplemented for DPDK target */
+  if (results == nullptr) return;
+  std::fill(results, results + n_entries, 0);
+}
+
+void ConfigTunnelSrcPortTableEntries(const struct src_port_info* tnl_sps,
+                                     size_t n_entries, bool insert_entry,
+                                     int* results) {
+  /* Unimplemented for DPDK target */
+  if (results == nullptr) return;
+  std::fill(results, results + n_entries, 0);
+}
+#endif
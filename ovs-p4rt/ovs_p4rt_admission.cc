@@ -0,0 +1,151 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ovs_p4rt_admission.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "absl/flags/flag.h"
+#include "absl/time/clock.h"
+
+ABSL_FLAG(double, learn_rate_limit, 0,
+          "Maximum number of MAC learns per second programmed across all "
+          "bridges. Excess learns are queued. 0 means unlimited.");
+ABSL_FLAG(double, learn_burst, 1000,
+          "Number of MAC learns that may exceed --learn_rate_limit in a "
+          "burst.");
+ABSL_FLAG(double, bridge_learn_rate_limit, 0,
+          "Maximum number of MAC learns per second accepted from a single "
+          "bridge. Excess learns are deferred. 0 means unlimited.");
+ABSL_FLAG(double, bridge_learn_burst, 1000,
+          "Number of MAC learns that may exceed --bridge_learn_rate_limit "
+          "in a burst.");
+ABSL_FLAG(uint32_t, learn_queue_limit, 65536,
+          "Maximum number of MAC learns queued by each worker shard. Excess "
+          "learns are deferred, up to the same number of MACs, and dropped "
+          "beyond it.");
+
+namespace ovs_p4rt {
+
+constexpr absl::Duration kReportInterval = absl::Seconds(10);
+
+//----------------------------------------------------------------------
+// TokenBucket
+//----------------------------------------------------------------------
+
+TokenBucket::TokenBucket(double rate, double burst)
+    : rate_(rate),
+      burst_(std::max(burst, 1.0)),
+      tokens_(burst_),
+      last_refill_(absl::Now()) {}
+
+void TokenBucket::Refill(absl::Time now) {
+  if (now > last_refill_) {
+    tokens_ = std::min(
+        burst_, tokens_ + rate_ * absl::ToDoubleSeconds(now - last_refill_));
+    last_refill_ = now;
+  }
+}
+
+bool TokenBucket::TryConsume(absl::Time now) {
+  if (rate_ <= 0) return true;
+
+  Refill(now);
+  if (tokens_ < 1) return false;
+  tokens_ -= 1;
+  return true;
+}
+
+absl::Duration TokenBucket::TimeToNextToken(absl::Time now) {
+  if (rate_ <= 0) return absl::ZeroDuration();
+
+  Refill(now);
+  if (tokens_ >= 1) return absl::ZeroDuration();
+  return absl::Seconds((1 - tokens_) / rate_);
+}
+
+//----------------------------------------------------------------------
+// AdmissionController
+//----------------------------------------------------------------------
+
+AdmissionController& AdmissionController::Instance() {
+  static AdmissionController* controller = new AdmissionController();
+  return *controller;
+}
+
+AdmissionController::AdmissionController()
+    : bridge_rate_(absl::GetFlag(FLAGS_bridge_learn_rate_limit)),
+      bridge_burst_(absl::GetFlag(FLAGS_bridge_learn_burst)),
+      learn_queue_limit_(absl::GetFlag(FLAGS_learn_queue_limit)),
+      learn_bucket_(absl::GetFlag(FLAGS_learn_rate_limit),
+                    absl::GetFlag(FLAGS_learn_burst)),
+      last_report_(absl::InfinitePast()) {}
+
+bool AdmissionController::AdmitLearn(uint8_t bridge_id) {
+  if (bridge_rate_ <= 0) return true;
+
+  absl::MutexLock lock(&mu_);
+  auto it = bridge_buckets_.find(bridge_id);
+  if (it == bridge_buckets_.end()) {
+    it = bridge_buckets_
+             .emplace(bridge_id, TokenBucket(bridge_rate_, bridge_burst_))
+             .first;
+  }
+  return it->second.TryConsume(absl::Now());
+}
+
+bool AdmissionController::TryAcquireLearnToken(absl::Duration* wait) {
+  absl::MutexLock lock(&mu_);
+  const absl::Time now = absl::Now();
+  if (learn_bucket_.TryConsume(now)) {
+    admitted_++;
+    return true;
+  }
+  throttled_++;
+  *wait = learn_bucket_.TimeToNextToken(now);
+  return false;
+}
+
+void AdmissionController::CountDeferred(bool queue_full) {
+  if (queue_full) {
+    deferred_queue_full_++;
+  } else {
+    deferred_bridge_rate_++;
+  }
+  absl::MutexLock lock(&mu_);
+  ReportStorm();
+}
+
+void AdmissionController::CountDropped() {
+  dropped_++;
+  absl::MutexLock lock(&mu_);
+  ReportStorm();
+}
+
+void AdmissionController::ReportStorm() {
+  const absl::Time now = absl::Now();
+  if (now - last_report_ < kReportInterval) return;
+  last_report_ = now;
+
+  const AdmissionStats stats = Stats();
+  printf("MAC learn storm: deferred %" PRIu64 " learns over the bridge "
+         "rate, %" PRIu64 " with a full queue; dropped %" PRIu64 "\n",
+         stats.deferred_bridge_rate, stats.deferred_queue_full,
+         stats.dropped);
+}
+
+AdmissionStats AdmissionController::Stats() const {
+  AdmissionStats stats;
+  stats.admitted = admitted_.load();
+  stats.deferred_bridge_rate = deferred_bridge_rate_.load();
+  stats.deferred_queue_full = deferred_queue_full_.load();
+  stats.dropped = dropped_.load();
+  stats.superseded = superseded_.load();
+  stats.throttled = throttled_.load();
+  return stats;
+}
+
+}  // namespace ovs_p4rt
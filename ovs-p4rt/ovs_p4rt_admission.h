@@ -0,0 +1,110 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OVSP4RT_ADMISSION_H_
+#define OVSP4RT_ADMISSION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace ovs_p4rt {
+
+// Classic token bucket. A rate of zero means unlimited.
+class TokenBucket {
+ public:
+  TokenBucket(double rate, double burst);
+
+  // Takes a token if one is available.
+  bool TryConsume(absl::Time now);
+
+  // Returns how long it takes until a token becomes available.
+  absl::Duration TimeToNextToken(absl::Time now);
+
+ private:
+  void Refill(absl::Time now);
+
+  const double rate_;
+  const double burst_;
+  double tokens_;
+  absl::Time last_refill_;
+};
+
+struct AdmissionStats {
+  uint64_t admitted;              // learns handed to a device worker
+  uint64_t deferred_bridge_rate;  // learns deferred by a per-bridge bucket
+  uint64_t deferred_queue_full;   // learns deferred with a full queue
+  uint64_t dropped;               // learns dropped with too many deferred
+  uint64_t superseded;            // queued learns cancelled by a later delete
+  uint64_t throttled;             // times a worker waited for learn tokens
+};
+
+// Admission control for MAC learns.
+//
+// A learn storm must not starve the rest of the control plane, so new FDB
+// entries are admitted at a bounded rate while deletes and all other
+// configuration bypass the limits:
+//  - Each bridge has a token bucket (--bridge_learn_rate_limit), so one
+//    bridge cannot crowd out the others.
+//  - Admitted learns wait in a bounded queue (--learn_queue_limit) that is
+//    served after all other requests, at the rate of a global token bucket
+//    (--learn_rate_limit).
+// OVS does not notify a learn again while the MAC stays where it is, so a
+// learn that is over the bridge rate or does not fit in the queue is not
+// dropped. The shard defers it, keeping only the latest learn of each MAC,
+// and retries it later (see OvsP4rtShard). Only learns beyond a bound on
+// the deferred MACs are dropped.
+class AdmissionController {
+ public:
+  static AdmissionController& Instance();
+
+  // Applies the per-bridge limit to a learn. Returns false if the learn
+  // must be deferred.
+  bool AdmitLearn(uint8_t bridge_id);
+
+  // Takes a token from the global learn budget. If none is available,
+  // returns false and sets *wait to the time until the next token.
+  bool TryAcquireLearnToken(absl::Duration* wait);
+
+  // Maximum number of learns queued, and of MACs deferred, per shard.
+  size_t LearnQueueLimit() const { return learn_queue_limit_; }
+
+  void CountDeferred(bool queue_full);
+  void CountDropped();
+  void CountSuperseded() { superseded_++; }
+
+  AdmissionStats Stats() const;
+
+ private:
+  AdmissionController();
+
+  // Logs the counters, at most once every few seconds.
+  void ReportStorm() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const double bridge_rate_;
+  const double bridge_burst_;
+  const size_t learn_queue_limit_;
+
+  absl::Mutex mu_;
+  TokenBucket learn_bucket_ ABSL_GUARDED_BY(mu_);
+  absl::flat_hash_map<uint8_t, TokenBucket> bridge_buckets_
+      ABSL_GUARDED_BY(mu_);
+  absl::Time last_report_ ABSL_GUARDED_BY(mu_);
+
+  std::atomic<uint64_t> admitted_{0};
+  std::atomic<uint64_t> deferred_bridge_rate_{0};
+  std::atomic<uint64_t> deferred_queue_full_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint64_t> superseded_{0};
+  std::atomic<uint64_t> throttled_{0};
+};
+
+}  // namespace ovs_p4rt
+
+#endif  // OVSP4RT_ADMISSION_H_
@@ -0,0 +1,73 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// Bulk programming interfaces for OVS.
+//
+// These complement the per-entry functions in openvswitch/ovs-p4rt.h.
+
+#ifndef OVSP4RT_BULK_H_
+#define OVSP4RT_BULK_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "openvswitch/ovs-p4rt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Complete set of entries OVS wants programmed. The tunnels include their
+// receive source port entries, as in ConfigTunnelTableEntries.
+struct p4_desired_state {
+  const struct mac_learning_info* fdb_entries;
+  size_t n_fdb_entries;
+  const struct tunnel_info* tunnels;
+  size_t n_tunnels;
+  const uint16_t* vlans;
+  size_t n_vlans;
+  const struct src_port_info* src_ports;
+  size_t n_src_ports;
+  const struct src_port_info* tunnel_src_ports;
+  size_t n_tunnel_src_ports;
+};
+
+// Brings the entries programmed by ovs-p4rt in line with the desired
+// state, e.g. after a bridge reconfiguration. Only the difference between
+// the desired state and what is installed is written: missing entries are
+// inserted, changed entries are modified and entries that are not part of
+// the desired state are deleted. Blocks until all devices are reconciled.
+extern void ReconcileTableEntries(const struct p4_desired_state* desired);
+
+// Programs (or removes) the encap, decap, tunnel termination and receive
+// source port entries of a set of tunnels, using a few large WriteRequests
+// instead of one per entry. If results is not NULL, results[i] is set to 0
+// if tunnel i was programmed and to -1 otherwise. Blocks until done.
+extern void ConfigTunnelTableEntries(const struct tunnel_info* tunnels,
+                                     size_t n_tunnels, bool insert_entry,
+                                     int* results);
+
+// Array versions of the per-entry functions in openvswitch/ovs-p4rt.h.
+// The entries are programmed in one pass per device, sharing lookups
+// such as VSI host ports, and written in a few large WriteRequests. Known
+// FDB entries that moved are modified in place. If results is not NULL,
+// results[i] is set to 0 if entry i was programmed and to -1 otherwise.
+// Each call blocks until done.
+extern void ConfigFdbTableEntries(const struct mac_learning_info* learn_infos,
+                                  size_t n_entries, bool insert_entry,
+                                  int* results);
+extern void ConfigVlanTableEntries(const uint16_t* vlan_ids, size_t n_vlans,
+                                   bool insert_entry, int* results);
+extern void ConfigSrcPortTableEntries(const struct src_port_info* vsi_sps,
+                                      size_t n_entries, bool insert_entry,
+                                      int* results);
+extern void ConfigTunnelSrcPortTableEntries(
+    const struct src_port_info* tnl_sps, size_t n_entries, bool insert_entry,
+    int* results);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // OVSP4RT_BULK_H_
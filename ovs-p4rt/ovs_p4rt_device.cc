@@ -0,0 +1,668 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ovs_p4rt_device.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "ovs_p4rt_admission.h"
+#include "ovs_p4rt_placement.h"
+#include "ovs_p4rt_tls_credentials.h"
+#include "ovs_p4rt_trace.h"
+
+ABSL_FLAG(std::string, grpc_addr, "localhost:9559",
+          "P4Runtime server address.");
+ABSL_FLAG(uint64_t, device_id, 1, "P4Runtime device ID.");
+ABSL_FLAG(std::string, bridge_device_map, "",
+          "Comma-separated list of bridge_id:device_id pairs. Bridges that "
+          "are not listed are programmed through --device_id.");
+ABSL_FLAG(int32_t, worker_shards, 4,
+          "Number of worker threads that program each device. FDB entries "
+          "are spread over them by bridge and MAC address.");
+ABSL_FLAG(uint32_t, tunnel_mac_filter_size, 256 * 1024,
+          "Number of counters in the filter of tunnel-learned MACs kept for "
+          "each device. Larger filters skip more device reads when FDB "
+          "entries are deleted.");
+ABSL_FLAG(int32_t, grpc_max_message_bytes, 64 << 20,
+          "Largest P4Runtime message sent or received, such as a batched "
+          "WriteRequest or a ReadResponse.");
+ABSL_FLAG(int32_t, grpc_keepalive_time_ms, 0,
+          "Interval of the keepalive pings on the P4Runtime connection. "
+          "0 disables them. The server must permit pings this often, or it "
+          "closes the connection; gRPC servers allow one every 5 minutes "
+          "(300000) by default.");
+ABSL_FLAG(int32_t, grpc_keepalive_timeout_ms, 5000,
+          "Time after which an unacknowledged keepalive ping closes the "
+          "P4Runtime connection.");
+ABSL_FLAG(int32_t, grpc_initial_window_bytes, 4 << 20,
+          "Initial HTTP/2 flow-control window of each P4Runtime call. 0 "
+          "uses the gRPC default.");
+ABSL_FLAG(int32_t, grpc_write_buffer_bytes, 1 << 20,
+          "Size of the HTTP/2 write buffer of the P4Runtime connection. 0 "
+          "uses the gRPC default.");
+ABSL_FLAG(uint64_t, grpc_buffer_pool_bytes, 0,
+          "Memory the buffers of each P4Runtime connection may use in "
+          "total. 0 means no limit.");
+ABSL_FLAG(int32_t, health_check_interval_ms, 1000,
+          "Interval at which each device checks its P4Runtime connection "
+          "and re-establishes it if it failed at two checks in a row. 0 "
+          "disables the checks.");
+ABSL_FLAG(std::string, shadow_snapshot_dir, "",
+          "Directory in which to keep a snapshot of the entries programmed "
+          "on each device, for warm restart of ovs-vswitchd. Disabled if "
+          "empty.");
+
+namespace ovs_p4rt {
+
+namespace {
+
+// Interval at which a shard retries its deferred learns.
+constexpr absl::Duration kDeferredRetryInterval = absl::Milliseconds(100);
+
+ChannelOptions ChannelOptionsFromFlags() {
+  ChannelOptions options;
+  options.max_message_bytes = absl::GetFlag(FLAGS_grpc_max_message_bytes);
+  options.keepalive_time_ms = absl::GetFlag(FLAGS_grpc_keepalive_time_ms);
+  options.keepalive_timeout_ms =
+      absl::GetFlag(FLAGS_grpc_keepalive_timeout_ms);
+  options.initial_window_bytes =
+      absl::GetFlag(FLAGS_grpc_initial_window_bytes);
+  options.write_buffer_bytes = absl::GetFlag(FLAGS_grpc_write_buffer_bytes);
+  options.buffer_pool_bytes = absl::GetFlag(FLAGS_grpc_buffer_pool_bytes);
+  return options;
+}
+
+}  // namespace
+
+//----------------------------------------------------------------------
+// OvsP4rtShard
+//----------------------------------------------------------------------
+
+OvsP4rtShard::OvsP4rtShard(OvsP4rtDevice* device, int index)
+    : device_(device), index_(index) {
+  worker_ = std::thread(&OvsP4rtShard::WorkerLoop, this);
+}
+
+OvsP4rtShard::~OvsP4rtShard() {
+  {
+    absl::MutexLock lock(&mu_);
+    shutdown_ = true;
+    cond_.Signal();
+  }
+  worker_.join();
+}
+
+void OvsP4rtShard::Submit(const OvsP4rtRequest& request) {
+  const bool is_learn =
+      (request.type == RequestType::kFdb && request.insert_entry);
+
+  absl::MutexLock lock(&mu_);
+  const uint64_t seq = next_seq_++;
+
+  if (is_learn) {
+    AdmitLearnLocked({seq, request}, false);
+  } else {
+    // The delete overtakes any learn of the same MAC that is still queued
+    // or deferred, and cancels it. So does a batch, whether it inserts or
+    // deletes.
+    if (request.type == RequestType::kFdb) {
+      SupersedeLearnsLocked(FdbShadowKey(request.learn_info), seq);
+    }
+    if (request.type == RequestType::kEntryBatch) {
+      for (size_t i = 0; i < request.entry_batch.n_entries; i++) {
+        const ShadowEntry& entry = request.entry_batch.entries[i];
+        if (entry.kind == ShadowKind::kFdb) {
+          SupersedeLearnsLocked(FdbShadowKey(entry.learn_info), seq);
+        }
+      }
+    }
+    priority_queue_.push_back({seq, request});
+  }
+  cond_.Signal();
+}
+
+void OvsP4rtShard::SupersedeLearnsLocked(uint64_t key, uint64_t seq) {
+  if (!learn_queue_.empty()) superseded_[key] = seq;
+  deferred_.erase(key);
+}
+
+bool OvsP4rtShard::AdmitLearnLocked(const QueuedRequest& learn, bool retry) {
+  auto& admission = AdmissionController::Instance();
+  const uint64_t key = FdbShadowKey(learn.request.learn_info);
+
+  // The bridge token is only taken if the learn fits in the queue.
+  const bool queue_full = learn_queue_.size() >= admission.LearnQueueLimit();
+  if (!queue_full &&
+      admission.AdmitLearn(learn.request.learn_info.bridge_id)) {
+    learn_queue_.push_back(learn);
+    deferred_.erase(key);
+    return true;
+  }
+  if (retry) return false;
+
+  auto it = deferred_.find(key);
+  if (it != deferred_.end()) {
+    it->second = learn;
+  } else if (deferred_.size() < admission.LearnQueueLimit()) {
+    deferred_.emplace(key, learn);
+  } else {
+    admission.CountDropped();
+    return false;
+  }
+  admission.CountDeferred(queue_full);
+  return false;
+}
+
+void OvsP4rtShard::RetryDeferredLocked() {
+  const absl::Time now = absl::Now();
+  if (deferred_.empty() || now < next_retry_) return;
+  next_retry_ = now + kDeferredRetryInterval;
+
+  // A deferred learn keeps its sequence number: any later delete of the
+  // MAC has removed it from deferred_. Erasing an admitted learn leaves
+  // the iterators to the other ones valid.
+  auto& admission = AdmissionController::Instance();
+  for (auto it = deferred_.begin(); it != deferred_.end();) {
+    if (learn_queue_.size() >= admission.LearnQueueLimit()) break;
+    const QueuedRequest learn = it->second;
+    ++it;
+    AdmitLearnLocked(learn, true);
+  }
+}
+
+std::deque<OvsP4rtShard::QueuedRequest>* OvsP4rtShard::NextQueue() {
+  if (!priority_queue_.empty()) return &priority_queue_;
+
+  while (!learn_queue_.empty()) {
+    const QueuedRequest& next = learn_queue_.front();
+    auto it = superseded_.find(FdbShadowKey(next.request.learn_info));
+    if (it == superseded_.end() || it->second < next.seq) {
+      return &learn_queue_;
+    }
+    AdmissionController::Instance().CountSuperseded();
+    learn_queue_.pop_front();
+  }
+  superseded_.clear();
+  return nullptr;
+}
+
+bool OvsP4rtShard::PopNextLocked(
+    absl::FunctionRef<bool(const OvsP4rtRequest&)> pred,
+    OvsP4rtRequest* request, absl::Duration* wait) {
+  std::deque<QueuedRequest>* queue = NextQueue();
+  if (queue == nullptr || !pred(queue->front().request)) return false;
+
+  if (queue == &learn_queue_ &&
+      !AdmissionController::Instance().TryAcquireLearnToken(wait)) {
+    return false;
+  }
+
+  *request = queue->front().request;
+  queue->pop_front();
+  return true;
+}
+
+bool OvsP4rtShard::PopNextIf(
+    absl::FunctionRef<bool(const OvsP4rtRequest&)> pred,
+    OvsP4rtRequest* request) {
+  absl::MutexLock lock(&mu_);
+  absl::Duration wait;
+  return PopNextLocked(pred, request, &wait);
+}
+
+void OvsP4rtShard::Drain() {
+  absl::MutexLock lock(&mu_);
+  mu_.Await(absl::Condition(this, &OvsP4rtShard::IsIdle));
+}
+
+void OvsP4rtShard::WorkerLoop() {
+  absl::Status status = ApplyThreadPlacement(WorkerPlacement());
+  if (!status.ok()) {
+    printf("Unable to place worker thread %d of device %u: %s\n", index_,
+           device_->DeviceId(), std::string(status.message()).c_str());
+  }
+
+  while (true) {
+    OvsP4rtRequest request;
+    {
+      absl::MutexLock lock(&mu_);
+      busy_ = false;
+      while (!shutdown_) {
+        RetryDeferredLocked();
+        // Wait for a new request, for the next learn token if learns are
+        // being throttled, or for the next retry of the deferred learns.
+        absl::Duration wait = absl::InfiniteDuration();
+        if (PopNextLocked([](const OvsP4rtRequest&) { return true; },
+                          &request, &wait)) {
+          break;
+        }
+        if (!deferred_.empty()) {
+          wait = std::min(wait, next_retry_ - absl::Now());
+        }
+        cond_.WaitWithTimeout(&mu_, wait);
+      }
+      if (shutdown_) return;
+      busy_ = true;
+    }
+    ProcessRequest(this, request);
+  }
+}
+
+//----------------------------------------------------------------------
+// OvsP4rtDevice
+//----------------------------------------------------------------------
+
+OvsP4rtDevice::OvsP4rtDevice(uint32_t device_id, const std::string& grpc_addr,
+                             const std::string& snapshot_path, int num_shards)
+    : device_id_(device_id),
+      grpc_addr_(grpc_addr),
+      tunnel_macs_(absl::GetFlag(FLAGS_tunnel_mac_filter_size)) {
+  if (!snapshot_path.empty()) {
+    absl::Status status = shadow_.AttachSnapshot(snapshot_path, device_id);
+    if (status.ok()) {
+      printf("Loaded %zu shadow entries for device %u from %s\n",
+             shadow_.size(), device_id, snapshot_path.c_str());
+    } else {
+      printf("Unable to open shadow snapshot: %s\n",
+             std::string(status.message()).c_str());
+    }
+  }
+
+  for (int i = 0; i < std::max(num_shards, 1); i++) {
+    shards_.push_back(absl::make_unique<OvsP4rtShard>(this, i));
+  }
+
+  watch_thread_ = std::thread(&OvsP4rtDevice::WatchLoop, this);
+  resync_thread_ = std::thread(&OvsP4rtDevice::ResyncLoop, this);
+
+  const int health_check_interval_ms =
+      absl::GetFlag(FLAGS_health_check_interval_ms);
+  if (health_check_interval_ms > 0) {
+    health_thread_ = std::thread(&OvsP4rtDevice::HealthLoop, this,
+                                 absl::Milliseconds(health_check_interval_ms));
+  }
+}
+
+// The threads must stop before the shadow and connection they use.
+OvsP4rtDevice::~OvsP4rtDevice() {
+  stop_health_.Notify();
+  if (health_thread_.joinable()) health_thread_.join();
+  {
+    absl::MutexLock lock(&mu_);
+    stopping_ = true;
+    if (connection_) connection_->session->CancelStream();
+  }
+  watch_thread_.join();
+  resync_thread_.join();
+  shards_.clear();
+}
+
+void OvsP4rtDevice::Submit(const OvsP4rtRequest& request) {
+  TraceWriter* trace = TraceWriter::Instance();
+  if (trace != nullptr && !IsBulkRequest(request.type)) {
+    trace->Append(request);
+  }
+
+  // Only FDB requests are spread over the shards; the others are few and
+  // may depend on each other, so they stay in order on the first shard.
+  // Entry batches are split by shard by the caller (see ShardForKey).
+  if (request.type == RequestType::kFdb) {
+    ShardForKey(FdbShadowKey(request.learn_info))->Submit(request);
+  } else {
+    shards_[0]->Submit(request);
+  }
+}
+
+OvsP4rtShard* OvsP4rtDevice::ShardForKey(uint64_t key) {
+  if (ShadowKeyKind(key) != ShadowKind::kFdb) return shards_[0].get();
+  return shards_[ShadowKeyHash(key) % shards_.size()].get();
+}
+
+void OvsP4rtDevice::Drain() {
+  for (auto& shard : shards_) {
+    shard->Drain();
+  }
+}
+
+absl::StatusOr<std::shared_ptr<const DeviceConnection>>
+OvsP4rtDevice::Connect() {
+  // Only one thread connects at a time, and the others wait for its
+  // connection. The lock is not held while the connection is established,
+  // so the connection can be reset or checked meanwhile.
+  {
+    absl::MutexLock lock(&mu_);
+    auto idle = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      return !connecting_;
+    };
+    mu_.Await(absl::Condition(&idle));
+    if (connection_) return connection_;
+    connecting_ = true;
+  }
+
+  auto new_connection = std::make_shared<DeviceConnection>();
+  auto status_or_session =
+      OvsP4rtSession::Create(grpc_addr_, GenerateClientCredentials(),
+                             device_id_, TimeBasedElectionId(),
+                             ChannelOptionsFromFlags());
+  absl::Status status = status_or_session.status();
+  if (status.ok()) {
+    new_connection->session = std::move(status_or_session).value();
+    status = GetForwardingPipelineConfig(new_connection->session.get(),
+                                         &new_connection->p4info,
+                                         &new_connection->cookie);
+  }
+
+  absl::MutexLock lock(&mu_);
+  connecting_ = false;
+  if (!status.ok()) return status;
+
+  if (check_shadow_) {
+    check_shadow_ = false;
+    const bool pipeline_changed =
+        (shadow_.PipelineCookie() != new_connection->cookie);
+    shadow_.SetPipelineCookie(new_connection->cookie);
+    if (!snapshot_checked_ && pipeline_changed) {
+      // Entries of a snapshot installed on another pipeline are gone, and
+      // OVS programs them again after a restart. This is done before any
+      // request can rely on the shadow.
+      if (shadow_.size() != 0) {
+        printf("Discarding %zu shadow entries of device %u, which were "
+               "installed on another pipeline\n",
+               shadow_.size(), device_id_);
+        shadow_.Clear();
+      }
+    } else {
+      // Otherwise, the server may have lost the entries meanwhile, when it
+      // restarted for example. The resync thread reads the tables back
+      // while requests go on, or reinstalls all the entries if the
+      // pipeline changed.
+      resync_connection_ = new_connection;
+      resync_all_ = pipeline_changed;
+    }
+    snapshot_checked_ = true;
+  }
+  connection_ = std::move(new_connection);
+  return connection_;
+}
+
+void OvsP4rtDevice::ResyncLoop() {
+  ApplyThreadPlacement(WorkerPlacement()).IgnoreError();
+
+  while (true) {
+    std::shared_ptr<const DeviceConnection> connection;
+    bool reinstall_all;
+    {
+      absl::MutexLock lock(&mu_);
+      auto ready = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        return resync_connection_ != nullptr || stopping_;
+      };
+      mu_.Await(absl::Condition(&ready));
+      if (stopping_) return;
+      connection = std::move(resync_connection_);
+      reinstall_all = resync_all_;
+    }
+
+    std::vector<uint64_t> missing;
+    if (!reinstall_all) {
+      absl::Status status =
+          FindMissingEntries(*connection, &shadow_, &missing);
+      if (!status.ok()) {
+        printf("Unable to read back the entries of device %u: %s\n",
+               device_id_, std::string(status.message()).c_str());
+        reinstall_all = true;
+      }
+    }
+    if (reinstall_all) {
+      missing.clear();
+      shadow_.ForEach([&missing](uint64_t key, const ShadowEntry&) {
+        missing.push_back(key);
+      });
+    }
+    ReinstallEntries(missing);
+  }
+}
+
+void OvsP4rtDevice::ResetConnection(const DeviceConnection* connection) {
+  absl::MutexLock lock(&mu_);
+  if (connection_.get() != connection) return;
+
+  connection_->session->CancelStream();
+  connection_.reset();
+  check_shadow_ = true;
+}
+
+void OvsP4rtDevice::HealthLoop(absl::Duration interval) {
+  ApplyThreadPlacement(WorkerPlacement()).IgnoreError();
+
+  // Nothing is kept alive until the first request has connected. A
+  // connection that is idle or reconnecting is left to gRPC, and only
+  // reset once it has failed at two checks in a row.
+  constexpr int kFailedChecksBeforeReset = 2;
+  bool was_connected = false;
+  int failed_checks = 0;
+  while (!stop_health_.WaitForNotificationWithTimeout(interval)) {
+    std::shared_ptr<const DeviceConnection> connection;
+    {
+      absl::MutexLock lock(&mu_);
+      connection = connection_;
+    }
+    if (connection) {
+      was_connected = true;
+      if (!connection->session->HasFailed()) {
+        failed_checks = 0;
+        continue;
+      }
+      if (++failed_checks < kFailedChecksBeforeReset) continue;
+      failed_checks = 0;
+      printf("Lost connection to P4Runtime device %u, reconnecting\n",
+             device_id_);
+      ResetConnection(connection.get());
+    } else if (!was_connected) {
+      continue;
+    }
+
+    // Reconnect now rather than on the next request. If the server is
+    // still down, try again on the next check.
+    Connect().IgnoreError();
+  }
+}
+
+void OvsP4rtDevice::WatchLoop() {
+  ApplyThreadPlacement(WorkerPlacement()).IgnoreError();
+
+  while (true) {
+    std::shared_ptr<const DeviceConnection> connection;
+    {
+      absl::MutexLock lock(&mu_);
+      auto ready = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        return connection_ != nullptr || stopping_;
+      };
+      mu_.Await(absl::Condition(&ready));
+      if (stopping_) return;
+      connection = connection_;
+    }
+
+    // The server sends an arbitration update when another controller
+    // becomes primary, and another one when mastership comes back.
+    bool is_primary = true;
+    bool changed = false;
+    ::p4::v1::StreamMessageResponse response;
+    while (!changed && connection->session->ReadStreamMessage(&response)) {
+      if (response.update_case() !=
+          ::p4::v1::StreamMessageResponse::kArbitration) {
+        continue;
+      }
+      const bool was_primary = is_primary;
+      is_primary =
+          (response.arbitration().status().code() == grpc::StatusCode::OK);
+      if (!is_primary && was_primary) {
+        printf("Another controller is primary for P4Runtime device %u\n",
+               device_id_);
+      } else if (is_primary && !was_primary) {
+        changed = PipelineChanged(*connection);
+      }
+    }
+
+    {
+      absl::MutexLock lock(&mu_);
+      if (stopping_) return;
+    }
+    Resync(connection.get(),
+           changed ? "Pipeline changed" : "Lost stream channel");
+  }
+}
+
+bool OvsP4rtDevice::PipelineChanged(const DeviceConnection& connection) {
+  uint64_t cookie;
+  absl::Status status =
+      GetForwardingPipelineCookie(connection.session.get(), &cookie);
+  if (!status.ok()) {
+    // Assume the worst.
+    printf("Unable to read pipeline cookie of device %u: %s\n", device_id_,
+           std::string(status.message()).c_str());
+    return true;
+  }
+  return cookie != connection.cookie;
+}
+
+void OvsP4rtDevice::Resync(const DeviceConnection* connection,
+                           absl::string_view reason) {
+  {
+    absl::MutexLock lock(&mu_);
+    if (connection_.get() != connection) return;
+    connection_->session->CancelStream();
+    connection_.reset();
+    check_shadow_ = true;
+  }
+  printf("%s on P4Runtime device %u, resynchronizing\n",
+         std::string(reason).c_str(), device_id_);
+
+  // The new connection fetches the P4Info of the pipeline now running, and
+  // the resync thread reinstalls the entries if it changed. Otherwise only
+  // the stream may have been reset, and it reinstalls the entries the
+  // tables read back do not hold. Requests that are already being applied finish on the old
+  // connection. If the server is still down, the next connection does it.
+  auto status_or_connection = Connect();
+  if (!status_or_connection.ok()) {
+    printf("Unable to reconnect to P4Runtime device %u: %s\n", device_id_,
+           std::string(status_or_connection.status().message()).c_str());
+  }
+}
+
+void OvsP4rtDevice::ReinstallEntries(const std::vector<uint64_t>& keys) {
+  if (keys.empty()) return;
+  printf("Reinstalling %zu entries on P4Runtime device %u\n", keys.size(),
+         device_id_);
+
+  // Each shard reinstalls the entries it owns in order with the requests
+  // already queued for them.
+  std::vector<std::unique_ptr<std::vector<uint64_t>>> shard_keys(
+      shards_.size());
+  for (uint64_t key : keys) {
+    auto& owned = shard_keys[ShardForKey(key)->index()];
+    if (!owned) owned = absl::make_unique<std::vector<uint64_t>>();
+    owned->push_back(key);
+  }
+  for (size_t i = 0; i < shards_.size(); i++) {
+    if (!shard_keys[i]) continue;
+    OvsP4rtRequest request = {};
+    request.type = RequestType::kResync;
+    request.resync.keys = shard_keys[i].release();
+    shards_[i]->Submit(request);
+  }
+}
+
+//----------------------------------------------------------------------
+// OvsP4rtDeviceRegistry
+//----------------------------------------------------------------------
+
+absl::StatusOr<absl::flat_hash_map<uint8_t, uint32_t>> ParseBridgeDeviceMap(
+    const std::string& map_str) {
+  absl::flat_hash_map<uint8_t, uint32_t> bridge_map;
+
+  for (absl::string_view pair :
+       absl::StrSplit(map_str, ',', absl::SkipEmpty())) {
+    std::vector<absl::string_view> fields = absl::StrSplit(pair, ':');
+    uint32_t bridge_id;
+    uint32_t device_id;
+    if (fields.size() != 2 || !absl::SimpleAtoi(fields[0], &bridge_id) ||
+        !absl::SimpleAtoi(fields[1], &device_id) || bridge_id > UINT8_MAX) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid bridge:device pair '", pair, "'"));
+    }
+    bridge_map[bridge_id] = device_id;
+  }
+  return bridge_map;
+}
+
+OvsP4rtDeviceRegistry& OvsP4rtDeviceRegistry::Instance() {
+  // The registry (and the worker threads it owns) lives until the
+  // process exits.
+  static OvsP4rtDeviceRegistry* registry = new OvsP4rtDeviceRegistry();
+  return *registry;
+}
+
+OvsP4rtDeviceRegistry::OvsP4rtDeviceRegistry()
+    : grpc_addr_(absl::GetFlag(FLAGS_grpc_addr)),
+      snapshot_dir_(absl::GetFlag(FLAGS_shadow_snapshot_dir)),
+      default_device_id_(absl::GetFlag(FLAGS_device_id)),
+      num_shards_(absl::GetFlag(FLAGS_worker_shards)) {
+  auto status_or_map =
+      ParseBridgeDeviceMap(absl::GetFlag(FLAGS_bridge_device_map));
+  if (!status_or_map.ok()) {
+    printf("Ignoring bridge_device_map: %s\n",
+           std::string(status_or_map.status().message()).c_str());
+    return;
+  }
+  bridge_to_device_ = std::move(status_or_map).value();
+}
+
+OvsP4rtDevice* OvsP4rtDeviceRegistry::DeviceForBridge(uint8_t bridge_id) {
+  auto it = bridge_to_device_.find(bridge_id);
+  uint32_t device_id =
+      (it != bridge_to_device_.end()) ? it->second : default_device_id_;
+
+  absl::MutexLock lock(&mu_);
+  return GetOrCreateDevice(device_id);
+}
+
+OvsP4rtDevice* OvsP4rtDeviceRegistry::DefaultDevice() {
+  absl::MutexLock lock(&mu_);
+  return GetOrCreateDevice(default_device_id_);
+}
+
+std::vector<OvsP4rtDevice*> OvsP4rtDeviceRegistry::Devices() {
+  absl::MutexLock lock(&mu_);
+  std::vector<OvsP4rtDevice*> devices;
+  devices.reserve(devices_.size());
+  for (const auto& kv : devices_) {
+    devices.push_back(kv.second.get());
+  }
+  return devices;
+}
+
+OvsP4rtDevice* OvsP4rtDeviceRegistry::GetOrCreateDevice(uint32_t device_id) {
+  auto& device = devices_[device_id];
+  if (!device) {
+    std::string snapshot_path;
+    if (!snapshot_dir_.empty()) {
+      snapshot_path = absl::StrCat(snapshot_dir_, "/ovs-p4rt-device-",
+                                   device_id, ".shadow");
+    }
+    device = absl::make_unique<OvsP4rtDevice>(device_id, grpc_addr_,
+                                              snapshot_path, num_shards_);
+  }
+  return device.get();
+}
+
+}  // namespace ovs_p4rt
@@ -0,0 +1,402 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OVSP4RT_DEVICE_H_
+#define OVSP4RT_DEVICE_H_
+
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/functional/function_ref.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+#include "openvswitch/ovs-p4rt.h"
+#include "ovs_p4rt_session.h"
+#include "ovs_p4rt_shadow.h"
+#include "ovs_p4rt_tunnel_filter.h"
+#include "p4/config/v1/p4info.pb.h"
+
+namespace ovs_p4rt {
+
+// Type of programming request received through the C interface.
+enum class RequestType {
+  kFdb,
+  kTunnel,
+  kIpTunnelTerm,
+  kRxTunnelSrc,
+  kTunnelSrcPort,
+  kSrcPort,
+  kVlan,
+  kReconcile,
+  kTunnelBatch,
+  kEntryBatch,
+  kResync,
+};
+
+// Returns true for requests made through the bulk interfaces, whose
+// payload points to the caller's memory.
+inline bool IsBulkRequest(RequestType type) {
+  return type == RequestType::kReconcile ||
+         type == RequestType::kTunnelBatch || type == RequestType::kEntryBatch;
+}
+
+// Desired entries for a device, keyed by shadow key.
+using DesiredEntries = absl::flat_hash_map<uint64_t, ShadowEntry>;
+
+class ShadowPartition;
+
+// A single programming request, queued for the device that owns the bridge.
+// The payload is a copy of the C structure passed in by OVS.
+struct OvsP4rtRequest {
+  RequestType type;
+  bool insert_entry;
+  union {
+    struct mac_learning_info learn_info;
+    struct tunnel_info tunnel_info;
+    struct src_port_info sp_info;
+    uint16_t vlan_id;
+    struct {
+      const DesiredEntries* desired;
+      ShadowPartition* partition;
+      ::absl::Status* status;
+      ::absl::Notification* done;
+    } reconcile;
+    struct {
+      const struct tunnel_info* tunnels;
+      size_t n_tunnels;
+      int* results;
+      ::absl::Notification* done;
+    } tunnel_batch;
+    struct {
+      const ShadowEntry* entries;
+      size_t n_entries;
+      int* results;
+      ::absl::Notification* done;
+    } entry_batch;
+    struct {
+      // Shadow keys of the entries to reinstall. Owned by the request.
+      std::vector<uint64_t>* keys;
+      // Number of earlier attempts to reinstall them.
+      int attempt;
+    } resync;
+  };
+};
+
+class OvsP4rtDevice;
+
+// Session state shared by the shards of a device.
+//
+// A connection is immutable once established. When the pipeline changes,
+// the device replaces it with a new one (see OvsP4rtDevice), so requests
+// never need to check that the P4Info they use is current.
+struct DeviceConnection {
+  std::unique_ptr<OvsP4rtSession> session;
+  ::p4::config::v1::P4Info p4info;
+  uint64_t cookie = 0;
+};
+
+// A worker shard of a device.
+//
+// Each shard owns part of the key space of its device and has a worker
+// thread that applies the requests for those keys. MAC learns are queued
+// separately and applied after all other requests, subject to admission
+// control (see AdmissionController); everything else is applied in the
+// order it was submitted. Learns that are not admitted are deferred: the
+// latest learn of each MAC is kept and retried periodically, until it is
+// admitted or a delete of the MAC cancels it. Learns queued back to back
+// are written together (see --learn_batch_size).
+class OvsP4rtShard {
+ public:
+  OvsP4rtShard(OvsP4rtDevice* device, int index);
+  ~OvsP4rtShard();
+
+  // Disable copy semantics.
+  OvsP4rtShard(const OvsP4rtShard&) = delete;
+  OvsP4rtShard& operator=(const OvsP4rtShard&) = delete;
+
+  OvsP4rtDevice* device() const { return device_; }
+  int index() const { return index_; }
+
+  // Queues a request for the worker thread.
+  void Submit(const OvsP4rtRequest& request);
+
+  // Removes the request the worker would apply next and copies it to
+  // *request if it satisfies the predicate. Returns true if it did.
+  bool PopNextIf(absl::FunctionRef<bool(const OvsP4rtRequest&)> pred,
+                 OvsP4rtRequest* request);
+
+  // Blocks until all queued requests have been applied.
+  void Drain();
+
+ private:
+  struct QueuedRequest {
+    uint64_t seq;
+    OvsP4rtRequest request;
+  };
+
+  void WorkerLoop();
+
+  // Cancels the learns of a MAC that are queued before seq or deferred.
+  void SupersedeLearnsLocked(uint64_t key, uint64_t seq)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Queues a learn if the admission limits allow it. Otherwise, keeps it
+  // as the deferred learn of its MAC. Returns true if it was queued.
+  bool AdmitLearnLocked(const QueuedRequest& learn, bool retry)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Queues the deferred learns that are admitted now, at most once per
+  // retry interval.
+  void RetryDeferredLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Returns the queue holding the request to apply next, or nullptr if
+  // both are empty. Drops queued learns that were superseded by a delete.
+  std::deque<QueuedRequest>* NextQueue() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Removes the next request if it satisfies the predicate and, for a
+  // learn, a learn token is available. Otherwise, sets *wait to the time
+  // until the next token if the learn was throttled.
+  bool PopNextLocked(absl::FunctionRef<bool(const OvsP4rtRequest&)> pred,
+                     OvsP4rtRequest* request, absl::Duration* wait)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  bool IsIdle() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return priority_queue_.empty() && learn_queue_.empty() &&
+           deferred_.empty() && !busy_;
+  }
+
+  OvsP4rtDevice* const device_;
+  const int index_;
+
+  ::absl::Mutex mu_;
+  ::absl::CondVar cond_;
+  std::deque<QueuedRequest> priority_queue_ ABSL_GUARDED_BY(mu_);
+  std::deque<QueuedRequest> learn_queue_ ABSL_GUARDED_BY(mu_);
+  // Sequence number of the latest delete of each MAC that may still have
+  // learns queued, keyed by shadow key.
+  absl::flat_hash_map<uint64_t, uint64_t> superseded_ ABSL_GUARDED_BY(mu_);
+  // Latest learn of each MAC that was not admitted, keyed by shadow key.
+  absl::flat_hash_map<uint64_t, QueuedRequest> deferred_ ABSL_GUARDED_BY(mu_);
+  ::absl::Time next_retry_ ABSL_GUARDED_BY(mu_) = ::absl::InfinitePast();
+  uint64_t next_seq_ ABSL_GUARDED_BY(mu_) = 0;
+  bool busy_ ABSL_GUARDED_BY(mu_) = false;
+  bool shutdown_ ABSL_GUARDED_BY(mu_) = false;
+
+  std::thread worker_;
+};
+
+// A P4Runtime device (pipeline) programmed by ovs-p4rt.
+//
+// Each device owns a long-lived session, a cached copy of the P4Info of
+// the pipeline it is running, the shadow of the entries it has installed,
+// and a set of worker shards. FDB requests are spread over the shards by
+// a hash of (bridge_id, MAC), so requests for the same MAC stay ordered
+// while different MACs are programmed in parallel over the shared session.
+// All other requests go to the first shard. If a snapshot path is given,
+// the shadow is persisted there and reloaded when the device is created.
+// The snapshot is only trusted once the device has connected: it is
+// discarded if it was taken on another pipeline, and the entries it lists
+// that the tables read back do not hold are reinstalled.
+// Once connected, the device checks its connection periodically (see
+// --health_check_interval_ms) and reconnects once it has failed.
+//
+// A watcher thread reads the stream channel of the session. If the stream
+// ends (the server restarted or reloaded), or if mastership comes back
+// after another controller held it and the pipeline cookie has changed
+// (p4rt-ctl set-pipe, for example), the device replaces its connection. Its
+// shards reinstall the entries of the shadow on a new pipeline, or the
+// ones the tables no longer hold on the same one.
+class OvsP4rtDevice {
+ public:
+  OvsP4rtDevice(uint32_t device_id, const std::string& grpc_addr,
+                const std::string& snapshot_path = "", int num_shards = 1);
+  ~OvsP4rtDevice();
+
+  // Disable copy semantics.
+  OvsP4rtDevice(const OvsP4rtDevice&) = delete;
+  OvsP4rtDevice& operator=(const OvsP4rtDevice&) = delete;
+
+  uint32_t DeviceId() const { return device_id_; }
+
+  // Queues a request for the shard that owns its key.
+  void Submit(const OvsP4rtRequest& request);
+
+  // Returns the shard that owns the specified shadow key.
+  OvsP4rtShard* ShardForKey(uint64_t key);
+
+  const std::vector<std::unique_ptr<OvsP4rtShard>>& Shards() const {
+    return shards_;
+  }
+
+  // Blocks until all queued requests have been applied.
+  void Drain();
+
+  // Returns the device connection, establishing the session and fetching
+  // the P4Info if necessary. Thread-safe; concurrent callers wait for the
+  // connection one of them establishes. Checking the shadow against the
+  // new connection is left to the resync thread.
+  ::absl::StatusOr<std::shared_ptr<const DeviceConnection>> Connect();
+
+  // Returns the shadow of the entries installed on the device. Shards may
+  // only modify the entries for the keys they own.
+  ShadowTable* Shadow() { return &shadow_; }
+
+  // Returns the filter of the MACs learned on tunnels on the device.
+  TunnelMacFilter* TunnelMacs() { return &tunnel_macs_; }
+
+  // Drops the connection if it is still the current one, so the next
+  // request reconnects and refreshes the P4Info. The server may have lost
+  // its tables, so the next connection reads them back and reinstalls the
+  // entries of the shadow they do not hold, or all of them if the pipeline
+  // changed.
+  void ResetConnection(const DeviceConnection* connection);
+
+ private:
+  // Checks the connection at every interval and re-establishes it if it
+  // was lost, so that requests do not wait for the reconnection.
+  void HealthLoop(::absl::Duration interval);
+
+  // Reads the stream channel of each connection in turn, and resyncs when
+  // it ends or the pipeline changes.
+  void WatchLoop();
+
+  // Reads back the tables of each new connection that needs its shadow
+  // checked, and has the shards reinstall the entries they do not hold.
+  void ResyncLoop();
+
+  // Returns true if the pipeline has changed since the connection was
+  // established.
+  bool PipelineChanged(const DeviceConnection& connection);
+
+  // Replaces the connection, if it is still the current one, and has the
+  // shards reinstall the entries the device lost through the new one.
+  void Resync(const DeviceConnection* connection, ::absl::string_view reason);
+
+  // Has the shards reinstall the entries with the specified shadow keys.
+  void ReinstallEntries(const std::vector<uint64_t>& keys);
+
+  const uint32_t device_id_;
+  const std::string grpc_addr_;
+  ShadowTable shadow_;
+  TunnelMacFilter tunnel_macs_;
+
+  ::absl::Mutex mu_;
+  std::shared_ptr<const DeviceConnection> connection_ ABSL_GUARDED_BY(mu_);
+  // Whether the shadow loaded from the snapshot was checked against the
+  // device yet.
+  bool snapshot_checked_ ABSL_GUARDED_BY(mu_) = false;
+  // Whether the next connection checks the shadow against the device.
+  bool check_shadow_ ABSL_GUARDED_BY(mu_) = true;
+  // Whether a thread is establishing a connection.
+  bool connecting_ ABSL_GUARDED_BY(mu_) = false;
+  // Connection whose shadow the resync thread checks next, and whether it
+  // reinstalls all the entries of the shadow rather than the missing ones.
+  std::shared_ptr<const DeviceConnection> resync_connection_
+      ABSL_GUARDED_BY(mu_);
+  bool resync_all_ ABSL_GUARDED_BY(mu_) = false;
+  bool stopping_ ABSL_GUARDED_BY(mu_) = false;
+
+  std::vector<std::unique_ptr<OvsP4rtShard>> shards_;
+
+  ::absl::Notification stop_health_;
+  std::thread health_thread_;
+  std::thread watch_thread_;
+  std::thread resync_thread_;
+};
+
+// Maps OVS bridges to the P4Runtime devices that program them.
+//
+// The mapping is read from the --bridge_device_map flag. Bridges that are
+// not listed are programmed through the device given by --device_id.
+// If --shadow_snapshot_dir is set, each device keeps its shadow in a file
+// in that directory. Each device has --worker_shards shards.
+class OvsP4rtDeviceRegistry {
+ public:
+  static OvsP4rtDeviceRegistry& Instance();
+
+  // Returns the device for the specified bridge, creating it on first use.
+  OvsP4rtDevice* DeviceForBridge(uint8_t bridge_id);
+
+  // Returns the device used for requests that are not bridge-specific.
+  OvsP4rtDevice* DefaultDevice();
+
+  // Returns the devices that have been created so far.
+  std::vector<OvsP4rtDevice*> Devices();
+
+ private:
+  OvsP4rtDeviceRegistry();
+
+  OvsP4rtDevice* GetOrCreateDevice(uint32_t device_id)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const std::string grpc_addr_;
+  const std::string snapshot_dir_;
+  const uint32_t default_device_id_;
+  const int num_shards_;
+  absl::flat_hash_map<uint8_t, uint32_t> bridge_to_device_;
+
+  ::absl::Mutex mu_;
+  absl::flat_hash_map<uint32_t, std::unique_ptr<OvsP4rtDevice>> devices_
+      ABSL_GUARDED_BY(mu_);
+};
+
+// The keys of the shadow of a device, split by the shard that owns them.
+//
+// The shards of a device reconcile concurrently, each against its own
+// keys. Rather than have each of them walk the whole shadow, the last
+// shard to start splits it once for all of them. By then, every shard has
+// applied the requests submitted before the reconciliation, so the shadow
+// does not change until the shards resume.
+class ShadowPartition {
+ public:
+  explicit ShadowPartition(OvsP4rtDevice* device);
+
+  // Disable copy semantics.
+  ShadowPartition(const ShadowPartition&) = delete;
+  ShadowPartition& operator=(const ShadowPartition&) = delete;
+
+  // Returns the shadow keys owned by the shard. Blocks until every shard
+  // of the device has called it.
+  const std::vector<uint64_t>& KeysOf(OvsP4rtShard* shard);
+
+  // Lets the other shards go on without this one, which does not take
+  // part in the reconciliation.
+  void Skip();
+
+ private:
+  void ArriveLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  OvsP4rtDevice* const device_;
+  ::absl::Mutex mu_;
+  int remaining_ ABSL_GUARDED_BY(mu_);
+  std::vector<std::vector<uint64_t>> keys_ ABSL_GUARDED_BY(mu_);
+};
+
+// Parses a bridge-to-device map of the form "bridge:device[,bridge:device]".
+::absl::StatusOr<absl::flat_hash_map<uint8_t, uint32_t>> ParseBridgeDeviceMap(
+    const std::string& map_str);
+
+// Applies a request on a shard of its device. Defined in ovs_p4rt.cc.
+void ProcessRequest(OvsP4rtShard* shard, const OvsP4rtRequest& request);
+
+// Reads back the tables of the entries in the shadow, and adds the keys of
+// the entries that are not fully installed to *missing. Defined in
+// ovs_p4rt.cc.
+::absl::Status FindMissingEntries(const DeviceConnection& connection,
+                                  ShadowTable* shadow,
+                                  std::vector<uint64_t>* missing);
+
+}  // namespace ovs_p4rt
+
+#endif  // OVSP4RT_DEVICE_H_
@@ -0,0 +1,118 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ovs_p4rt_epoch.h"
+
+#include <utility>
+#include <vector>
+
+namespace ovs_p4rt {
+
+namespace {
+
+// Number of retired objects that triggers an attempt to free them, so
+// the cost of scanning the readers is shared by many retirements.
+constexpr size_t kReclaimBatch = 64;
+
+}  // namespace
+
+// Releases the record of a thread when it exits.
+struct EpochDomain::LocalHolder {
+  ThreadRecord* record = nullptr;
+
+  ~LocalHolder() {
+    if (record == nullptr) return;
+    record->epoch.store(0);
+    record->depth = 0;
+    record->in_use.store(false);
+  }
+};
+
+EpochDomain& EpochDomain::Instance() {
+  // Retired objects may be freed by any thread until the process exits.
+  static EpochDomain* domain = new EpochDomain();
+  return *domain;
+}
+
+EpochDomain::ThreadRecord* EpochDomain::LocalRecord() {
+  thread_local LocalHolder holder;
+  if (holder.record != nullptr) return holder.record;
+
+  // Reuse the record of a thread that has exited, if any.
+  for (ThreadRecord* record = records_.load(); record != nullptr;
+       record = record->next) {
+    bool in_use = false;
+    if (!record->in_use.load() &&
+        record->in_use.compare_exchange_strong(in_use, true)) {
+      holder.record = record;
+      return record;
+    }
+  }
+
+  auto* record = new ThreadRecord();
+  record->in_use.store(true);
+  record->next = records_.load();
+  while (!records_.compare_exchange_weak(record->next, record)) {
+  }
+  holder.record = record;
+  return record;
+}
+
+void EpochDomain::Enter() {
+  ThreadRecord* record = LocalRecord();
+  if (record->depth++ > 0) return;
+
+  // A stale epoch is harmless: it only holds back reclamation until the
+  // guard is left. The store is sequentially consistent so that it is
+  // ordered before the loads of the objects it protects.
+  record->epoch.store(global_epoch_.load());
+}
+
+void EpochDomain::Exit() {
+  ThreadRecord* record = LocalRecord();
+  if (--record->depth > 0) return;
+  record->epoch.store(0, std::memory_order_release);
+}
+
+EpochDomain::ReadGuard::ReadGuard() { EpochDomain::Instance().Enter(); }
+
+EpochDomain::ReadGuard::~ReadGuard() { EpochDomain::Instance().Exit(); }
+
+void EpochDomain::TryAdvance() {
+  const uint64_t epoch = global_epoch_.load();
+  for (ThreadRecord* record = records_.load(); record != nullptr;
+       record = record->next) {
+    const uint64_t observed = record->epoch.load();
+    if (observed != 0 && observed != epoch) return;
+  }
+  global_epoch_.store(epoch + 1);
+}
+
+void EpochDomain::Retire(std::function<void()> deleter) {
+  std::vector<std::function<void()>> expired;
+  {
+    absl::MutexLock lock(&mu_);
+    retired_.push_back({global_epoch_.load(), std::move(deleter)});
+    if (retired_.size() < kReclaimBatch) return;
+    TryAdvance();
+
+    // Readers inside a guard have observed at least the previous epoch,
+    // so objects retired two epochs ago can no longer be reached.
+    const uint64_t epoch = global_epoch_.load();
+    size_t kept = 0;
+    for (size_t i = 0; i < retired_.size(); i++) {
+      if (retired_[i].epoch + 2 <= epoch) {
+        expired.push_back(std::move(retired_[i].deleter));
+      } else if (kept++ != i) {
+        retired_[kept - 1] = std::move(retired_[i]);
+      }
+    }
+    retired_.resize(kept);
+  }
+
+  for (auto& deleter : expired) {
+    deleter();
+  }
+}
+
+}  // namespace ovs_p4rt
@@ -0,0 +1,92 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OVSP4RT_EPOCH_H_
+#define OVSP4RT_EPOCH_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+namespace ovs_p4rt {
+
+// Epoch-based reclamation for lock-free readers.
+//
+// Readers access shared objects inside a ReadGuard. Writers unlink an
+// object and Retire() it; it is freed once every reader that could still
+// see it has left its guard. Entering and leaving a guard is a pair of
+// stores, so readers never wait for writers or for each other.
+class EpochDomain {
+ public:
+  static EpochDomain& Instance();
+
+  // Disable copy semantics.
+  EpochDomain(const EpochDomain&) = delete;
+  EpochDomain& operator=(const EpochDomain&) = delete;
+
+  // Read-side critical section. Guards may be nested.
+  class ReadGuard {
+   public:
+    ReadGuard();
+    ~ReadGuard();
+
+    // Disable copy semantics.
+    ReadGuard(const ReadGuard&) = delete;
+    ReadGuard& operator=(const ReadGuard&) = delete;
+  };
+
+  // Runs deleter once no reader can hold a reference to the retired
+  // object.
+  void Retire(std::function<void()> deleter);
+
+  // Deletes an object once no reader can hold a reference to it.
+  template <typename T>
+  void RetireObject(const T* object) {
+    Retire([object] { delete object; });
+  }
+
+ private:
+  // Per-thread reader state. Records are never freed; the record of a
+  // thread that exits is reused by the next thread that needs one.
+  struct ThreadRecord {
+    // Epoch observed when the current guard was entered, 0 if the thread
+    // is outside any guard.
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<bool> in_use{false};
+    ThreadRecord* next = nullptr;
+    int depth = 0;
+  };
+
+  struct LocalHolder;
+
+  struct Retired {
+    uint64_t epoch;
+    std::function<void()> deleter;
+  };
+
+  EpochDomain() = default;
+
+  ThreadRecord* LocalRecord();
+  void Enter();
+  void Exit();
+
+  // Advances the global epoch if every active reader has observed the
+  // current one.
+  void TryAdvance() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  std::atomic<uint64_t> global_epoch_{1};
+  std::atomic<ThreadRecord*> records_{nullptr};
+
+  absl::Mutex mu_;
+  std::vector<Retired> retired_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace ovs_p4rt
+
+#endif  // OVSP4RT_EPOCH_H_
@@ -0,0 +1,92 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ovs_p4rt_options.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/flags/reflection.h"
+#include "absl/strings/strip.h"
+#include "absl/strings/string_view.h"
+
+namespace ovs_p4rt {
+
+namespace {
+
+// The flags of ovs-p4rt that may be set as options. Other flags linked
+// into ovs-vswitchd, such as those of gRPC, may not.
+const absl::flat_hash_set<std::string>& OptionNames() {
+  static const auto* names = new absl::flat_hash_set<std::string>({
+      // Devices (ovs_p4rt_device.cc).
+      "grpc_addr",
+      "device_id",
+      "bridge_device_map",
+      "worker_shards",
+      "tunnel_mac_filter_size",
+      "grpc_max_message_bytes",
+      "grpc_keepalive_time_ms",
+      "grpc_keepalive_timeout_ms",
+      "grpc_initial_window_bytes",
+      "grpc_write_buffer_bytes",
+      "grpc_buffer_pool_bytes",
+      "health_check_interval_ms",
+      "shadow_snapshot_dir",
+      // Batching (ovs_p4rt.cc).
+      "write_batch_size",
+      "learn_batch_size",
+      // Learn admission (ovs_p4rt_admission.cc).
+      "learn_rate_limit",
+      "learn_burst",
+      "bridge_learn_rate_limit",
+      "bridge_learn_burst",
+      "learn_queue_limit",
+      // Worker placement (ovs_p4rt_placement.cc).
+      "worker_cpus",
+      "worker_numa_node",
+      "worker_sched_policy",
+      "worker_sched_priority",
+      // Tracing (ovs_p4rt_trace.cc).
+      "trace_file",
+      "trace_file_records",
+  });
+  return *names;
+}
+
+// Returns the flag name of an option: "p4rt-worker-shards" is
+// "worker_shards".
+std::string FlagName(absl::string_view name) {
+  absl::ConsumePrefix(&name, "p4rt-");
+  std::string flag_name(name);
+  std::replace(flag_name.begin(), flag_name.end(), '-', '_');
+  return flag_name;
+}
+
+}  // namespace
+
+}  // namespace ovs_p4rt
+
+bool SetOvsP4rtOption(const char* name, const char* value) {
+  using namespace ovs_p4rt;
+
+  const std::string flag_name = FlagName(name);
+  absl::CommandLineFlag* flag = nullptr;
+  if (OptionNames().contains(flag_name)) {
+    flag = absl::FindCommandLineFlag(flag_name);
+  }
+  if (flag == nullptr) {
+    printf("Unknown ovs-p4rt option '%s'\n", name);
+    return false;
+  }
+
+  std::string error;
+  if (!flag->ParseFrom(value, &error)) {
+    printf("Invalid value '%s' for ovs-p4rt option '%s': %s\n", value, name,
+           error.c_str());
+    return false;
+  }
+  return true;
+}
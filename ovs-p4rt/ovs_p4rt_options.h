@@ -0,0 +1,34 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// Configuration interface for OVS.
+//
+// ovs-vswitchd does not parse the command-line flags of ovs-p4rt, so the
+// options of the library are set through this interface instead, from the
+// other_config column of the Open_vSwitch table for example. See
+// docs/clients/ovs-p4rt.rst for the list of options.
+
+#ifndef OVSP4RT_OPTIONS_H_
+#define OVSP4RT_OPTIONS_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Sets an ovs-p4rt option. The name may be given with dashes or
+// underscores, and with or without a "p4rt-" prefix: "p4rt-worker-shards"
+// and "worker_shards" set the same option. Returns false, and leaves the
+// option unchanged, if the name is unknown or the value is invalid.
+//
+// Options are read when the state they configure is created, so they
+// must be set before the first entry is programmed. Only the batch sizes
+// may be changed at any time.
+extern bool SetOvsP4rtOption(const char* name, const char* value);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // OVSP4RT_OPTIONS_H_
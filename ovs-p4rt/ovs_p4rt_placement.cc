@@ -0,0 +1,171 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ovs_p4rt_placement.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
+
+ABSL_FLAG(std::string, worker_cpus, "",
+          "CPUs the device worker threads may run on, as a list such as "
+          "\"2-5,8\". Keep them off the CPUs of the OVS PMD threads and DPDK "
+          "lcores. Empty means any CPU.");
+ABSL_FLAG(int32_t, worker_numa_node, -1,
+          "NUMA node whose CPUs the device worker threads may run on. "
+          "Combined with --worker_cpus if both are set. -1 means any node.");
+ABSL_FLAG(std::string, worker_sched_policy, "other",
+          "Scheduling policy of the device worker threads: other, batch, "
+          "idle, fifo or rr.");
+ABSL_FLAG(int32_t, worker_sched_priority, 0,
+          "Scheduling priority of the device worker threads, for the fifo "
+          "and rr policies.");
+
+namespace ovs_p4rt {
+
+absl::StatusOr<std::vector<int>> ParseCpuList(absl::string_view list) {
+  std::vector<int> cpus;
+  for (absl::string_view range :
+       absl::StrSplit(absl::StripAsciiWhitespace(list), ',',
+                      absl::SkipEmpty())) {
+    std::vector<absl::string_view> bounds = absl::StrSplit(range, '-');
+    int first;
+    int last;
+    if (bounds.size() > 2 || !absl::SimpleAtoi(bounds[0], &first) ||
+        !absl::SimpleAtoi(bounds.back(), &last) || first < 0 ||
+        last < first || last >= CPU_SETSIZE) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid CPU range '", range, "'"));
+    }
+    for (int cpu = first; cpu <= last; cpu++) {
+      cpus.push_back(cpu);
+    }
+  }
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+  return cpus;
+}
+
+absl::StatusOr<std::vector<int>> NumaNodeCpus(int node) {
+  const std::string path =
+      absl::StrCat("/sys/devices/system/node/node", node, "/cpulist");
+  std::ifstream file(path);
+  if (!file) {
+    return absl::NotFoundError(absl::StrCat("No NUMA node ", node));
+  }
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return ParseCpuList(contents.str());
+}
+
+absl::StatusOr<int> ParseSchedPolicy(absl::string_view name) {
+  if (name == "other") return SCHED_OTHER;
+  if (name == "batch") return SCHED_BATCH;
+  if (name == "idle") return SCHED_IDLE;
+  if (name == "fifo") return SCHED_FIFO;
+  if (name == "rr") return SCHED_RR;
+  return absl::InvalidArgumentError(
+      absl::StrCat("Unknown scheduling policy '", name, "'"));
+}
+
+absl::StatusOr<ThreadPlacement> MakeThreadPlacement(
+    const std::string& cpu_list, int numa_node, const std::string& policy,
+    int priority) {
+  ThreadPlacement placement;
+
+  auto status_or_cpus = ParseCpuList(cpu_list);
+  if (!status_or_cpus.ok()) return status_or_cpus.status();
+  placement.cpus = std::move(status_or_cpus).value();
+
+  if (numa_node >= 0) {
+    auto status_or_node_cpus = NumaNodeCpus(numa_node);
+    if (!status_or_node_cpus.ok()) return status_or_node_cpus.status();
+    const std::vector<int>& node_cpus = status_or_node_cpus.value();
+
+    if (placement.cpus.empty()) {
+      placement.cpus = node_cpus;
+    } else {
+      std::vector<int> cpus;
+      std::set_intersection(placement.cpus.begin(), placement.cpus.end(),
+                            node_cpus.begin(), node_cpus.end(),
+                            std::back_inserter(cpus));
+      placement.cpus = std::move(cpus);
+    }
+    if (placement.cpus.empty()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("No CPU of NUMA node ", numa_node, " is listed"));
+    }
+  }
+
+  auto status_or_policy = ParseSchedPolicy(policy);
+  if (!status_or_policy.ok()) return status_or_policy.status();
+  placement.policy = status_or_policy.value();
+
+  const int min_priority = sched_get_priority_min(placement.policy);
+  const int max_priority = sched_get_priority_max(placement.policy);
+  if (priority < min_priority || priority > max_priority) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Priority ", priority, " is out of range [",
+                     min_priority, ", ", max_priority, "] for '", policy,
+                     "'"));
+  }
+  placement.priority = priority;
+  return placement;
+}
+
+absl::Status ApplyThreadPlacement(const ThreadPlacement& placement) {
+  if (!placement.cpus.empty()) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int cpu : placement.cpus) {
+      CPU_SET(cpu, &cpu_set);
+    }
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set),
+                                     &cpu_set);
+    if (err != 0) {
+      return absl::InternalError(
+          absl::StrCat("Unable to set CPU affinity: ", strerror(err)));
+    }
+  }
+
+  struct sched_param param = {};
+  param.sched_priority = placement.priority;
+  int err = pthread_setschedparam(pthread_self(), placement.policy, &param);
+  if (err != 0) {
+    return absl::InternalError(
+        absl::StrCat("Unable to set scheduling policy: ", strerror(err)));
+  }
+  return absl::OkStatus();
+}
+
+const ThreadPlacement& WorkerPlacement() {
+  static const ThreadPlacement* placement = [] {
+    auto status_or_placement = MakeThreadPlacement(
+        absl::GetFlag(FLAGS_worker_cpus), absl::GetFlag(FLAGS_worker_numa_node),
+        absl::GetFlag(FLAGS_worker_sched_policy),
+        absl::GetFlag(FLAGS_worker_sched_priority));
+    if (!status_or_placement.ok()) {
+      printf("Ignoring worker thread placement: %s\n",
+             std::string(status_or_placement.status().message()).c_str());
+      return new ThreadPlacement();
+    }
+    return new ThreadPlacement(std::move(status_or_placement).value());
+  }();
+  return *placement;
+}
+
+}  // namespace ovs_p4rt
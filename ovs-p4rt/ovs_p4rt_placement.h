@@ -0,0 +1,53 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OVSP4RT_PLACEMENT_H_
+#define OVSP4RT_PLACEMENT_H_
+
+#include <sched.h>
+
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+
+namespace ovs_p4rt {
+
+// Where a thread runs: the CPUs it may use and its scheduling class.
+struct ThreadPlacement {
+  std::vector<int> cpus;  // empty means any CPU
+  int policy = SCHED_OTHER;
+  int priority = 0;  // for SCHED_FIFO and SCHED_RR
+};
+
+// Parses a CPU list such as "2-5,8" (the format of the kernel's cpulist
+// files and of taskset -c).
+::absl::StatusOr<std::vector<int>> ParseCpuList(absl::string_view list);
+
+// Returns the CPUs of a NUMA node.
+::absl::StatusOr<std::vector<int>> NumaNodeCpus(int node);
+
+// Parses a scheduling policy name: other, batch, idle, fifo or rr.
+::absl::StatusOr<int> ParseSchedPolicy(absl::string_view name);
+
+// Builds a placement from its configuration. If both a CPU list and a
+// NUMA node are given, the thread may use the listed CPUs of that node.
+// A negative node means any node.
+::absl::StatusOr<ThreadPlacement> MakeThreadPlacement(
+    const std::string& cpu_list, int numa_node, const std::string& policy,
+    int priority);
+
+// Applies a placement to the calling thread. Threads it creates later
+// (including the ones gRPC starts) inherit the CPU affinity.
+::absl::Status ApplyThreadPlacement(const ThreadPlacement& placement);
+
+// Placement of the device worker threads, from the --worker_cpus,
+// --worker_numa_node, --worker_sched_policy and --worker_sched_priority
+// flags. Invalid settings are reported and ignored.
+const ThreadPlacement& WorkerPlacement();
+
+}  // namespace ovs_p4rt
+
+#endif  // OVSP4RT_PLACEMENT_H_
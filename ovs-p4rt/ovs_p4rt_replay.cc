@@ -0,0 +1,217 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// Replays a trace captured with --trace_file through the ovs-p4rt sidecar.
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "openvswitch/ovs-p4rt.h"
+#include "ovs_p4rt_admission.h"
+#include "ovs_p4rt_bulk.h"
+#include "ovs_p4rt_device.h"
+#include "ovs_p4rt_trace.h"
+
+ABSL_FLAG(std::string, replay_file, "", "Trace file to replay.");
+ABSL_FLAG(double, speed, 1.0,
+          "Replay speed relative to the capture, e.g. 10 for ten times "
+          "faster. 0 replays the requests as fast as possible.");
+
+namespace {
+
+// Calls the C function through which OVS made the request.
+void ReplayRequest(const ovs_p4rt::OvsP4rtRequest& request) {
+  using ovs_p4rt::RequestType;
+
+  switch (request.type) {
+    case RequestType::kFdb:
+      ConfigFdbTableEntry(request.learn_info, request.insert_entry);
+      break;
+    case RequestType::kTunnel:
+      ConfigTunnelTableEntry(request.tunnel_info, request.insert_entry);
+      break;
+    case RequestType::kIpTunnelTerm:
+      ConfigIpTunnelTermTableEntry(request.tunnel_info, request.insert_entry);
+      break;
+    case RequestType::kRxTunnelSrc:
+      ConfigRxTunnelSrcTableEntry(request.tunnel_info, request.insert_entry);
+      break;
+    case RequestType::kTunnelSrcPort:
+      ConfigTunnelSrcPortTableEntry(request.sp_info, request.insert_entry);
+      break;
+    case RequestType::kSrcPort:
+      ConfigSrcPortTableEntry(request.sp_info, request.insert_entry);
+      break;
+    case RequestType::kVlan:
+      ConfigVlanTableEntry(request.vlan_id, request.insert_entry);
+      break;
+    default:
+      break;
+  }
+}
+
+// Calls the bulk C function through which OVS programmed a set of entries.
+void ReplayBatch(const ovs_p4rt::OvsP4rtRequest& bulk,
+                 const std::vector<ovs_p4rt::OvsP4rtRequest>& entries) {
+  using ovs_p4rt::RequestType;
+
+  std::vector<struct mac_learning_info> fdb_entries;
+  std::vector<struct tunnel_info> tunnels;
+  std::vector<uint16_t> vlans;
+  std::vector<struct src_port_info> src_ports;
+  std::vector<struct src_port_info> tunnel_src_ports;
+  for (const auto& entry : entries) {
+    switch (entry.type) {
+      case RequestType::kFdb:
+        fdb_entries.push_back(entry.learn_info);
+        break;
+      case RequestType::kTunnel:
+        tunnels.push_back(entry.tunnel_info);
+        break;
+      case RequestType::kVlan:
+        vlans.push_back(entry.vlan_id);
+        break;
+      case RequestType::kSrcPort:
+        src_ports.push_back(entry.sp_info);
+        break;
+      case RequestType::kTunnelSrcPort:
+        tunnel_src_ports.push_back(entry.sp_info);
+        break;
+      default:
+        break;
+    }
+  }
+
+  switch (bulk.type) {
+    case RequestType::kReconcile: {
+      struct p4_desired_state desired = {};
+      desired.fdb_entries = fdb_entries.data();
+      desired.n_fdb_entries = fdb_entries.size();
+      desired.tunnels = tunnels.data();
+      desired.n_tunnels = tunnels.size();
+      desired.vlans = vlans.data();
+      desired.n_vlans = vlans.size();
+      desired.src_ports = src_ports.data();
+      desired.n_src_ports = src_ports.size();
+      desired.tunnel_src_ports = tunnel_src_ports.data();
+      desired.n_tunnel_src_ports = tunnel_src_ports.size();
+      ReconcileTableEntries(&desired);
+      break;
+    }
+    case RequestType::kTunnelBatch:
+      ConfigTunnelTableEntries(tunnels.data(), tunnels.size(),
+                               bulk.insert_entry, nullptr);
+      break;
+    case RequestType::kEntryBatch:
+      // The entries of a batch are all of one kind.
+      if (!fdb_entries.empty()) {
+        ConfigFdbTableEntries(fdb_entries.data(), fdb_entries.size(),
+                              bulk.insert_entry, nullptr);
+      }
+      if (!vlans.empty()) {
+        ConfigVlanTableEntries(vlans.data(), vlans.size(), bulk.insert_entry,
+                               nullptr);
+      }
+      if (!src_ports.empty()) {
+        ConfigSrcPortTableEntries(src_ports.data(), src_ports.size(),
+                                  bulk.insert_entry, nullptr);
+      }
+      if (!tunnel_src_ports.empty()) {
+        ConfigTunnelSrcPortTableEntries(tunnel_src_ports.data(),
+                                        tunnel_src_ports.size(),
+                                        bulk.insert_entry, nullptr);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+
+  const std::string replay_file = absl::GetFlag(FLAGS_replay_file);
+  if (replay_file.empty()) {
+    printf("Usage: %s --replay_file=<trace> [--speed=<factor>]\n", argv[0]);
+    return 1;
+  }
+
+  auto status_or_records = ovs_p4rt::ReadTrace(replay_file);
+  if (!status_or_records.ok()) {
+    printf("%s\n", std::string(status_or_records.status().message()).c_str());
+    return 1;
+  }
+
+  const std::vector<ovs_p4rt::TraceRecord>& records =
+      status_or_records.value();
+  if (records.empty()) {
+    printf("%s holds no requests\n", replay_file.c_str());
+    return 0;
+  }
+
+  const double speed = absl::GetFlag(FLAGS_speed);
+  const uint64_t first_ns = records.front().timestamp_ns;
+  const absl::Time start = absl::Now();
+
+  // Bulk requests whose entries were overwritten, and entries whose bulk
+  // request was, are skipped.
+  size_t skipped = 0;
+  for (size_t i = 0; i < records.size();) {
+    const ovs_p4rt::TraceRecord& record = records[i++];
+    std::vector<ovs_p4rt::OvsP4rtRequest> entries;
+    while (i < records.size() && records[i].batch_seq == record.seq &&
+           records[i].seq != record.seq) {
+      entries.push_back(records[i++].request);
+    }
+    const bool is_bulk = ovs_p4rt::IsBulkRequest(record.request.type);
+    if (record.batch_seq != record.seq ||
+        (is_bulk && entries.size() != record.n_entries)) {
+      skipped += 1 + entries.size();
+      continue;
+    }
+
+    if (speed > 0) {
+      const absl::Time due =
+          start + absl::Nanoseconds((record.timestamp_ns - first_ns) / speed);
+      absl::SleepFor(due - absl::Now());
+    }
+    if (is_bulk) {
+      ReplayBatch(record.request, entries);
+    } else {
+      ReplayRequest(record.request);
+    }
+  }
+  const absl::Duration submit_time = absl::Now() - start;
+
+  for (auto* device : ovs_p4rt::OvsP4rtDeviceRegistry::Instance().Devices()) {
+    device->Drain();
+  }
+  const absl::Duration total_time = absl::Now() - start;
+
+  printf("Replayed %zu requests (seq %" PRIu64 " to %" PRIu64
+         "), skipped %zu of incomplete bulk requests\n",
+         records.size() - skipped, records.front().seq, records.back().seq,
+         skipped);
+  printf("Submitted in %.3f s, applied in %.3f s (%.0f requests/s)\n",
+         absl::ToDoubleSeconds(submit_time), absl::ToDoubleSeconds(total_time),
+         records.size() / absl::ToDoubleSeconds(total_time));
+
+  const ovs_p4rt::AdmissionStats stats =
+      ovs_p4rt::AdmissionController::Instance().Stats();
+  printf("MAC learns: %" PRIu64 " admitted, %" PRIu64 " deferred (%" PRIu64
+         " over the bridge rate, %" PRIu64 " with a full queue), %" PRIu64
+         " dropped, %" PRIu64 " superseded, %" PRIu64 " token waits\n",
+         stats.admitted, stats.deferred_bridge_rate + stats.deferred_queue_full,
+         stats.deferred_bridge_rate, stats.deferred_queue_full, stats.dropped,
+         stats.superseded, stats.throttled);
+  return 0;
+}
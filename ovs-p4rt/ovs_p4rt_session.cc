@@ -6,11 +6,14 @@
 #include "ovs_p4rt_session.h"
 
 #include <string>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "google/rpc/status.pb.h"
 #include "grpcpp/channel.h"
 #include "grpcpp/create_channel.h"
+#include "grpcpp/resource_quota.h"
 #include "p4/v1/p4runtime.grpc.pb.h"
 #include "p4/v1/p4runtime.pb.h"
 
@@ -38,13 +41,77 @@ absl::Status GrpcStatusToAbslStatus(const grpc::Status& status) {
                       status.error_message());
 }
 
+// Returns, for each update of a failed WriteRequest, its status code.
+// The server reports one p4.v1.Error per update in the status details;
+// without them, all updates are assumed to have failed with the status
+// of the request.
+std::vector<absl::StatusCode> UpdateStatusCodes(const grpc::Status& status,
+                                                int num_updates) {
+  std::vector<absl::StatusCode> codes(
+      num_updates, static_cast<absl::StatusCode>(status.error_code()));
+  google::rpc::Status details;
+  if (!details.ParseFromString(status.error_details()) ||
+      details.details_size() != num_updates) {
+    return codes;
+  }
+  for (int i = 0; i < num_updates; i++) {
+    ::p4::v1::Error error;
+    if (details.details(i).UnpackTo(&error)) {
+      codes[i] = static_cast<absl::StatusCode>(error.canonical_code());
+    }
+  }
+  return codes;
+}
+
+// Create P4Runtime channel.
+std::shared_ptr<grpc::Channel> CreateP4RuntimeChannel(
+    const std::string& address,
+    const std::shared_ptr<grpc::ChannelCredentials>& credentials,
+    const ChannelOptions& options) {
+  grpc::ChannelArguments args;
+  if (options.max_message_bytes > 0) {
+    args.SetMaxSendMessageSize(options.max_message_bytes);
+    args.SetMaxReceiveMessageSize(options.max_message_bytes);
+  }
+  if (options.keepalive_time_ms > 0) {
+    // Pings are only sent while a call is open, such as the stream
+    // channel, and within the limits gRPC puts on pings without data. A
+    // server that gets pings more often than it allows (every 5 minutes
+    // by default) closes the connection with GOAWAY too_many_pings.
+    args.SetInt(GRPC_ARG_KEEPALIVE_TIME_MS, options.keepalive_time_ms);
+  }
+  if (options.keepalive_timeout_ms > 0) {
+    args.SetInt(GRPC_ARG_KEEPALIVE_TIMEOUT_MS, options.keepalive_timeout_ms);
+  }
+  if (options.initial_window_bytes > 0) {
+    args.SetInt(GRPC_ARG_HTTP2_STREAM_LOOKAHEAD_BYTES,
+                options.initial_window_bytes);
+  }
+  if (options.write_buffer_bytes > 0) {
+    args.SetInt(GRPC_ARG_HTTP2_WRITE_BUFFER_SIZE, options.write_buffer_bytes);
+  }
+  if (options.buffer_pool_bytes > 0) {
+    grpc::ResourceQuota quota("ovs-p4rt");
+    quota.Resize(options.buffer_pool_bytes);
+    args.SetResourceQuota(quota);
+  }
+  return grpc::CreateCustomChannel(address, credentials, args);
+}
+
 // Create P4Runtime Stub.
 std::unique_ptr<P4Runtime::Stub> CreateP4RuntimeStub(
     const std::string& address,
-    const std::shared_ptr<grpc::ChannelCredentials>& credentials) {
-  grpc::ChannelArguments args;
+    const std::shared_ptr<grpc::ChannelCredentials>& credentials,
+    const ChannelOptions& options) {
   return P4Runtime::NewStub(
-      grpc::CreateCustomChannel(address, credentials, args));
+      CreateP4RuntimeChannel(address, credentials, options));
+}
+
+bool OvsP4rtSession::HasFailed() const {
+  if (!channel_) return false;
+  const grpc_connectivity_state state = channel_->GetState(false);
+  return state == GRPC_CHANNEL_TRANSIENT_FAILURE ||
+         state == GRPC_CHANNEL_SHUTDOWN;
 }
 
 // Creates a session with the switch, which lasts until the session object is
@@ -88,7 +155,8 @@ absl::StatusOr<std::unique_ptr<OvsP4rtSession>> OvsP4rtSession::Create(
 absl::StatusOr<std::unique_ptr<OvsP4rtSession>> OvsP4rtSession::Create(
     const std::string& address,
     const std::shared_ptr<grpc::ChannelCredentials>& credentials,
-    uint32_t device_id, absl::uint128 election_id) {
+    uint32_t device_id, absl::uint128 election_id,
+    const ChannelOptions& options) {
   /* OVS spawns multiple revalidator threads and handler threads to handle
    * datapath Notifications.
    * When multiple L2 MAC's are learnt at the same time, the learn information
@@ -102,12 +170,19 @@ absl::StatusOr<std::unique_ptr<OvsP4rtSession>> OvsP4rtSession::Create(
    * time.
    */
   election_id = election_id + (absl::uint128)pthread_self();
-  return Create(CreateP4RuntimeStub(address, credentials), device_id,
-                election_id);
+  std::shared_ptr<grpc::Channel> channel =
+      CreateP4RuntimeChannel(address, credentials, options);
+  auto status_or_session =
+      Create(P4Runtime::NewStub(channel), device_id, election_id);
+  if (status_or_session.ok()) {
+    status_or_session.value()->channel_ = std::move(channel);
+  }
+  return status_or_session;
 }
 
 absl::Status GetForwardingPipelineConfig(OvsP4rtSession* session,
-                                         p4::config::v1::P4Info* p4info) {
+                                         p4::config::v1::P4Info* p4info,
+                                         uint64_t* cookie) {
   GetForwardingPipelineConfigRequest request;
   request.set_device_id(session->DeviceId());
   request.set_response_type(
@@ -118,12 +193,31 @@ absl::Status GetForwardingPipelineConfig(OvsP4rtSession* session,
   absl::Status status =
       GrpcStatusToAbslStatus(session->Stub().GetForwardingPipelineConfig(
           &context, request, &response));
+  if (!status.ok()) return status;
 
   *p4info = response.config().p4info();
+  if (cookie != nullptr) *cookie = response.config().cookie().cookie();
 
   return absl::OkStatus();
 }
 
+absl::Status GetForwardingPipelineCookie(OvsP4rtSession* session,
+                                         uint64_t* cookie) {
+  GetForwardingPipelineConfigRequest request;
+  request.set_device_id(session->DeviceId());
+  request.set_response_type(GetForwardingPipelineConfigRequest::COOKIE_ONLY);
+
+  GetForwardingPipelineConfigResponse response;
+  grpc::ClientContext context;
+  absl::Status status =
+      GrpcStatusToAbslStatus(session->Stub().GetForwardingPipelineConfig(
+          &context, request, &response));
+  if (!status.ok()) return status;
+
+  *cookie = response.config().cookie().cookie();
+  return absl::OkStatus();
+}
+
 absl::StatusOr<ReadResponse> SendReadRequest(OvsP4rtSession* session,
                                              const ReadRequest& read_request) {
   grpc::ClientContext context;
@@ -188,4 +282,53 @@ absl::Status SendWriteRequest(OvsP4rtSession* session,
   return update->mutable_entity()->mutable_table_entry();
 }
 
+::p4::v1::TableEntry* WriteBatch::AddInsert(uint64_t tag) {
+  return Add(::p4::v1::Update::INSERT, tag);
+}
+
+::p4::v1::TableEntry* WriteBatch::AddModify(uint64_t tag) {
+  return Add(::p4::v1::Update::MODIFY, tag);
+}
+
+::p4::v1::TableEntry* WriteBatch::AddDelete(uint64_t tag) {
+  return Add(::p4::v1::Update::DELETE, tag);
+}
+
+::p4::v1::TableEntry* WriteBatch::Add(::p4::v1::Update::Type type,
+                                      uint64_t tag) {
+  if (request_.updates_size() >= max_updates_) {
+    Flush().IgnoreError();
+  }
+  if (request_.updates_size() == 0) {
+    request_.set_device_id(session_->DeviceId());
+    *request_.mutable_election_id() = session_->ElectionId();
+  }
+  auto* update = request_.add_updates();
+  update->set_type(type);
+  tags_.push_back(tag);
+  return update->mutable_entity()->mutable_table_entry();
+}
+
+absl::Status WriteBatch::Flush() {
+  if (request_.updates_size() == 0) return status_;
+
+  grpc::ClientContext context;
+  WriteResponse response;
+  grpc::Status status = session_->Stub().Write(&context, request_, &response);
+  ++num_requests_;
+  if (!status.ok()) {
+    std::vector<absl::StatusCode> codes =
+        UpdateStatusCodes(status, tags_.size());
+    for (size_t i = 0; i < tags_.size(); i++) {
+      if (codes[i] == absl::StatusCode::kOk || tags_[i] == 0) continue;
+      failed_tags_.push_back(tags_[i]);
+      errors_.push_back({tags_[i], request_.updates(i).type(), codes[i]});
+    }
+    if (status_.ok()) status_ = GrpcStatusToAbslStatus(status);
+  }
+  request_.Clear();
+  tags_.clear();
+  return status_;
+}
+
 }  // namespace ovs_p4rt
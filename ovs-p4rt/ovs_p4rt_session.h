@@ -12,6 +12,7 @@
 #include <memory>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
@@ -32,6 +33,24 @@ inline ::absl::uint128 TimeBasedElectionId() {
   return ::absl::MakeUint128(::absl::ToUnixSeconds(::absl::Now()), 0);
 }
 
+// Parameters of the gRPC channel to the P4Runtime server. Zero leaves a
+// parameter at its gRPC default.
+struct ChannelOptions {
+  // Largest message sent or received, such as a batched WriteRequest or a
+  // ReadResponse.
+  int max_message_bytes = 0;
+  // Interval of the HTTP/2 pings that check that the connection is alive,
+  // and how long to wait for their acknowledgement.
+  int keepalive_time_ms = 0;
+  int keepalive_timeout_ms = 0;
+  // Initial HTTP/2 flow-control window of each stream.
+  int initial_window_bytes = 0;
+  // Size of the HTTP/2 write buffer.
+  int write_buffer_bytes = 0;
+  // Memory that the channel's buffers may use in total.
+  size_t buffer_pool_bytes = 0;
+};
+
 class OvsP4rtSession {
  public:
   // Create the session with given P4runtime stub and device id
@@ -44,7 +63,8 @@ class OvsP4rtSession {
   static ::absl::StatusOr<std::unique_ptr<OvsP4rtSession>> Create(
       const std::string& address,
       const std::shared_ptr<grpc::ChannelCredentials>& credentials,
-      uint32_t device_id, ::absl::uint128 election_id = TimeBasedElectionId());
+      uint32_t device_id, ::absl::uint128 election_id = TimeBasedElectionId(),
+      const ChannelOptions& options = ChannelOptions());
 
   // Disable copy semantics.
   OvsP4rtSession(const OvsP4rtSession&) = delete;
@@ -60,6 +80,22 @@ class OvsP4rtSession {
 
   p4::v1::P4Runtime::Stub& Stub() { return *stub_; }
 
+  // Returns whether the connection to the server has failed or was shut
+  // down. A session whose connection failed has lost its stream channel
+  // (and mastership) with it, and must be recreated. An idle or connecting
+  // channel has not failed. Always false for sessions created from a stub.
+  bool HasFailed() const;
+
+  // Blocks until the server sends a message on the stream channel, such
+  // as an arbitration update. Returns false once the stream has ended.
+  // May be called from one thread at a time.
+  bool ReadStreamMessage(p4::v1::StreamMessageResponse* response) {
+    return stream_channel_->Read(response);
+  }
+
+  // Ends the stream channel, which makes ReadStreamMessage return false.
+  void CancelStream() { stream_channel_context_->TryCancel(); }
+
  private:
   OvsP4rtSession(uint32_t device_id,
                  std::unique_ptr<p4::v1::P4Runtime::Stub> stub,
@@ -76,6 +112,8 @@ class OvsP4rtSession {
 
   p4::v1::Uint128 election_id_;
 
+  std::shared_ptr<grpc::Channel> channel_;
+
   std::unique_ptr<p4::v1::P4Runtime::Stub> stub_;
 
   std::unique_ptr<grpc::ClientContext> stream_channel_context_;
@@ -85,9 +123,15 @@ class OvsP4rtSession {
       stream_channel_;
 };
 
+std::shared_ptr<grpc::Channel> CreateP4RuntimeChannel(
+    const std::string& address,
+    const std::shared_ptr<grpc::ChannelCredentials>& credentials,
+    const ChannelOptions& options = ChannelOptions());
+
 std::unique_ptr<p4::v1::P4Runtime::Stub> CreateP4RuntimeStub(
     const std::string& address,
-    const std::shared_ptr<grpc::ChannelCredentials>& credentials);
+    const std::shared_ptr<grpc::ChannelCredentials>& credentials,
+    const ChannelOptions& options = ChannelOptions());
 
 // Functions that operate on a OvsP4rtSession.
 
@@ -97,8 +141,16 @@ std::unique_ptr<p4::v1::P4Runtime::Stub> CreateP4RuntimeStub(
 ::absl::Status SendWriteRequest(OvsP4rtSession* session,
                                 const p4::v1::WriteRequest& write_request);
 
+// Fetches the P4Info of the pipeline and, if cookie is not null, the
+// cookie that identifies it.
 ::absl::Status GetForwardingPipelineConfig(OvsP4rtSession* session,
-                                           p4::config::v1::P4Info* p4info);
+                                           p4::config::v1::P4Info* p4info,
+                                           uint64_t* cookie = nullptr);
+
+// Fetches the cookie of the pipeline, which changes when another
+// pipeline is loaded.
+::absl::Status GetForwardingPipelineCookie(OvsP4rtSession* session,
+                                           uint64_t* cookie);
 
 ::p4::v1::TableEntry* SetupTableEntryToInsert(OvsP4rtSession* session,
                                               ::p4::v1::WriteRequest* req);
@@ -111,6 +163,63 @@ std::unique_ptr<p4::v1::P4Runtime::Stub> CreateP4RuntimeStub(
 
 ::p4::v1::TableEntry* SetupTableEntryToRead(OvsP4rtSession* session,
                                             ::p4::v1::ReadRequest* req);
+
+// Accumulates table updates and sends them to the session in
+// WriteRequests of at most max_updates updates each.
+class WriteBatch {
+ public:
+  // An update that the server rejected.
+  struct UpdateError {
+    uint64_t tag;
+    ::p4::v1::Update::Type type;
+    ::absl::StatusCode code;
+  };
+
+  WriteBatch(OvsP4rtSession* session, int max_updates)
+      : session_(session), max_updates_(max_updates) {}
+
+  // Adds an update to the batch and returns the table entry to fill in.
+  // The tag identifies the object the update belongs to; it is reported
+  // by FailedTags() if the update fails. Tag 0 is never reported.
+  ::p4::v1::TableEntry* Add(::p4::v1::Update::Type type, uint64_t tag = 0);
+  ::p4::v1::TableEntry* AddInsert(uint64_t tag = 0);
+  ::p4::v1::TableEntry* AddModify(uint64_t tag = 0);
+  ::p4::v1::TableEntry* AddDelete(uint64_t tag = 0);
+
+  // Sends the pending updates, if any. Returns the status of the first
+  // WriteRequest that failed since the batch was created.
+  ::absl::Status Flush();
+
+  // Tags of the updates that failed. If the server does not report the
+  // status of each update, all the updates of a failed WriteRequest are
+  // considered failed.
+  const std::vector<uint64_t>& FailedTags() const { return failed_tags_; }
+
+  // The updates that failed, with the error of each. Callers use it to
+  // tell an INSERT of an entry that is already installed (ALREADY_EXISTS)
+  // or a DELETE of one that is already gone (NOT_FOUND) from a real
+  // failure.
+  const std::vector<UpdateError>& Errors() const { return errors_; }
+
+  // Number of WriteRequests sent so far.
+  int NumRequests() const { return num_requests_; }
+
+  // The updates added since the last flush, and their tags. A batch that
+  // is never flushed only collects the updates it is given.
+  const ::p4::v1::WriteRequest& PendingRequest() const { return request_; }
+  const std::vector<uint64_t>& PendingTags() const { return tags_; }
+
+ private:
+  OvsP4rtSession* session_;
+  const int max_updates_;
+  ::p4::v1::WriteRequest request_;
+  std::vector<uint64_t> tags_;
+  std::vector<uint64_t> failed_tags_;
+  std::vector<UpdateError> errors_;
+  ::absl::Status status_;
+  int num_requests_ = 0;
+};
+
 }  // namespace ovs_p4rt
 
 #endif  // OVS_P4RT_SESSION_H_
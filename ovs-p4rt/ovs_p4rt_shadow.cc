@@ -0,0 +1,380 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ovs_p4rt_shadow.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+
+namespace ovs_p4rt {
+
+namespace {
+
+constexpr uint64_t kSnapshotMagic = 0x535452345053564fULL;  // "OVSP4RTS"
+constexpr uint32_t kSnapshotVersion = 2;
+constexpr uint64_t kInitialCapacity = 4096;
+constexpr size_t kInitialMapCapacity = 1024;
+
+absl::Status ErrnoError(const char* op, const std::string& path) {
+  return absl::InternalError(
+      absl::StrCat(op, " ", path, ": ", strerror(errno)));
+}
+
+}  // namespace
+
+//----------------------------------------------------------------------
+// ShadowSnapshot
+//----------------------------------------------------------------------
+
+struct ShadowSnapshot::Header {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t entry_size;
+  uint64_t capacity;  // number of slots, a power of two
+  uint64_t count;     // number of slots in use
+  uint64_t cookie;    // pipeline the entries are installed on
+  uint32_t device_id;
+  uint32_t reserved;
+};
+
+absl::StatusOr<std::unique_ptr<ShadowSnapshot>> ShadowSnapshot::Open(
+    const std::string& path) {
+  auto snapshot = absl::WrapUnique(new ShadowSnapshot(path));
+
+  int fd = open(path.c_str(), O_RDWR);
+  if (fd >= 0) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 &&
+        static_cast<size_t>(st.st_size) >= sizeof(Header)) {
+      void* base = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+      if (base != MAP_FAILED) {
+        snapshot->fd_ = fd;
+        snapshot->base_ = base;
+        snapshot->size_ = st.st_size;
+        snapshot->header_ = static_cast<Header*>(base);
+        snapshot->slots_ = reinterpret_cast<Slot*>(snapshot->header_ + 1);
+        if (snapshot->IsValid()) return snapshot;
+
+        printf("Discarding incompatible shadow snapshot %s\n", path.c_str());
+        snapshot->Unmap();
+        fd = -1;
+      }
+    }
+    if (fd >= 0) close(fd);
+  }
+
+  absl::Status status = snapshot->Rebuild(kInitialCapacity);
+  if (!status.ok()) return status;
+  return snapshot;
+}
+
+ShadowSnapshot::~ShadowSnapshot() { Unmap(); }
+
+bool ShadowSnapshot::IsValid() const {
+  const uint64_t capacity = header_->capacity;
+  return header_->magic == kSnapshotMagic &&
+         header_->version == kSnapshotVersion &&
+         header_->entry_size == sizeof(ShadowEntry) && capacity != 0 &&
+         (capacity & (capacity - 1)) == 0 &&
+         size_ == sizeof(Header) + capacity * sizeof(Slot);
+}
+
+void ShadowSnapshot::Unmap() {
+  if (base_ != nullptr) munmap(base_, size_);
+  if (fd_ >= 0) close(fd_);
+  fd_ = -1;
+  base_ = nullptr;
+  size_ = 0;
+  header_ = nullptr;
+  slots_ = nullptr;
+}
+
+absl::Status ShadowSnapshot::Rebuild(uint64_t capacity) {
+  // The new file is written next to the old one and renamed over it, so
+  // a restart never observes a half-built table.
+  const std::string tmp_path = path_ + ".tmp";
+  const size_t size = sizeof(Header) + capacity * sizeof(Slot);
+
+  int fd = open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) return ErrnoError("open", tmp_path);
+
+  if (ftruncate(fd, size) != 0) {
+    absl::Status status = ErrnoError("ftruncate", tmp_path);
+    close(fd);
+    return status;
+  }
+
+  void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    absl::Status status = ErrnoError("mmap", tmp_path);
+    close(fd);
+    return status;
+  }
+
+  // ftruncate() zero-fills the file, so all slots start out empty.
+  ShadowSnapshot rebuilt(tmp_path);
+  rebuilt.fd_ = fd;
+  rebuilt.base_ = base;
+  rebuilt.size_ = size;
+  rebuilt.header_ = static_cast<Header*>(base);
+  rebuilt.slots_ = reinterpret_cast<Slot*>(rebuilt.header_ + 1);
+  rebuilt.header_->magic = kSnapshotMagic;
+  rebuilt.header_->version = kSnapshotVersion;
+  rebuilt.header_->entry_size = sizeof(ShadowEntry);
+  rebuilt.header_->capacity = capacity;
+  rebuilt.header_->count = 0;
+
+  if (header_ != nullptr) {
+    rebuilt.SetPipeline(header_->device_id, header_->cookie);
+    ForEach([&rebuilt](uint64_t key, const ShadowEntry& entry) {
+      rebuilt.Put(key, entry);
+    });
+  }
+
+  if (rename(tmp_path.c_str(), path_.c_str()) != 0) {
+    absl::Status status = ErrnoError("rename", tmp_path);
+    unlink(tmp_path.c_str());
+    return status;
+  }
+
+  // Take over the new mapping.
+  Unmap();
+  std::swap(fd_, rebuilt.fd_);
+  std::swap(base_, rebuilt.base_);
+  std::swap(size_, rebuilt.size_);
+  std::swap(header_, rebuilt.header_);
+  std::swap(slots_, rebuilt.slots_);
+  return absl::OkStatus();
+}
+
+uint64_t ShadowSnapshot::capacity() const { return header_->capacity; }
+
+size_t ShadowSnapshot::size() const { return header_->count; }
+
+uint32_t ShadowSnapshot::device_id() const { return header_->device_id; }
+
+uint64_t ShadowSnapshot::cookie() const { return header_->cookie; }
+
+void ShadowSnapshot::SetPipeline(uint32_t device_id, uint64_t cookie) {
+  header_->device_id = device_id;
+  header_->cookie = cookie;
+}
+
+uint64_t ShadowSnapshot::FindSlot(uint64_t key) const {
+  const uint64_t mask = capacity() - 1;
+  uint64_t i = ShadowKeyHash(key) & mask;
+  while (slots_[i].key != 0 && slots_[i].key != key) {
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+void ShadowSnapshot::Put(uint64_t key, const ShadowEntry& entry) {
+  // Keep the load factor at or below one half.
+  if ((header_->count + 1) * 2 > capacity()) {
+    absl::Status status = Rebuild(capacity() * 2);
+    if (!status.ok()) {
+      printf("Unable to grow shadow snapshot: %s\n",
+             std::string(status.message()).c_str());
+      // At least one slot must stay empty to terminate lookups.
+      if (header_->count + 1 >= capacity()) return;
+    }
+  }
+
+  Slot& slot = slots_[FindSlot(key)];
+  if (slot.key == 0) header_->count++;
+  slot.entry = entry;
+  slot.key = key;
+}
+
+void ShadowSnapshot::Remove(uint64_t key) {
+  const uint64_t mask = capacity() - 1;
+  uint64_t hole = FindSlot(key);
+  if (slots_[hole].key == 0) return;
+
+  // Backward-shift deletion: move later members of the probe sequence
+  // into the hole, so lookups never need tombstones.
+  for (uint64_t i = (hole + 1) & mask; slots_[i].key != 0; i = (i + 1) & mask) {
+    const uint64_t home = ShadowKeyHash(slots_[i].key) & mask;
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      slots_[hole] = slots_[i];
+      hole = i;
+    }
+  }
+  slots_[hole].key = 0;
+  header_->count--;
+}
+
+void ShadowSnapshot::Clear() {
+  memset(slots_, 0, capacity() * sizeof(Slot));
+  header_->count = 0;
+}
+
+//----------------------------------------------------------------------
+// ConcurrentShadowMap
+//----------------------------------------------------------------------
+
+// Memory ordering: the slot operations are sequentially consistent, which
+// the EpochDomain relies on to order a reader entering its guard before
+// the loads it makes inside it. On x86 this only costs the writers.
+
+ConcurrentShadowMap::ConcurrentShadowMap()
+    : table_(new Table(kInitialMapCapacity)) {}
+
+ConcurrentShadowMap::~ConcurrentShadowMap() {
+  Table* table = table_.load();
+  for (size_t i = 0; i < table->capacity; i++) {
+    delete table->slots[i].entry.load();
+  }
+  delete table;
+}
+
+ConcurrentShadowMap::Slot* ConcurrentShadowMap::FindSlot(const Table* table,
+                                                         uint64_t key) {
+  const size_t mask = table->capacity - 1;
+  size_t i = ShadowKeyHash(key) & mask;
+  while (true) {
+    const uint64_t slot_key = table->slots[i].key.load();
+    if (slot_key == key || slot_key == 0) return &table->slots[i];
+    i = (i + 1) & mask;
+  }
+}
+
+const ShadowEntry* ConcurrentShadowMap::Lookup(const Table* table,
+                                              uint64_t key) {
+  // An unclaimed slot may be claimed for another key meanwhile, so only
+  // the entry of a slot that holds the key is read.
+  const size_t mask = table->capacity - 1;
+  size_t i = ShadowKeyHash(key) & mask;
+  while (true) {
+    const uint64_t slot_key = table->slots[i].key.load();
+    if (slot_key == key) return table->slots[i].entry.load();
+    if (slot_key == 0) return nullptr;
+    i = (i + 1) & mask;
+  }
+}
+
+bool ConcurrentShadowMap::Find(uint64_t key, ShadowEntry* entry) const {
+  EpochDomain::ReadGuard guard;
+  const ShadowEntry* found = Lookup(table_.load(), key);
+  if (found == nullptr) return false;
+  *entry = *found;
+  return true;
+}
+
+bool ConcurrentShadowMap::Contains(uint64_t key) const {
+  EpochDomain::ReadGuard guard;
+  return Lookup(table_.load(), key) != nullptr;
+}
+
+void ConcurrentShadowMap::Insert(uint64_t key, const ShadowEntry& entry) {
+  Table* table = table_.load();
+  Slot* slot = FindSlot(table, key);
+
+  if (slot->key.load() == 0) {
+    // Keep the load factor (including erased slots) at most 1/2, so
+    // lookups stay short and always find an unclaimed slot.
+    if (2 * (table->claimed + 1) > table->capacity) {
+      size_t capacity = kInitialMapCapacity;
+      while (capacity < 4 * (size() + 1)) capacity *= 2;
+      Rehash(capacity);
+      table = table_.load();
+      slot = FindSlot(table, key);
+    }
+    // The entry is published before the key, so a reader that finds the
+    // key sees the entry.
+    slot->entry.store(new ShadowEntry(entry));
+    slot->key.store(key);
+    table->claimed++;
+    size_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  const ShadowEntry* old = slot->entry.exchange(new ShadowEntry(entry));
+  if (old != nullptr) {
+    EpochDomain::Instance().RetireObject(old);
+  } else {
+    size_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void ConcurrentShadowMap::Erase(uint64_t key) {
+  Slot* slot = FindSlot(table_.load(), key);
+  if (slot->key.load() == 0) return;
+
+  const ShadowEntry* old = slot->entry.exchange(nullptr);
+  if (old != nullptr) {
+    EpochDomain::Instance().RetireObject(old);
+    size_.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
+
+void ConcurrentShadowMap::Clear() {
+  Table* old = table_.exchange(new Table(kInitialMapCapacity));
+  size_.store(0, std::memory_order_relaxed);
+  EpochDomain::Instance().Retire([old] {
+    for (size_t i = 0; i < old->capacity; i++) {
+      delete old->slots[i].entry.load();
+    }
+    delete old;
+  });
+}
+
+void ConcurrentShadowMap::Rehash(size_t capacity) {
+  Table* old = table_.load();
+  auto* table = new Table(capacity);
+
+  // The entries move to the new table; only the old slots are retired.
+  for (size_t i = 0; i < old->capacity; i++) {
+    const ShadowEntry* entry = old->slots[i].entry.load();
+    if (entry == nullptr) continue;
+    const uint64_t key = old->slots[i].key.load();
+    Slot* slot = FindSlot(table, key);
+    slot->entry.store(entry);
+    slot->key.store(key);
+    table->claimed++;
+  }
+
+  table_.store(table);
+  EpochDomain::Instance().RetireObject(old);
+}
+
+//----------------------------------------------------------------------
+// ShadowTable
+//----------------------------------------------------------------------
+
+absl::Status ShadowTable::AttachSnapshot(const std::string& path,
+                                        uint32_t device_id) {
+  auto status_or_snapshot = ShadowSnapshot::Open(path);
+  if (!status_or_snapshot.ok()) return status_or_snapshot.status();
+
+  absl::MutexLock lock(&mu_);
+  snapshot_ = std::move(status_or_snapshot).value();
+  if (snapshot_->size() != 0 && snapshot_->device_id() != device_id) {
+    printf("Discarding shadow snapshot %s of device %u\n", path.c_str(),
+           snapshot_->device_id());
+    snapshot_->Clear();
+  }
+  device_id_ = device_id;
+  cookie_ = snapshot_->cookie();
+  snapshot_->SetPipeline(device_id_, cookie_);
+  entries_.Clear();
+  snapshot_->ForEach([this](uint64_t key, const ShadowEntry& entry) {
+    entries_.Insert(key, entry);
+  });
+  return absl::OkStatus();
+}
+
+}  // namespace ovs_p4rt
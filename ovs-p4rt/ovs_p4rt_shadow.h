@@ -0,0 +1,331 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OVSP4RT_SHADOW_H_
+#define OVSP4RT_SHADOW_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "openvswitch/ovs-p4rt.h"
+#include "ovs_p4rt_epoch.h"
+
+namespace ovs_p4rt {
+
+// Kind of object tracked in the shadow state.
+enum class ShadowKind : uint8_t {
+  kFdb = 1,
+  kTunnel = 2,
+  kVlan = 3,
+  kSrcPort = 4,
+  kTunnelSrcPort = 5,
+  kRxTunnelSrc = 6,
+};
+
+// A copy of the OVS request that programmed an object, as it was last
+// written to the device.
+struct ShadowEntry {
+  ShadowKind kind;
+  union {
+    struct mac_learning_info learn_info;
+    struct tunnel_info tunnel_info;
+    struct src_port_info sp_info;
+    uint16_t vlan_id;
+  };
+};
+
+// Packs (kind, bridge_id, 48-bit value) into a 64-bit shadow key.
+inline uint64_t MakeShadowKey(ShadowKind kind, uint8_t bridge_id,
+                              uint64_t value) {
+  return (static_cast<uint64_t>(kind) << 56) |
+         (static_cast<uint64_t>(bridge_id) << 48) |
+         (value & 0xffffffffffffULL);
+}
+
+// Returns the shadow key of an FDB entry: (bridge_id, MAC address).
+inline uint64_t FdbShadowKey(const struct mac_learning_info& learn_info) {
+  uint64_t mac = 0;
+  for (int i = 0; i < 6; i++) {
+    mac = (mac << 8) | learn_info.mac_addr[i];
+  }
+  return MakeShadowKey(ShadowKind::kFdb, learn_info.bridge_id, mac);
+}
+
+// Returns the shadow key of a tunnel: (bridge_id, VNI).
+inline uint64_t TunnelShadowKey(const struct tunnel_info& tunnel_info) {
+  return MakeShadowKey(ShadowKind::kTunnel, tunnel_info.bridge_id,
+                       tunnel_info.vni);
+}
+
+// Returns the shadow key of the receive source port of a tunnel:
+// (bridge_id, VNI).
+inline uint64_t RxTunnelSrcShadowKey(const struct tunnel_info& tunnel_info) {
+  return MakeShadowKey(ShadowKind::kRxTunnelSrc, tunnel_info.bridge_id,
+                       tunnel_info.vni);
+}
+
+// Returns the shadow key of a VLAN. VLAN entries are not bridge-specific.
+inline uint64_t VlanShadowKey(uint16_t vlan_id) {
+  return MakeShadowKey(ShadowKind::kVlan, 0, vlan_id);
+}
+
+// Returns the shadow key of a source port mapping: (bridge_id, port, VID).
+inline uint64_t SrcPortShadowKey(ShadowKind kind,
+                                 const struct src_port_info& sp_info) {
+  return MakeShadowKey(kind, sp_info.bridge_id,
+                       (static_cast<uint64_t>(sp_info.src_port) << 12) |
+                           (sp_info.vlan_id & 0xfff));
+}
+
+// Returns the shadow key of an entry.
+inline uint64_t ShadowEntryKey(const ShadowEntry& entry) {
+  switch (entry.kind) {
+    case ShadowKind::kFdb:
+      return FdbShadowKey(entry.learn_info);
+    case ShadowKind::kTunnel:
+      return TunnelShadowKey(entry.tunnel_info);
+    case ShadowKind::kRxTunnelSrc:
+      return RxTunnelSrcShadowKey(entry.tunnel_info);
+    case ShadowKind::kVlan:
+      return VlanShadowKey(entry.vlan_id);
+    default:
+      return SrcPortShadowKey(entry.kind, entry.sp_info);
+  }
+}
+
+// Returns the kind of object a shadow key refers to.
+inline ShadowKind ShadowKeyKind(uint64_t key) {
+  return static_cast<ShadowKind>(key >> 56);
+}
+
+// Mixes the bits of a shadow key. Unlike absl::Hash, the result is the
+// same in every process, so it can be used to place keys in a file.
+inline uint64_t ShadowKeyHash(uint64_t key) {
+  key ^= key >> 30;
+  key *= 0xbf58476d1ce4e5b9ULL;
+  key ^= key >> 27;
+  key *= 0x94d049bb133111ebULL;
+  key ^= key >> 31;
+  return key;
+}
+
+// Memory-mapped file holding a copy of a shadow table.
+//
+// The file is an open-addressing hash table of fixed-size slots, so each
+// change is a write to one or two slots rather than a rewrite of the file.
+// Changes reach the page cache immediately and survive a restart (or
+// crash) of ovs-vswitchd; they are not synced to disk. The header records
+// the device and the cookie of the pipeline the entries were installed on.
+class ShadowSnapshot {
+ public:
+  // Opens the snapshot file at the specified path, creating it if it does
+  // not exist. A file with an unknown format is replaced by an empty one.
+  static ::absl::StatusOr<std::unique_ptr<ShadowSnapshot>> Open(
+      const std::string& path);
+
+  ~ShadowSnapshot();
+
+  // Disable copy semantics.
+  ShadowSnapshot(const ShadowSnapshot&) = delete;
+  ShadowSnapshot& operator=(const ShadowSnapshot&) = delete;
+
+  void Put(uint64_t key, const ShadowEntry& entry);
+  void Remove(uint64_t key);
+  void Clear();
+
+  size_t size() const;
+
+  uint32_t device_id() const;
+  uint64_t cookie() const;
+  void SetPipeline(uint32_t device_id, uint64_t cookie);
+
+  // Calls fn(key, entry) for each entry in the snapshot.
+  template <typename Fn>
+  void ForEach(Fn fn) const {
+    for (uint64_t i = 0; i < capacity(); i++) {
+      if (slots_[i].key != 0) {
+        fn(slots_[i].key, slots_[i].entry);
+      }
+    }
+  }
+
+ private:
+  struct Header;
+  struct Slot {
+    uint64_t key;  // 0 if the slot is empty
+    ShadowEntry entry;
+  };
+
+  explicit ShadowSnapshot(const std::string& path) : path_(path) {}
+
+  // Replaces the file by one with the specified capacity, holding the
+  // current entries (if any).
+  ::absl::Status Rebuild(uint64_t capacity);
+  bool IsValid() const;
+  void Unmap();
+
+  uint64_t capacity() const;
+  uint64_t FindSlot(uint64_t key) const;
+
+  const std::string path_;
+  int fd_ = -1;
+  void* base_ = nullptr;
+  size_t size_ = 0;
+  Header* header_ = nullptr;
+  Slot* slots_ = nullptr;
+};
+
+// Concurrent hash map from shadow key to entry.
+//
+// Lookups are wait-free: they never take a lock and never retry. Writers
+// must be serialized by the caller. The map is an open-addressing table
+// whose slots hold a key and a pointer to an immutable entry. A slot keeps
+// its key once claimed (an erased entry leaves a null pointer behind), so
+// a lookup can stop at the first empty slot. Replaced entries, and tables
+// replaced when the map grows, are reclaimed through the EpochDomain.
+class ConcurrentShadowMap {
+ public:
+  ConcurrentShadowMap();
+  // There must be no concurrent readers.
+  ~ConcurrentShadowMap();
+
+  // Disable copy semantics.
+  ConcurrentShadowMap(const ConcurrentShadowMap&) = delete;
+  ConcurrentShadowMap& operator=(const ConcurrentShadowMap&) = delete;
+
+  bool Find(uint64_t key, ShadowEntry* entry) const;
+  bool Contains(uint64_t key) const;
+  size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+  // Calls fn(key, entry) for each entry. Entries inserted or erased
+  // meanwhile may or may not be visited.
+  template <typename Fn>
+  void ForEach(Fn fn) const {
+    EpochDomain::ReadGuard guard;
+    const Table* table = table_.load();
+    for (size_t i = 0; i < table->capacity; i++) {
+      const uint64_t key = table->slots[i].key.load();
+      if (key == 0) continue;
+      const ShadowEntry* entry = table->slots[i].entry.load();
+      if (entry != nullptr) fn(key, *entry);
+    }
+  }
+
+  void Insert(uint64_t key, const ShadowEntry& entry);
+  void Erase(uint64_t key);
+  void Clear();
+
+ private:
+  struct Slot {
+    std::atomic<uint64_t> key{0};  // 0 if the slot is unclaimed
+    std::atomic<const ShadowEntry*> entry{nullptr};
+  };
+
+  struct Table {
+    explicit Table(size_t capacity)
+        : capacity(capacity), slots(new Slot[capacity]) {}
+
+    const size_t capacity;  // a power of two
+    std::unique_ptr<Slot[]> slots;
+    size_t claimed = 0;  // slots with a key, written by writers only
+  };
+
+  // Returns the slot holding the key, or the unclaimed slot where it
+  // would go. For writers.
+  static Slot* FindSlot(const Table* table, uint64_t key);
+
+  // Returns the entry with the specified key, or nullptr. For readers,
+  // which must hold an EpochDomain::ReadGuard.
+  static const ShadowEntry* Lookup(const Table* table, uint64_t key);
+
+  // Replaces the table by one sized for the live entries.
+  void Rehash(size_t capacity);
+
+  std::atomic<Table*> table_;
+  std::atomic<size_t> size_{0};
+};
+
+// Shadow of the entries ovs-p4rt has installed on a device.
+//
+// The shadow lets the sidecar tell an update (station move) from a new
+// entry without reading the device. It is shared by the worker shards of
+// the device; each shard only modifies the keys it owns. Lookups do not
+// lock, so the shards do not contend on the table.
+class ShadowTable {
+ public:
+  // Copies the entry with the specified key to *entry. Returns false if
+  // there is no such entry.
+  bool Find(uint64_t key, ShadowEntry* entry) const {
+    return entries_.Find(key, entry);
+  }
+
+  bool Contains(uint64_t key) const { return entries_.Contains(key); }
+
+  void Insert(uint64_t key, const ShadowEntry& entry) {
+    absl::MutexLock lock(&mu_);
+    entries_.Insert(key, entry);
+    if (snapshot_) snapshot_->Put(key, entry);
+  }
+
+  void Erase(uint64_t key) {
+    absl::MutexLock lock(&mu_);
+    if (!entries_.Contains(key)) return;
+    entries_.Erase(key);
+    if (snapshot_) snapshot_->Remove(key);
+  }
+
+  void Clear() {
+    absl::MutexLock lock(&mu_);
+    entries_.Clear();
+    if (snapshot_) snapshot_->Clear();
+  }
+
+  size_t size() const { return entries_.size(); }
+
+  // Cookie of the pipeline the entries are installed on, or 0 if unknown.
+  // It is kept in the snapshot, so that a restart can tell whether the
+  // entries in the snapshot were installed on the pipeline now running.
+  uint64_t PipelineCookie() {
+    absl::MutexLock lock(&mu_);
+    return cookie_;
+  }
+
+  void SetPipelineCookie(uint64_t cookie) {
+    absl::MutexLock lock(&mu_);
+    cookie_ = cookie;
+    if (snapshot_) snapshot_->SetPipeline(device_id_, cookie);
+  }
+
+  // Calls fn(key, entry) for each entry in the table. Changes made
+  // meanwhile by other shards may or may not be visited.
+  template <typename Fn>
+  void ForEach(Fn fn) const {
+    entries_.ForEach(fn);
+  }
+
+  // Backs the table with a snapshot file, so that it survives a restart of
+  // ovs-vswitchd. The entries in the file replace the contents of the
+  // table, and later changes are written through to the file. A file
+  // written for another device is emptied.
+  ::absl::Status AttachSnapshot(const std::string& path, uint32_t device_id);
+
+ private:
+  // Serializes writers, and guards the snapshot.
+  absl::Mutex mu_;
+  ConcurrentShadowMap entries_;
+  std::unique_ptr<ShadowSnapshot> snapshot_ ABSL_GUARDED_BY(mu_);
+  uint32_t device_id_ ABSL_GUARDED_BY(mu_) = 0;
+  uint64_t cookie_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+}  // namespace ovs_p4rt
+
+#endif  // OVSP4RT_SHADOW_H_
@@ -0,0 +1,287 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ovs_p4rt_trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/strings/str_cat.h"
+
+ABSL_FLAG(std::string, trace_file, "",
+          "File in which to record the requests received from OVS, for "
+          "replay with ovs-p4rt-replay. The trace of the previous run is "
+          "kept as <file>.1. Disabled if empty.");
+ABSL_FLAG(uint64_t, trace_file_records, 1 << 20,
+          "Number of requests the trace file holds before the oldest ones "
+          "are overwritten.");
+
+namespace ovs_p4rt {
+
+namespace {
+
+constexpr uint64_t kTraceMagic = 0x454341525452504fULL;  // "OPRTRACE"
+constexpr uint32_t kTraceVersion = 2;
+
+// Number of times a record that is being written is read again before it
+// is dropped.
+constexpr int kMaxReadAttempts = 100;
+
+absl::Status ErrnoError(const char* op, const std::string& path) {
+  return absl::InternalError(
+      absl::StrCat(op, " ", path, ": ", strerror(errno)));
+}
+
+uint64_t MonotonicNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+// Returns the per-entry request that programs a shadow entry.
+OvsP4rtRequest EntryRequest(const ShadowEntry& entry, bool insert_entry) {
+  OvsP4rtRequest request = {};
+  request.insert_entry = insert_entry;
+  switch (entry.kind) {
+    case ShadowKind::kFdb:
+      request.type = RequestType::kFdb;
+      request.learn_info = entry.learn_info;
+      break;
+    case ShadowKind::kTunnel:
+      request.type = RequestType::kTunnel;
+      request.tunnel_info = entry.tunnel_info;
+      break;
+    case ShadowKind::kRxTunnelSrc:
+      request.type = RequestType::kRxTunnelSrc;
+      request.tunnel_info = entry.tunnel_info;
+      break;
+    case ShadowKind::kTunnelSrcPort:
+      request.type = RequestType::kTunnelSrcPort;
+      request.sp_info = entry.sp_info;
+      break;
+    case ShadowKind::kSrcPort:
+      request.type = RequestType::kSrcPort;
+      request.sp_info = entry.sp_info;
+      break;
+    case ShadowKind::kVlan:
+      request.type = RequestType::kVlan;
+      request.vlan_id = entry.vlan_id;
+      break;
+  }
+  return request;
+}
+
+}  // namespace
+
+struct TraceWriter::Header {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t slot_size;
+  uint64_t capacity;
+  std::atomic<uint64_t> next_seq;
+};
+
+// A record in the ring. seq is 0 while the slot is empty. Otherwise, it is
+// 2 * (n + 1) once the record with sequence number n is complete, and one
+// less while it is written. A reader copies a record between two reads of
+// seq, and keeps the copy only if seq was even and did not change.
+struct TraceWriter::Slot {
+  std::atomic<uint64_t> seq;
+  uint64_t timestamp_ns;
+  uint64_t batch_seq;
+  uint64_t n_entries;
+  OvsP4rtRequest request;
+};
+
+TraceWriter* TraceWriter::Instance() {
+  static TraceWriter* writer = []() -> TraceWriter* {
+    const std::string path = absl::GetFlag(FLAGS_trace_file);
+    if (path.empty()) return nullptr;
+
+    auto* writer = new TraceWriter();
+    absl::Status status =
+        writer->Open(path, absl::GetFlag(FLAGS_trace_file_records));
+    if (!status.ok()) {
+      printf("Unable to create trace file: %s\n",
+             std::string(status.message()).c_str());
+      delete writer;
+      return nullptr;
+    }
+    return writer;
+  }();
+  return writer;
+}
+
+absl::Status TraceWriter::Open(const std::string& path, uint64_t capacity) {
+  if (capacity == 0) {
+    return absl::InvalidArgumentError("Trace must hold at least one record");
+  }
+
+  // Keep the trace of the previous run, which may be the one that shows
+  // why ovs-vswitchd restarted.
+  const std::string old_path = path + ".1";
+  if (rename(path.c_str(), old_path.c_str()) != 0 && errno != ENOENT) {
+    return ErrnoError("rename", path);
+  }
+
+  const size_t size = sizeof(Header) + capacity * sizeof(Slot);
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) return ErrnoError("open", path);
+
+  if (ftruncate(fd, size) != 0) {
+    absl::Status status = ErrnoError("ftruncate", path);
+    close(fd);
+    return status;
+  }
+
+  void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return ErrnoError("mmap", path);
+
+  // The mapping stays in place until the process exits.
+  header_ = static_cast<Header*>(base);
+  slots_ = reinterpret_cast<Slot*>(header_ + 1);
+  header_->magic = kTraceMagic;
+  header_->version = kTraceVersion;
+  header_->slot_size = sizeof(Slot);
+  header_->capacity = capacity;
+  header_->next_seq.store(0, std::memory_order_relaxed);
+  return absl::OkStatus();
+}
+
+void TraceWriter::Append(const OvsP4rtRequest& request) {
+  const uint64_t seq =
+      header_->next_seq.fetch_add(1, std::memory_order_relaxed);
+  WriteSlot(seq, MonotonicNanos(), seq, 0, request);
+}
+
+void TraceWriter::AppendBatch(RequestType type, bool insert_entry,
+                              const std::vector<ShadowEntry>& entries) {
+  const uint64_t batch_seq = header_->next_seq.fetch_add(
+      entries.size() + 1, std::memory_order_relaxed);
+  const uint64_t timestamp_ns = MonotonicNanos();
+
+  // The payload of the bulk request points to the caller's memory, so
+  // only its type is recorded.
+  OvsP4rtRequest request = {};
+  request.type = type;
+  request.insert_entry = insert_entry;
+  WriteSlot(batch_seq, timestamp_ns, batch_seq, entries.size(), request);
+  for (size_t i = 0; i < entries.size(); i++) {
+    WriteSlot(batch_seq + i + 1, timestamp_ns, batch_seq, 0,
+              EntryRequest(entries[i], insert_entry));
+  }
+}
+
+void TraceWriter::WriteSlot(uint64_t seq, uint64_t timestamp_ns,
+                            uint64_t batch_seq, uint64_t n_entries,
+                            const OvsP4rtRequest& request) {
+  Slot& slot = slots_[seq % header_->capacity];
+
+  // Claim the slot by making its seq odd. Once the ring has wrapped, the
+  // writer of an older record may still hold it; the newer record wins.
+  const uint64_t writing = 2 * seq + 1;
+  uint64_t current = slot.seq.load(std::memory_order_relaxed);
+  do {
+    while (current & 1) {
+      std::this_thread::yield();
+      current = slot.seq.load(std::memory_order_relaxed);
+    }
+    if (current > writing) return;
+  } while (!slot.seq.compare_exchange_weak(current, writing,
+                                           std::memory_order_relaxed));
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot.timestamp_ns = timestamp_ns;
+  slot.batch_seq = batch_seq;
+  slot.n_entries = n_entries;
+  slot.request = request;
+  slot.seq.store(writing + 1, std::memory_order_release);
+}
+
+absl::StatusOr<std::vector<TraceRecord>> ReadTrace(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return ErrnoError("open", path);
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    absl::Status status = ErrnoError("fstat", path);
+    close(fd);
+    return status;
+  }
+
+  void* base = nullptr;
+  if (static_cast<size_t>(st.st_size) >= sizeof(TraceWriter::Header)) {
+    base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (base == nullptr || base == MAP_FAILED) {
+    return absl::InvalidArgumentError(
+        absl::StrCat(path, " is not an ovs-p4rt trace"));
+  }
+
+  const auto* header = static_cast<const TraceWriter::Header*>(base);
+  const auto* slots = reinterpret_cast<const TraceWriter::Slot*>(header + 1);
+  if (header->magic != kTraceMagic || header->version != kTraceVersion ||
+      header->slot_size != sizeof(TraceWriter::Slot) ||
+      static_cast<size_t>(st.st_size) !=
+          sizeof(TraceWriter::Header) +
+              header->capacity * sizeof(TraceWriter::Slot)) {
+    munmap(base, st.st_size);
+    return absl::InvalidArgumentError(
+        absl::StrCat(path, " is not a compatible ovs-p4rt trace"));
+  }
+
+  std::vector<TraceRecord> records;
+  records.reserve(std::min(header->capacity,
+                           header->next_seq.load(std::memory_order_acquire)));
+  // The trace may be read while it is written. A record that is being
+  // rewritten is read again, and dropped if it does not settle.
+  uint64_t dropped = 0;
+  for (uint64_t i = 0; i < header->capacity; i++) {
+    const TraceWriter::Slot& slot = slots[i];
+    int attempt = 0;
+    for (; attempt < kMaxReadAttempts; attempt++) {
+      const uint64_t before = slot.seq.load(std::memory_order_acquire);
+      if (before == 0) break;
+      if (before & 1) {
+        std::this_thread::yield();
+        continue;
+      }
+      TraceRecord record = {before / 2 - 1, slot.timestamp_ns, slot.batch_seq,
+                            slot.n_entries, slot.request};
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.seq.load(std::memory_order_relaxed) == before) {
+        records.push_back(record);
+        break;
+      }
+    }
+    if (attempt == kMaxReadAttempts) dropped++;
+  }
+  if (dropped != 0) {
+    printf("Dropped %" PRIu64 " records of %s that were being written\n",
+           dropped, path.c_str());
+  }
+  munmap(base, st.st_size);
+
+  std::sort(records.begin(), records.end(),
+            [](const TraceRecord& a, const TraceRecord& b) {
+              return a.seq < b.seq;
+            });
+  return records;
+}
+
+}  // namespace ovs_p4rt
@@ -0,0 +1,76 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// Binary trace of the requests ovs-p4rt receives through its C interface.
+//
+// When --trace_file is set, every request is appended to a fixed-size ring
+// in a memory-mapped file, together with a timestamp. Once the ring is
+// full, the oldest records are overwritten. ovs-p4rt-replay feeds a trace
+// back through the sidecar to reproduce the workload.
+//
+// A call to a bulk interface (see ovs_p4rt_bulk.h) is recorded as the bulk
+// request, without its payload, followed by one record per entry. The
+// records of a call have consecutive sequence numbers.
+
+#ifndef OVSP4RT_TRACE_H_
+#define OVSP4RT_TRACE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "ovs_p4rt_device.h"
+
+namespace ovs_p4rt {
+
+// A request read from a trace file.
+struct TraceRecord {
+  uint64_t seq;           // position of the request in the capture
+  uint64_t timestamp_ns;  // CLOCK_MONOTONIC time of the request
+  uint64_t batch_seq;     // seq of the bulk request of an entry, or seq
+  uint64_t n_entries;     // number of entries of a bulk request
+  OvsP4rtRequest request;
+};
+
+// Reads the records of a trace file, ordered by sequence number.
+::absl::StatusOr<std::vector<TraceRecord>> ReadTrace(const std::string& path);
+
+class TraceWriter {
+ public:
+  // Returns the process-wide trace writer, or nullptr if tracing is
+  // disabled or the trace file could not be created.
+  static TraceWriter* Instance();
+
+  // Appends a request to the trace. Thread-safe.
+  void Append(const OvsP4rtRequest& request);
+
+  // Appends a bulk request of the specified type, followed by its entries.
+  // Thread-safe.
+  void AppendBatch(RequestType type, bool insert_entry,
+                   const std::vector<ShadowEntry>& entries);
+
+ private:
+  friend ::absl::StatusOr<std::vector<TraceRecord>> ReadTrace(
+      const std::string& path);
+
+  struct Header;
+  struct Slot;
+
+  TraceWriter() = default;
+  ::absl::Status Open(const std::string& path, uint64_t capacity);
+
+  // Writes the record with the specified sequence number in its slot,
+  // unless a newer record has already taken the slot.
+  void WriteSlot(uint64_t seq, uint64_t timestamp_ns, uint64_t batch_seq,
+                 uint64_t n_entries, const OvsP4rtRequest& request);
+
+  Header* header_ = nullptr;
+  Slot* slots_ = nullptr;
+};
+
+}  // namespace ovs_p4rt
+
+#endif  // OVSP4RT_TRACE_H_
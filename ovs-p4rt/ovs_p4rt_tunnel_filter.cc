@@ -0,0 +1,89 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ovs_p4rt_tunnel_filter.h"
+
+#include "ovs_p4rt_shadow.h"
+
+namespace ovs_p4rt {
+
+namespace {
+
+constexpr uint8_t kSaturated = UINT8_MAX;
+
+size_t RoundUpToPowerOfTwo(size_t n) {
+  size_t power = 1;
+  while (power < n) power <<= 1;
+  return power;
+}
+
+}  // namespace
+
+TunnelMacFilter::TunnelMacFilter(size_t num_counters)
+    : mask_(RoundUpToPowerOfTwo(num_counters) - 1),
+      counters_(new std::atomic<uint8_t>[mask_ + 1]) {
+  for (size_t i = 0; i <= mask_; i++) {
+    counters_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+void TunnelMacFilter::Indices(uint64_t mac,
+                              size_t indices[kNumHashes]) const {
+  // Double hashing: index i is h1 + i * h2, with h2 odd so the indices
+  // are distinct.
+  const uint64_t hash = ShadowKeyHash(mac);
+  const uint64_t h1 = hash;
+  const uint64_t h2 = (hash >> 32) | 1;
+  for (int i = 0; i < kNumHashes; i++) {
+    indices[i] = (h1 + i * h2) & mask_;
+  }
+}
+
+void TunnelMacFilter::Add(uint64_t mac) {
+  size_t indices[kNumHashes];
+  Indices(mac, indices);
+  for (size_t index : indices) {
+    std::atomic<uint8_t>& counter = counters_[index];
+    uint8_t value = counter.load();
+    while (value != kSaturated &&
+           !counter.compare_exchange_weak(value, value + 1)) {
+    }
+  }
+}
+
+void TunnelMacFilter::Remove(uint64_t mac) {
+  if (!IsSeeded()) return;
+
+  size_t indices[kNumHashes];
+  Indices(mac, indices);
+  for (size_t index : indices) {
+    std::atomic<uint8_t>& counter = counters_[index];
+    uint8_t value = counter.load();
+    while (value != kSaturated && value != 0 &&
+           !counter.compare_exchange_weak(value, value - 1)) {
+    }
+  }
+}
+
+bool TunnelMacFilter::MayContain(uint64_t mac) const {
+  if (!IsSeeded()) return true;
+
+  size_t indices[kNumHashes];
+  Indices(mac, indices);
+  for (size_t index : indices) {
+    if (counters_[index].load() == 0) return false;
+  }
+  return true;
+}
+
+absl::Status TunnelMacFilter::SeedOnce(
+    absl::FunctionRef<absl::Status()> seed) {
+  absl::MutexLock lock(&seed_mu_);
+  if (IsSeeded()) return absl::OkStatus();
+
+  absl::Status status = seed();
+  if (status.ok()) seeded_.store(true);
+  return status;
+}
+
+}  // namespace ovs_p4rt
@@ -0,0 +1,80 @@
+// Copyright 2023 Intel Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef OVSP4RT_TUNNEL_FILTER_H_
+#define OVSP4RT_TUNNEL_FILTER_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include "absl/functional/function_ref.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+
+namespace ovs_p4rt {
+
+// Packs a MAC address into the low 48 bits of an integer.
+inline uint64_t MacToInt(const uint8_t mac[6]) {
+  uint64_t value = 0;
+  for (int i = 0; i < 6; i++) {
+    value = (value << 8) | mac[i];
+  }
+  return value;
+}
+
+// Counting Bloom filter of the MAC addresses learned on tunnels.
+//
+// OVS does not say whether the MAC of an FDB entry it deletes was learned
+// on a tunnel, and on ES2K the sidecar reads the l2_to_tunnel tables to
+// find out. The filter holds a superset of the tunnel-learned MACs on the
+// device: a MAC is added before its tunnel entries are written and only
+// removed after they are deleted. Once the filter has been seeded with the
+// entries installed before it existed, a miss proves that a MAC is not
+// tunnel-learned and the reads can be skipped.
+//
+// Counters saturate instead of overflowing; a saturated counter is never
+// decremented, so it can only cause false positives.
+class TunnelMacFilter {
+ public:
+  // num_counters is rounded up to a power of two.
+  explicit TunnelMacFilter(size_t num_counters);
+
+  // Disable copy semantics.
+  TunnelMacFilter(const TunnelMacFilter&) = delete;
+  TunnelMacFilter& operator=(const TunnelMacFilter&) = delete;
+
+  void Add(uint64_t mac);
+
+  // Removes a MAC that was added, or was installed when the filter was
+  // seeded. Ignored until the filter is seeded, since the MAC may not
+  // have been counted yet.
+  void Remove(uint64_t mac);
+
+  // Returns false only if the MAC is certainly not tunnel-learned. Always
+  // true until the filter is seeded.
+  bool MayContain(uint64_t mac) const;
+
+  bool IsSeeded() const { return seeded_.load(); }
+
+  // Runs seed (which adds the installed MACs) unless the filter is
+  // already seeded, and marks the filter seeded if it succeeds. Callers
+  // are serialized.
+  ::absl::Status SeedOnce(absl::FunctionRef<::absl::Status()> seed);
+
+ private:
+  static constexpr int kNumHashes = 3;
+
+  void Indices(uint64_t mac, size_t indices[kNumHashes]) const;
+
+  const size_t mask_;
+  std::unique_ptr<std::atomic<uint8_t>[]> counters_;
+  std::atomic<bool> seeded_{false};
+  absl::Mutex seed_mu_;
+};
+
+}  // namespace ovs_p4rt
+
+#endif  // OVSP4RT_TUNNEL_FILTER_H_